@@ -1,10 +1,14 @@
 #include "ClientApp.h"
+#include "../common/Platform.h"
 #include <iostream>
 #include <string>
 #include <cstring>
 #include <limits> 
+#include <clocale>
+#include <sstream>
+#include <vector>
 
-ClientApp::ClientApp(const std::string& pipeName) : client(pipeName) {}
+ClientApp::ClientApp(const std::string& pipeName) : client(pipeName), shmMode(-1) {}
 
 void ClientApp::run() {
     setlocale(LC_ALL, "Russian");
@@ -15,9 +19,15 @@ void ClientApp::run() {
         return;
     }
 
+#ifdef __linux__
+    if (shmMode >= 0 && !client.attachSharedMemory(static_cast<ShmWaitMode>(shmMode))) {
+        std::cerr << "Shared memory channel unavailable, using socket\n";
+    }
+#endif
+
     bool running = true;
     while (running) {
-        std::cout << "\n1 - Record modification\n2 - Record reading\n3 - Exit\nChoose: ";
+        std::cout << "\n1 - Record modification\n2 - Record reading\n3 - Record creation\n4 - Record deletion\n5 - Record search\n6 - Hours report\n7 - Consistent read of several records\n8 - Update several records together\n9 - Exit\nChoose: ";
         int choice;
         std::cin >> choice;
 
@@ -32,6 +42,24 @@ void ClientApp::run() {
             readRecord();
             break;
         case 3:
+            createRecord();
+            break;
+        case 4:
+            deleteRecord();
+            break;
+        case 5:
+            searchRecords();
+            break;
+        case 6:
+            hoursReport();
+            break;
+        case 7:
+            snapshotRead();
+            break;
+        case 8:
+            updateTogether();
+            break;
+        case 9:
             client.sendMessage({ CLIENT_EXIT, 0, {} });
             running = false;
             break;
@@ -70,6 +98,10 @@ void ClientApp::modifyRecord() {
         return;
     }
 
+    if (resp.type == LOCK_TIMEOUT) {
+        std::cout << "Record is busy, try again later\n";
+        return;
+    }
     if (resp.id == -1) {
         std::cout << "Record wasn't found\n";
         return;
@@ -100,7 +132,7 @@ void ClientApp::modifyRecord() {
     newE.name[sizeof(newE.name) - 1] = '\0';
     newE.hours = newHours;
 
-    Message updateMessage{ WRITE_UPDATE, newE.num, newE };
+    Message updateMessage{ WRITE_UPDATE, newE.num, 0, newE };
 
     if (!client.sendMessage(updateMessage)) {
         std::cout << "Error occurred while sending message to the server\n";
@@ -137,11 +169,18 @@ void ClientApp::readRecord() {
     
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-    client.sendMessage({ READ_LOCK, id });
-    
     Message resp;
-    if (!client.recvMessage(resp)) return;
+    if (client.caching) {
+        if (!client.readCached(id, resp)) return;
+    } else {
+        client.sendMessage({ READ_OPTIMISTIC, id });
+        if (!client.recvMessage(resp)) return;
+    }
     
+    if (resp.type == LOCK_TIMEOUT) {
+        std::cout << "Record is busy, try again later\n";
+        return;
+    }
     if (resp.id == -1) {
         std::cout << "Record wasn't found\n";
         return;
@@ -150,13 +189,215 @@ void ClientApp::readRecord() {
     Employee e = resp.emp;
     std::cout << "Reading: " << e.num << " " << e.name << " " << e.hours << "\n";
     
-    client.sendMessage({ UNLOCK, id });
-    
-    Message unlockResp;
-    if (!client.recvMessage(unlockResp)) {
-        std::cout << "Error unlocking record\n";
-    }
-    
     std::cout << "Press Enter to continue...";
     std::cin.get();
-}
\ No newline at end of file
+}
+
+void ClientApp::createRecord() {
+    Employee e{};
+    std::cout << "ID: ";
+    while (!(std::cin >> e.num)) {
+        std::cout << "Invalid input! Please enter a valid integer for ID.\n";
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cout << "ID: ";
+    }
+    std::string name;
+    std::cout << "name: ";
+    std::cin >> name;
+    strncpy_s(e.name, name.c_str(), sizeof(e.name) - 1);
+    std::cout << "hours: ";
+    while (!(std::cin >> e.hours)) {
+        std::cout << "Invalid input! Please enter a valid number for hours.\n";
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cout << "hours: ";
+    }
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    Message resp;
+    if (!client.sendMessage({ CREATE_RECORD, e.num, 0, e }) || !client.recvMessage(resp)) {
+        std::cout << "Error occurred while talking to the server\n";
+        return;
+    }
+    if (resp.id == -1) {
+        std::cout << "Record wasn't created (ID already exists?)\n";
+    } else {
+        std::cout << "Record created\n";
+    }
+}
+
+void ClientApp::deleteRecord() {
+    int id;
+    std::cout << "Enter ID for deletion: ";
+    while (!(std::cin >> id)) {
+        std::cout << "Invalid input! Please enter a valid integer for ID.\n";
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cout << "Enter ID for deletion: ";
+    }
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    Message resp;
+    if (!client.sendMessage({ WRITE_LOCK, id }) || !client.recvMessage(resp)) {
+        std::cout << "Error occurred while talking to the server\n";
+        return;
+    }
+    if (resp.type == LOCK_TIMEOUT) {
+        std::cout << "Record is busy, try again later\n";
+        return;
+    }
+    if (resp.id == -1) {
+        std::cout << "Record wasn't found\n";
+        return;
+    }
+
+    // A successful delete releases the lock, a failed one does not.
+    if (!client.sendMessage({ DELETE_RECORD, id }) || !client.recvMessage(resp)) {
+        std::cout << "Error occurred while talking to the server\n";
+        return;
+    }
+    if (resp.id == -1) {
+        std::cout << "Record deletion failed\n";
+        Message unlockResp;
+        client.sendMessage({ UNLOCK, id });
+        client.recvMessage(unlockResp);
+    } else {
+        std::cout << "Record deleted\n";
+    }
+}
+
+void ClientApp::searchRecords() {
+    int by;
+    std::cout << "1 - by name prefix\n2 - by hours range\nChoose: ";
+    std::cin >> by;
+    std::cin.clear();
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+    Message req{ SCAN, by };
+    if (by == SCAN_NAME_PREFIX) {
+        std::string prefix;
+        std::cout << "Name prefix: ";
+        std::getline(std::cin, prefix);
+        strncpy_s(req.emp.name, prefix.c_str(), sizeof(req.emp.name) - 1);
+    } else if (by == SCAN_HOURS_RANGE) {
+        double lo, hi;
+        std::cout << "From hours: ";
+        while (!(std::cin >> lo)) {
+            std::cout << "Invalid input! Please enter a valid number for hours.\n";
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            std::cout << "From hours: ";
+        }
+        std::cout << "To hours: ";
+        while (!(std::cin >> hi)) {
+            std::cout << "Invalid input! Please enter a valid number for hours.\n";
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            std::cout << "To hours: ";
+        }
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        req.emp.hours = lo;
+        setUpperBound(req, hi);
+    } else {
+        std::cout << "Wrong choice\n";
+        return;
+    }
+
+    std::vector<Employee> rows;
+    if (!client.scan(req, rows)) {
+        std::cout << "Error occurred while talking to the server\n";
+        return;
+    }
+    for (const Employee& e : rows) {
+        std::cout << e.num << " " << e.name << " " << e.hours << "\n";
+    }
+    std::cout << rows.size() << " record(s) found\n";
+}
+
+void ClientApp::hoursReport() {
+    const int ops[] = { AGG_SUM, AGG_MIN, AGG_MAX };
+    Message resp[3];
+    for (int i = 0; i < 3; ++i) {
+        if (!client.sendMessage({ AGGREGATE, ops[i] }) || !client.recvMessage(resp[i]) || resp[i].id == -1) {
+            std::cout << "Error occurred while talking to the server\n";
+            return;
+        }
+    }
+    std::cout << "Records: " << resp[0].id << "\n";
+    if (resp[0].id > 0) {
+        std::cout << "Total hours: " << resp[0].emp.hours << "\nMin hours: " << resp[1].emp.hours
+                  << "\nMax hours: " << resp[2].emp.hours << "\n";
+    }
+}
+
+// All records come from one snapshot, so they show a single point in time
+// even while other clients update them.
+void ClientApp::snapshotRead() {
+    std::string line;
+    std::cout << "IDs separated by spaces: ";
+    std::getline(std::cin, line);
+    std::istringstream in(line);
+    std::vector<int> ids;
+    int id;
+    while (in >> id) ids.push_back(id);
+    if (ids.empty()) {
+        std::cout << "No IDs given\n";
+        return;
+    }
+
+    Message resp;
+    if (!client.sendMessage({ SNAPSHOT_OPEN, 0 }) || !client.recvMessage(resp) || resp.id == -1) {
+        std::cout << "Error occurred while talking to the server\n";
+        return;
+    }
+    int snapshot = resp.id;
+    for (int rid : ids) {
+        Message req{ SNAPSHOT_READ, rid };
+        req.emp.num = snapshot;
+        if (!client.sendMessage(req) || !client.recvMessage(resp)) {
+            std::cout << "Error occurred while talking to the server\n";
+            return;
+        }
+        if (resp.id == -1) {
+            std::cout << rid << ": record wasn't found\n";
+        } else {
+            std::cout << resp.emp.num << " " << resp.emp.name << " " << resp.emp.hours << "\n";
+        }
+    }
+    client.sendMessage({ SNAPSHOT_CLOSE, snapshot });
+    client.recvMessage(resp);
+}
+
+// The server locks and writes all records in one request, so either every
+// update is applied or none is.
+void ClientApp::updateTogether() {
+    std::vector<Employee> records;
+    std::string line;
+    std::cout << "One record per line as \"ID name hours\", empty line to finish:\n";
+    while (std::getline(std::cin, line) && !line.empty()) {
+        std::istringstream in(line);
+        Employee e{};
+        std::string name;
+        if (!(in >> e.num >> name >> e.hours)) {
+            std::cout << "Invalid input! Expected \"ID name hours\".\n";
+            continue;
+        }
+        strncpy_s(e.name, name.c_str(), sizeof(e.name) - 1);
+        records.push_back(e);
+    }
+    if (records.empty()) {
+        std::cout << "No records given\n";
+        return;
+    }
+    if (records.size() > static_cast<size_t>(MAX_TXN_RECORDS)) {
+        std::cout << "At most " << MAX_TXN_RECORDS << " records at once\n";
+        return;
+    }
+
+    if (client.transaction(records)) {
+        std::cout << records.size() << " record(s) changed\n";
+    } else {
+        std::cout << "Records weren't changed (missing, repeated or busy ID?)\n";
+    }
+}
@@ -8,6 +8,13 @@ public:
 
 public:
     PipeClient client;
+    int shmMode;
     void modifyRecord();
     void readRecord();
+    void createRecord();
+    void deleteRecord();
+    void searchRecords();
+    void hoursReport();
+    void snapshotRead();
+    void updateTogether();
 };
\ No newline at end of file
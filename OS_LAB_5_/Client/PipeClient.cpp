@@ -1,15 +1,292 @@
 #include "PipeClient.h"
+#include "../common/Platform.h"
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <iostream>
-#include <windows.h> 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
-PipeClient::PipeClient(const std::string& pipeName) : pipeName(pipeName), hPipe(INVALID_HANDLE_VALUE) {}
+#ifdef _WIN32
+PipeClient::PipeClient(const std::string& pipeName)
+    : pipeName(pipeName), nextReqId(1), inboxCount(0), inboxPos(0), hPipe(INVALID_HANDLE_VALUE),
+      asyncRunning(false), asyncFailed(false) {}
+#else
+PipeClient::PipeClient(const std::string& pipeName)
+    : pipeName(pipeName), nextReqId(1), inboxCount(0), inboxPos(0), fd(-1),
+      asyncRunning(false), asyncFailed(false) {}
+#endif
 PipeClient::~PipeClient() { close(); }
 
+uint32_t PipeClient::takeReqId() {
+    uint32_t id = nextReqId++;
+    if (nextReqId == 0) nextReqId = 1;
+    return id;
+}
+
+uint32_t PipeClient::submit(const Message& msg) {
+    Message req = msg;
+    req.reqId = takeReqId();
+    return sendMessage(req) ? req.reqId : 0;
+}
+
+bool PipeClient::waitResponse(uint32_t reqId, Message& resp) {
+    auto it = early.find(reqId);
+    if (it != early.end()) {
+        resp = it->second;
+        early.erase(it);
+        return true;
+    }
+
+    Message msg;
+    while (recvMessage(msg)) {
+        if (msg.reqId == reqId) {
+            resp = msg;
+            return true;
+        }
+        early[msg.reqId] = msg;
+    }
+    return false;
+}
+
+// Responses to other pipelined requests that arrive in between are kept for
+// waitResponse.
+bool PipeClient::scan(const Message& req, std::vector<Employee>& rows) {
+    rows.clear();
+    uint32_t reqId = submit(req);
+    if (reqId == 0) return false;
+
+    Message msg;
+    while (recvMessage(msg)) {
+        if (msg.reqId != reqId) {
+            early[msg.reqId] = msg;
+            continue;
+        }
+        if (msg.type == SCAN_END) return msg.id >= 0;
+        rows.push_back(msg.emp);
+    }
+    return false;
+}
+
+bool PipeClient::transaction(const std::vector<Employee>& records) {
+    uint32_t reqId = takeReqId();
+    std::vector<Message> reqs;
+    for (const Employee& e : records) {
+        reqs.push_back({ TXN_ITEM, e.num, reqId, e });
+    }
+    reqs.push_back({ TXN_COMMIT, static_cast<int>(records.size()), reqId, {} });
+
+    for (size_t i = 0; i < reqs.size(); i += MAX_BATCH_MESSAGES) {
+        size_t n = std::min(reqs.size() - i, static_cast<size_t>(MAX_BATCH_MESSAGES));
+        if (!sendBatch(reqs.data() + i, n)) return false;
+    }
+    Message resp;
+    return waitResponse(reqId, resp) && resp.type == TXN_COMMIT && resp.id == static_cast<int>(records.size());
+}
+
+bool PipeClient::sendMessage(const Message& msg) {
+    bool success = sendBatch(&msg, 1);
+    if (!success) {
+        std::cerr << "Client Error: Failed to send message of type " << msg.type << "\n";
+    }
+    return success;
+}
+
+bool PipeClient::recvMessage(Message& msg) {
+    if (!arrived.empty()) {
+        msg = arrived.front();
+        arrived.pop_front();
+        return true;
+    }
+    bool success;
+    while ((success = receive(msg)) && !noteIncoming(msg)) {}
+    if (!success) {
+        std::cerr << "Client Error: Failed to receive message\n";
+    }
+    return success;
+}
+
+bool PipeClient::readCached(int id, Message& resp) {
+    if (caching) {
+        takeArrived();
+        std::lock_guard<std::mutex> lk(cacheMutex);
+        auto it = cache.find(id);
+        if (it != cache.end() && it->second.valid) {
+            resp = { READ_CACHED, id, 0, it->second.emp };
+            return true;
+        }
+    }
+    uint32_t reqId = submit({ READ_CACHED, id });
+    return reqId != 0 && waitResponse(reqId, resp);
+}
+
+// Applies the INVALIDATEs already received and keeps the rest for
+// recvMessage().
+void PipeClient::takeArrived() {
+    Message msg;
+    while (readable()) {
+        if (!receive(msg)) return;
+        if (noteIncoming(msg)) arrived.push_back(msg);
+    }
+}
+
+void PipeClient::noteOutgoing(const Message* msgs, size_t count) {
+    if (!caching) return;
+    std::lock_guard<std::mutex> lk(cacheMutex);
+    for (size_t i = 0; i < count; ++i) {
+        const Message& m = msgs[i];
+        if (m.type == READ_CACHED) cache.insert({ m.id, CacheEntry{ {}, false } });
+        else if (m.type == WRITE_UPDATE || m.type == DELETE_RECORD) cache.erase(m.id);
+        else if (m.type == TXN_ITEM) cache.erase(m.emp.num);
+    }
+}
+
+// Returns false for a message that only updates the cache and is no answer.
+bool PipeClient::noteIncoming(const Message& msg) {
+    if (msg.type != INVALIDATE && msg.type != READ_CACHED) return true;
+    if (!caching) return msg.type != INVALIDATE;
+
+    std::lock_guard<std::mutex> lk(cacheMutex);
+    if (msg.type == INVALIDATE) {
+        cache.erase(msg.id);
+        return false;
+    }
+    auto it = cache.find(msg.id);
+    if (msg.id >= 0 && it != cache.end()) {
+        it->second.emp = msg.emp;
+        it->second.valid = true;
+    }
+    return true;
+}
+
+bool PipeClient::startAsync() {
+    std::lock_guard<std::mutex> lk(asyncMutex);
+    if (asyncRunning) return true;
+    if (!early.empty() || !arrived.empty() || inboxPos != inboxCount) return false;
+
+    asyncRunning = true;
+    asyncFailed = false;
+    readerActive = true;
+    readerThread = std::thread(&PipeClient::readerLoop, this);
+    writerThread = std::thread(&PipeClient::writerLoop, this);
+    return true;
+}
+
+bool PipeClient::submitAsync(const Message& msg, ResponseCallback done) {
+    std::lock_guard<std::mutex> lk(asyncMutex);
+    if (!asyncRunning || asyncFailed) return false;
+
+    Message req = msg;
+    req.reqId = takeReqId();
+    inflight[req.reqId] = std::move(done);
+    outgoing.push_back(req);
+    if (outgoing.size() == 1) {
+        asyncCv.notify_one();
+    }
+    return true;
+}
+
+std::future<Message> PipeClient::submitAsync(const Message& msg) {
+    auto promise = std::make_shared<std::promise<Message>>();
+    std::future<Message> result = promise->get_future();
+    submitAsync(msg, [promise](bool ok, const Message& resp) {
+        if (ok) promise->set_value(resp);
+    });
+    return result;
+}
+
+// Everything queued while the previous write was in flight goes out together,
+// MAX_BATCH_MESSAGES per transport write.
+void PipeClient::writerLoop() {
+    std::vector<Message> batch;
+    std::unique_lock<std::mutex> lk(asyncMutex);
+    while (true) {
+        asyncCv.wait(lk, [this]() { return !outgoing.empty() || !asyncRunning; });
+        if (outgoing.empty()) break;
+
+        batch.swap(outgoing);
+        lk.unlock();
+        bool ok = true;
+        for (size_t i = 0; ok && i < batch.size(); i += MAX_BATCH_MESSAGES) {
+            size_t count = std::min(batch.size() - i, static_cast<size_t>(MAX_BATCH_MESSAGES));
+            ok = sendBatch(&batch[i], count);
+        }
+        batch.clear();
+        lk.lock();
+
+        if (!ok) {
+            asyncFailed = true;
+            lk.unlock();
+            failInflight();
+            return;
+        }
+    }
+}
+
+void PipeClient::readerLoop() {
+    Message msg;
+    while (receive(msg)) {
+        if (!noteIncoming(msg)) continue;
+        ResponseCallback done;
+        {
+            std::lock_guard<std::mutex> lk(asyncMutex);
+            auto it = inflight.find(msg.reqId);
+            if (it == inflight.end()) continue;
+            done = std::move(it->second);
+            inflight.erase(it);
+        }
+        done(true, msg);
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(asyncMutex);
+        asyncFailed = true;
+    }
+    failInflight();
+    readerActive = false;
+}
+
+void PipeClient::failInflight() {
+    std::unordered_map<uint32_t, ResponseCallback> lost;
+    {
+        std::lock_guard<std::mutex> lk(asyncMutex);
+        lost.swap(inflight);
+    }
+    Message none{};
+    for (auto& p : lost) {
+        p.second(false, none);
+    }
+}
+
+// Lets the writer drain what is already queued, then unblocks and joins the reader.
+void PipeClient::stopAsync() {
+    {
+        std::lock_guard<std::mutex> lk(asyncMutex);
+        if (!asyncRunning) return;
+        asyncRunning = false;
+    }
+    asyncCv.notify_all();
+    writerThread.join();
+
+    while (readerActive) {
+        interruptReader();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    readerThread.join();
+}
+
+#ifdef _WIN32
 bool PipeClient::connect() {
     while (true) {
-        hPipe = CreateFileA(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        hPipe = CreateFileA(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
         if (hPipe != INVALID_HANDLE_VALUE) break;
 
         DWORD err = GetLastError();
@@ -25,33 +302,160 @@ bool PipeClient::connect() {
     return true;
 }
 
-bool PipeClient::sendMessage(const Message& msg) {
-    DWORD written;
-    BOOL success = WriteFile(hPipe, &msg, sizeof(msg), &written, nullptr) && written == sizeof(msg);
-    
-    if (success) {
-        FlushFileBuffers(hPipe);
-    }
-    
-    if (!success) {
-        std::cerr << "Client Error: Failed to send message of type " << msg.type << " (Error: " << GetLastError() << ")\n";
+bool PipeClient::sendBatch(const Message* msgs, size_t count) {
+    noteOutgoing(msgs, count);
+    DWORD len = static_cast<DWORD>(count * sizeof(Message));
+    DWORD written = 0;
+    return overlappedTransfer(hPipe, true, const_cast<Message*>(msgs), len, written) && written == len;
+}
+
+bool PipeClient::receive(Message& msg) {
+    if (inboxPos == inboxCount) {
+        DWORD read = 0;
+        if (!overlappedTransfer(hPipe, false, inbox, sizeof(inbox), read) ||
+            read == 0 || read % sizeof(Message) != 0) {
+            return false;
+        }
+        inboxCount = static_cast<int>(read / sizeof(Message));
+        inboxPos = 0;
     }
-    return success;
+    msg = inbox[inboxPos++];
+    return true;
 }
 
-bool PipeClient::recvMessage(Message& msg) {
-    DWORD read;
-    BOOL success = ReadFile(hPipe, &msg, sizeof(msg), &read, nullptr) && read == sizeof(msg);
+bool PipeClient::readable() {
+    if (inboxPos != inboxCount) return true;
+    DWORD available = 0;
+    return PeekNamedPipe(hPipe, NULL, 0, NULL, &available, NULL) && available > 0;
+}
 
-    if (!success) {
-        std::cerr << "Client Error: Failed to receive full message (Read: " << read << ", Expected: " << sizeof(msg) << ", Error: " << GetLastError() << ")\n";
-    }
-    return success;
+void PipeClient::interruptReader() {
+    CancelIoEx(hPipe, NULL);
 }
 
 void PipeClient::close() {
+    stopAsync();
     if (hPipe != INVALID_HANDLE_VALUE) {
         ::CloseHandle(hPipe);
         hPipe = INVALID_HANDLE_VALUE;
     }
-}
\ No newline at end of file
+}
+#else
+bool PipeClient::connect() {
+    sockaddr_un addr{};
+    if (pipeName.size() >= sizeof(addr.sun_path)) return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, pipeName.c_str(), pipeName.size() + 1);
+
+    while (true) {
+        fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) break;
+
+        int err = errno;
+        ::close(fd);
+        fd = -1;
+        if (err == ENOENT || err == ECONNREFUSED || err == EAGAIN) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            continue;
+        }
+        else return false;
+    }
+    return true;
+}
+
+bool PipeClient::sendBatch(const Message* msgs, size_t count) {
+    noteOutgoing(msgs, count);
+#ifdef __linux__
+    if (shm) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!shm->sendMessage(msgs[i])) return false;
+        }
+        return true;
+    }
+#endif
+    ssize_t len = static_cast<ssize_t>(count * sizeof(Message));
+    ssize_t n;
+    do {
+        n = ::send(fd, msgs, len, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == len;
+}
+
+bool PipeClient::receive(Message& msg) {
+#ifdef __linux__
+    if (shm) return shm->recvMessage(msg);
+#endif
+    if (inboxPos == inboxCount) {
+        ssize_t n;
+        do {
+            n = ::recv(fd, inbox, sizeof(inbox), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0 || n % sizeof(Message) != 0) {
+            return false;
+        }
+        inboxCount = static_cast<int>(n / sizeof(Message));
+        inboxPos = 0;
+    }
+    msg = inbox[inboxPos++];
+    return true;
+}
+
+bool PipeClient::readable() {
+#ifdef __linux__
+    if (shm) return shm->readable();
+#endif
+    if (inboxPos != inboxCount) return true;
+    pollfd p{ fd, POLLIN, 0 };
+    return ::poll(&p, 1, 0) > 0;
+}
+
+void PipeClient::interruptReader() {
+#ifdef __linux__
+    if (shm) {
+        shm->shutdown();
+        return;
+    }
+#endif
+    ::shutdown(fd, SHUT_RDWR);
+}
+
+void PipeClient::close() {
+    stopAsync();
+#ifdef __linux__
+    shm.reset();
+#endif
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+#ifdef __linux__
+bool PipeClient::attachSharedMemory(ShmWaitMode mode) {
+    static std::atomic<int> counter{0};
+    std::string name = "/EmployeeShm." + std::to_string(getpid()) + "." + std::to_string(counter++);
+
+    auto channel = std::make_unique<ShmTransport>();
+    if (!channel->create(name, mode)) {
+        return false;
+    }
+
+    Message req{};
+    req.type = SHM_ATTACH;
+    req.id = mode;
+    strncpy_s(req.emp.name, name.c_str(), sizeof(req.emp.name) - 1);
+
+    Message resp{};
+    bool attached = sendMessage(req) && recvMessage(resp) && resp.type == SHM_ATTACH && resp.id == 0;
+    channel->unlink();
+    if (!attached) {
+        return false;
+    }
+
+    channel->peerFd = fd;
+    shm = std::move(channel);
+    return true;
+}
+#endif
+#endif
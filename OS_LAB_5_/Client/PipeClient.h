@@ -1,33 +1,120 @@
 #pragma once
 #include "../common/Employee.h"
+#include "../common/Message.h"
+#include "../common/Transport.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#ifdef __linux__
+#include "../common/ShmTransport.h"
+#include <memory>
+#endif
 
-struct Message {
-    int type;
-    int id;
-    Employee emp;
-};
-
-enum MsgType {
-    READ_LOCK = 1,
-    WRITE_LOCK,
-    WRITE_UPDATE,
-    UNLOCK,
-    CLIENT_EXIT
-};
+using ResponseCallback = std::function<void(bool ok, const Message& resp)>;
 
-class PipeClient {
+// Blocking use: sendMessage/recvMessage, or submit/waitResponse to pipeline.
+// After startAsync() a writer thread owns sending (coalescing queued requests
+// into one transport write) and a reader thread completes requests by reqId;
+// from then on only the submitAsync overloads and close() may be used.
+//
+// With the read cache enabled, READ_CACHED answers are kept by record ID
+// until the server pushes INVALIDATE for that ID, and readCached() serves
+// them without a round trip. An answer is only kept if no INVALIDATE for its
+// record arrived while it was on the way, and writing a record through this
+// client drops it at once. INVALIDATEs are consumed on receipt and never
+// returned by recvMessage(). A blocking client does not read while idle, so
+// readCached() first takes whatever has already arrived, without waiting.
+class PipeClient : public Transport {
 public:
     PipeClient(const std::string& pipeName);
     ~PipeClient();
 
     bool connect();
-    bool sendMessage(const Message& msg);
-    bool recvMessage(Message& msg);
-    void close();
+    bool sendMessage(const Message& msg) override;
+    bool recvMessage(Message& msg) override;
+    void close() override;
+
+    uint32_t submit(const Message& msg);
+    bool waitResponse(uint32_t reqId, Message& resp);
+    // Blocking use only: sends a SCAN and collects its rows up to SCAN_END.
+    bool scan(const Message& req, std::vector<Employee>& rows);
+    // Blocking use only: sends the records as TXN_ITEMs plus a TXN_COMMIT in
+    // as few transport writes as possible and waits for the commit's answer.
+    bool transaction(const std::vector<Employee>& records);
+    bool sendBatch(const Message* msgs, size_t count);
+    // Call before connecting.
+    void enableCache() { caching = true; }
+    // Blocking use only. resp is the cached or the fresh READ_CACHED answer.
+    bool readCached(int id, Message& resp);
+#ifdef __linux__
+    bool attachSharedMemory(ShmWaitMode mode);
+#endif
+
+    bool startAsync();
+    // done runs on the reader thread; ok is false if the connection was lost.
+    bool submitAsync(const Message& msg, ResponseCallback done);
+    // The future throws std::future_error (broken_promise) if the connection is lost.
+    std::future<Message> submitAsync(const Message& msg);
 
 public:
     std::string pipeName;
+    uint32_t nextReqId;
+    std::map<uint32_t, Message> early;
+    // Taken by takeArrived() and not yet returned by recvMessage().
+    std::deque<Message> arrived;
+    Message inbox[MAX_BATCH_MESSAGES];
+    int inboxCount;
+    int inboxPos;
+#ifdef _WIN32
     HANDLE hPipe;
-};
\ No newline at end of file
+#else
+    int fd;
+#endif
+#ifdef __linux__
+    std::unique_ptr<ShmTransport> shm;
+#endif
+
+    std::mutex asyncMutex;
+    std::condition_variable asyncCv;
+    std::vector<Message> outgoing;
+    std::unordered_map<uint32_t, ResponseCallback> inflight;
+    std::thread readerThread;
+    std::thread writerThread;
+    bool asyncRunning;
+    bool asyncFailed;
+    std::atomic<bool> readerActive{false};
+
+    // valid is false while a READ_CACHED for the record is on the way.
+    struct CacheEntry {
+        Employee emp;
+        bool valid;
+    };
+    bool caching = false;
+    std::mutex cacheMutex;
+    std::unordered_map<int, CacheEntry> cache;
+
+    bool receive(Message& msg);
+    // Whether receive() would return without waiting.
+    bool readable();
+    void takeArrived();
+    void noteOutgoing(const Message* msgs, size_t count);
+    bool noteIncoming(const Message& msg);
+    uint32_t takeReqId();
+    void readerLoop();
+    void writerLoop();
+    void failInflight();
+    void stopAsync();
+    void interruptReader();
+};
@@ -1,7 +1,16 @@
 #include "ClientApp.h"
+#include <cstring>
 
-int main() {
-    ClientApp app(R"(\\.\pipe\EmployeePipe)");
+int main(int argc, char** argv) {
+    ClientApp app(DEFAULT_ENDPOINT);
+    for (int i = 1; i < argc; ++i) {
+        // Keeps read records until the server reports a change.
+        if (std::strcmp(argv[i], "--cache") == 0) app.client.enableCache();
+#ifdef __linux__
+        else if (std::strcmp(argv[i], "--shm") == 0) app.shmMode = SHM_WAIT_FUTEX;
+        else if (std::strcmp(argv[i], "--shm-poll") == 0) app.shmMode = SHM_WAIT_BUSY_POLL;
+#endif
+    }
     app.run();
     return 0;
 }
\ No newline at end of file
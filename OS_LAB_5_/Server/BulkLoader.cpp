@@ -0,0 +1,226 @@
+#include "BulkLoader.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+static const size_t WRITE_CHUNK_BYTES = 8 << 20;
+static const size_t MIN_CHUNK_BYTES = 64 << 10;
+
+struct ParsedChunk {
+    std::vector<Employee> records;
+    size_t lines = 0;
+    size_t badLine = 0;
+    std::string error;
+};
+
+ImportFormat guessImportFormat(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos) {
+        std::string ext = path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+        if (ext == "csv" || ext == "txt") return IMPORT_CSV;
+    }
+    return IMPORT_BINARY;
+}
+
+static unsigned threadCount(unsigned requested, size_t bytes) {
+    unsigned n = requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+    size_t bySize = std::max<size_t>(1, bytes / MIN_CHUNK_BYTES);
+    return static_cast<unsigned>(std::min<size_t>(n, bySize));
+}
+
+static bool readWholeFile(const std::string& path, std::vector<char>& data) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        std::cerr << "Cannot open import file " << path << "\n";
+        return false;
+    }
+    std::streamsize size = in.tellg();
+    in.seekg(0);
+    data.resize(static_cast<size_t>(size));
+    if (size > 0 && !in.read(data.data(), size)) {
+        std::cerr << "Error reading " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+static const char* trimLeft(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+static const char* trimRight(const char* begin, const char* p) {
+    while (p > begin && (p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\r')) --p;
+    return p;
+}
+
+// Parses one line; returns false with a message if it is malformed.
+static bool parseCsvLine(const char* p, const char* end, Employee& e, std::string& error) {
+    const char* comma1 = std::find(p, end, ',');
+    const char* comma2 = comma1 == end ? end : std::find(comma1 + 1, end, ',');
+    if (comma2 == end) {
+        error = "expected num,name,hours";
+        return false;
+    }
+
+    e = Employee{};
+    const char* numBegin = trimLeft(p, comma1);
+    const char* numEnd = trimRight(numBegin, comma1);
+    auto num = std::from_chars(numBegin, numEnd, e.num);
+    if (num.ec != std::errc() || num.ptr != numEnd) {
+        error = "bad ID";
+        return false;
+    }
+
+    const char* nameBegin = trimLeft(comma1 + 1, comma2);
+    const char* nameEnd = trimRight(nameBegin, comma2);
+    size_t nameLen = static_cast<size_t>(nameEnd - nameBegin);
+    if (nameLen == 0 || nameLen >= NAME_SIZE) {
+        error = "name must be 1.." + std::to_string(NAME_SIZE - 1) + " characters";
+        return false;
+    }
+    std::memcpy(e.name, nameBegin, nameLen);
+
+    const char* hoursBegin = trimLeft(comma2 + 1, end);
+    const char* hoursEnd = trimRight(hoursBegin, end);
+    auto hours = std::from_chars(hoursBegin, hoursEnd, e.hours);
+    if (hours.ec != std::errc() || hours.ptr != hoursEnd) {
+        error = "bad hours";
+        return false;
+    }
+    return true;
+}
+
+static void parseCsvChunk(const char* p, const char* end, ParsedChunk& chunk) {
+    chunk.records.reserve(static_cast<size_t>(end - p) / 16);
+    while (p < end) {
+        const char* eol = std::find(p, end, '\n');
+        ++chunk.lines;
+        const char* content = trimRight(p, eol);
+        if (trimLeft(p, content) != content) {
+            Employee e;
+            if (!parseCsvLine(p, content, e, chunk.error)) {
+                chunk.badLine = chunk.lines;
+                return;
+            }
+            chunk.records.push_back(e);
+        }
+        p = eol == end ? end : eol + 1;
+    }
+}
+
+static bool isHeaderLine(const char* p, const char* end) {
+    p = trimLeft(p, end);
+    return p < end && !(*p == '-' || *p == '+' || (*p >= '0' && *p <= '9'));
+}
+
+static bool loadCsv(const std::vector<char>& data, std::vector<Employee>& out, unsigned nThreads) {
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    size_t skippedLines = 0;
+    if (begin < end && isHeaderLine(begin, std::find(begin, end, '\n'))) {
+        const char* eol = std::find(begin, end, '\n');
+        begin = eol == end ? end : eol + 1;
+        skippedLines = 1;
+    }
+
+    // Chunk boundaries are moved forward to the next line start.
+    unsigned n = threadCount(nThreads, static_cast<size_t>(end - begin));
+    std::vector<const char*> bounds(n + 1, end);
+    bounds[0] = begin;
+    for (unsigned i = 1; i < n; ++i) {
+        const char* guess = begin + (end - begin) * static_cast<ptrdiff_t>(i) / n;
+        guess = std::max(guess, bounds[i - 1]);
+        const char* eol = std::find(guess, end, '\n');
+        bounds[i] = eol == end ? end : eol + 1;
+    }
+
+    std::vector<ParsedChunk> chunks(n);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < n; ++i) {
+        workers.emplace_back(parseCsvChunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+    }
+    parseCsvChunk(bounds[0], bounds[1], chunks[0]);
+    for (auto& t : workers) t.join();
+
+    size_t total = 0;
+    size_t line = skippedLines;
+    for (const ParsedChunk& c : chunks) {
+        if (!c.error.empty()) {
+            std::cerr << "Import error at line " << line + c.badLine << ": " << c.error << "\n";
+            return false;
+        }
+        line += c.lines;
+        total += c.records.size();
+    }
+
+    out.clear();
+    out.reserve(total);
+    for (ParsedChunk& c : chunks) {
+        out.insert(out.end(), c.records.begin(), c.records.end());
+        std::vector<Employee>().swap(c.records);
+    }
+    return true;
+}
+
+static bool loadBinary(const std::vector<char>& data, std::vector<Employee>& out, unsigned nThreads) {
+    if (data.size() % sizeof(Employee) != 0) {
+        std::cerr << "Binary import size " << data.size() << " is not a multiple of " << sizeof(Employee) << "\n";
+        return false;
+    }
+    size_t count = data.size() / sizeof(Employee);
+    out.resize(count);
+
+    unsigned n = threadCount(nThreads, data.size());
+    auto copyRange = [&](size_t from, size_t to) {
+        std::memcpy(out.data() + from, data.data() + from * sizeof(Employee), (to - from) * sizeof(Employee));
+        for (size_t i = from; i < to; ++i) {
+            out[i].name[NAME_SIZE - 1] = '\0';
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < n; ++i) {
+        workers.emplace_back(copyRange, count * i / n, count * (i + 1) / n);
+    }
+    copyRange(0, count / n);
+    for (auto& t : workers) t.join();
+    return true;
+}
+
+bool loadEmployees(const std::string& path, ImportFormat format, std::vector<Employee>& out, unsigned nThreads) {
+    std::vector<char> data;
+    if (!readWholeFile(path, data)) {
+        return false;
+    }
+    return format == IMPORT_CSV ? loadCsv(data, out, nThreads) : loadBinary(data, out, nThreads);
+}
+
+bool writeEmployeeFile(const std::string& path, const std::vector<Employee>& records) {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Error openning file: " << path << "\n";
+        return false;
+    }
+    std::setvbuf(f, nullptr, _IONBF, 0);
+
+    const char* p = reinterpret_cast<const char*>(records.data());
+    size_t left = records.size() * sizeof(Employee);
+    bool ok = true;
+    while (ok && left > 0) {
+        size_t n = std::min(left, WRITE_CHUNK_BYTES);
+        ok = std::fwrite(p, 1, n, f) == n;
+        p += n;
+        left -= n;
+    }
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Error writing in file\n";
+    }
+    return ok;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "../common/Employee.h"
+#include <string>
+#include <vector>
+
+enum ImportFormat {
+    IMPORT_CSV,
+    IMPORT_BINARY
+};
+
+ImportFormat guessImportFormat(const std::string& path);
+
+// Reads a whole CSV ("num,name,hours" per line, optional header) or raw binary
+// Employee file and parses it on nThreads threads (0 = one per core), keeping
+// the input order. On error, returns false after describing the problem.
+bool loadEmployees(const std::string& path, ImportFormat format, std::vector<Employee>& out, unsigned nThreads = 0);
+
+// Writes the records as the data file using large sequential writes.
+bool writeEmployeeFile(const std::string& path, const std::vector<Employee>& records);
@@ -0,0 +1,285 @@
+#include "ColumnStore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define COLUMN_SSE2 1
+#if defined(__GNUC__) || defined(__clang__)
+// Compiled for AVX2 per function and picked at run time, so the binary still
+// runs on CPUs without it. MSVC builds stay on SSE2.
+#define COLUMN_AVX2 1
+#define AVX2_KERNEL __attribute__((target("avx2")))
+#endif
+#endif
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+static bool hasAvx2() {
+#ifdef COLUMN_AVX2
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+// Scalar kernels. They also finish the tail the vector loops leave over.
+
+static void summarizeScalar(const double* h, size_t n, HoursSummary& s) {
+    for (size_t i = 0; i < n; ++i) {
+        double x = h[i];
+        if (std::isnan(x)) continue;
+        s.count++;
+        s.sum += x;
+        s.min = std::min(s.min, x);
+        s.max = std::max(s.max, x);
+    }
+}
+
+static size_t countScalar(const double* h, size_t n, double lo, double hi) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        count += h[i] >= lo && h[i] <= hi;
+    }
+    return count;
+}
+
+static void histogramScalar(const double* h, size_t n, double lo, double hi, double scale, std::vector<size_t>& b) {
+    size_t last = b.size() - 1;
+    for (size_t i = 0; i < n; ++i) {
+        double x = h[i];
+        if (!(x >= lo && x <= hi)) continue;
+        size_t at = static_cast<size_t>((x - lo) * scale);
+        b[at > last ? last : at]++;
+    }
+}
+
+#ifdef COLUMN_SSE2
+static size_t laneSum(__m128i v) {
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), v);
+    return static_cast<size_t>(lanes[0] + lanes[1]);
+}
+
+// A lane of an all-ones compare mask is -1 as an integer, so subtracting the
+// mask counts the lanes that passed.
+static void summarizeSse2(const double* h, size_t n, HoursSummary& s) {
+    __m128d sum = _mm_setzero_pd();
+    __m128d mn = _mm_set1_pd(INF);
+    __m128d mx = _mm_set1_pd(-INF);
+    __m128i count = _mm_setzero_si128();
+    const __m128d inf = _mm_set1_pd(INF);
+    const __m128d ninf = _mm_set1_pd(-INF);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(h + i);
+        __m128d ord = _mm_cmpord_pd(x, x);
+        sum = _mm_add_pd(sum, _mm_and_pd(x, ord));
+        mn = _mm_min_pd(mn, _mm_or_pd(_mm_and_pd(ord, x), _mm_andnot_pd(ord, inf)));
+        mx = _mm_max_pd(mx, _mm_or_pd(_mm_and_pd(ord, x), _mm_andnot_pd(ord, ninf)));
+        count = _mm_sub_epi64(count, _mm_castpd_si128(ord));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum);
+    s.sum += lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, mn);
+    s.min = std::min(s.min, std::min(lanes[0], lanes[1]));
+    _mm_storeu_pd(lanes, mx);
+    s.max = std::max(s.max, std::max(lanes[0], lanes[1]));
+    s.count += laneSum(count);
+    summarizeScalar(h + i, n - i, s);
+}
+
+static size_t countSse2(const double* h, size_t n, double lo, double hi) {
+    const __m128d vlo = _mm_set1_pd(lo);
+    const __m128d vhi = _mm_set1_pd(hi);
+    __m128i count = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(h + i);
+        __m128d in = _mm_and_pd(_mm_cmpge_pd(x, vlo), _mm_cmple_pd(x, vhi));
+        count = _mm_sub_epi64(count, _mm_castpd_si128(in));
+    }
+    return laneSum(count) + countScalar(h + i, n - i, lo, hi);
+}
+#endif
+
+#ifdef COLUMN_AVX2
+AVX2_KERNEL static size_t laneSum256(__m256i v) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), v);
+    return static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+// Two independent accumulator sets keep the adds from waiting on each other.
+AVX2_KERNEL static void summarizeAvx2(const double* h, size_t n, HoursSummary& s) {
+    const __m256d inf = _mm256_set1_pd(INF);
+    const __m256d ninf = _mm256_set1_pd(-INF);
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d mn0 = inf, mn1 = inf;
+    __m256d mx0 = ninf, mx1 = ninf;
+    __m256i count = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d x0 = _mm256_loadu_pd(h + i);
+        __m256d x1 = _mm256_loadu_pd(h + i + 4);
+        __m256d ord0 = _mm256_cmp_pd(x0, x0, _CMP_ORD_Q);
+        __m256d ord1 = _mm256_cmp_pd(x1, x1, _CMP_ORD_Q);
+        sum0 = _mm256_add_pd(sum0, _mm256_and_pd(x0, ord0));
+        sum1 = _mm256_add_pd(sum1, _mm256_and_pd(x1, ord1));
+        mn0 = _mm256_min_pd(mn0, _mm256_blendv_pd(inf, x0, ord0));
+        mn1 = _mm256_min_pd(mn1, _mm256_blendv_pd(inf, x1, ord1));
+        mx0 = _mm256_max_pd(mx0, _mm256_blendv_pd(ninf, x0, ord0));
+        mx1 = _mm256_max_pd(mx1, _mm256_blendv_pd(ninf, x1, ord1));
+        count = _mm256_sub_epi64(count, _mm256_castpd_si256(ord0));
+        count = _mm256_sub_epi64(count, _mm256_castpd_si256(ord1));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+    s.sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, _mm256_min_pd(mn0, mn1));
+    s.min = std::min(s.min, std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3])));
+    _mm256_storeu_pd(lanes, _mm256_max_pd(mx0, mx1));
+    s.max = std::max(s.max, std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3])));
+    s.count += laneSum256(count);
+    summarizeScalar(h + i, n - i, s);
+}
+
+AVX2_KERNEL static size_t countAvx2(const double* h, size_t n, double lo, double hi) {
+    const __m256d vlo = _mm256_set1_pd(lo);
+    const __m256d vhi = _mm256_set1_pd(hi);
+    __m256i count = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(h + i);
+        __m256d in = _mm256_and_pd(_mm256_cmp_pd(x, vlo, _CMP_GE_OQ), _mm256_cmp_pd(x, vhi, _CMP_LE_OQ));
+        count = _mm256_sub_epi64(count, _mm256_castpd_si256(in));
+    }
+    return laneSum256(count) + countScalar(h + i, n - i, lo, hi);
+}
+
+// Bucket numbers are computed four at a time; the increments themselves stay
+// scalar since there is no scatter-add.
+AVX2_KERNEL static void histogramAvx2(const double* h, size_t n, double lo, double hi, double scale,
+                                      std::vector<size_t>& b) {
+    const __m256d vlo = _mm256_set1_pd(lo);
+    const __m256d vhi = _mm256_set1_pd(hi);
+    const __m256d vscale = _mm256_set1_pd(scale);
+    const __m128i last = _mm_set1_epi32(static_cast<int>(b.size() - 1));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(h + i);
+        __m256d in = _mm256_and_pd(_mm256_cmp_pd(x, vlo, _CMP_GE_OQ), _mm256_cmp_pd(x, vhi, _CMP_LE_OQ));
+        int mask = _mm256_movemask_pd(in);
+        if (mask == 0) continue;
+        __m256d pos = _mm256_mul_pd(_mm256_sub_pd(_mm256_and_pd(x, in), _mm256_and_pd(vlo, in)), vscale);
+        __m128i at = _mm_min_epi32(_mm256_cvttpd_epi32(pos), last);
+        alignas(16) int32_t idx[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(idx), at);
+        for (int k = 0; k < 4; ++k) {
+            if (mask & (1 << k)) b[idx[k]]++;
+        }
+    }
+    histogramScalar(h + i, n - i, lo, hi, scale, b);
+}
+#endif
+
+HoursSummary summarizeHours(const double* hours, size_t n) {
+    HoursSummary s{0, 0.0, INF, -INF};
+#if defined(COLUMN_AVX2)
+    if (hasAvx2()) summarizeAvx2(hours, n, s);
+    else summarizeSse2(hours, n, s);
+#elif defined(COLUMN_SSE2)
+    summarizeSse2(hours, n, s);
+#else
+    summarizeScalar(hours, n, s);
+#endif
+    if (s.count == 0) {
+        s.min = s.max = std::numeric_limits<double>::quiet_NaN();
+    }
+    return s;
+}
+
+size_t countHoursInRange(const double* hours, size_t n, double lo, double hi) {
+#if defined(COLUMN_AVX2)
+    if (hasAvx2()) return countAvx2(hours, n, lo, hi);
+    return countSse2(hours, n, lo, hi);
+#elif defined(COLUMN_SSE2)
+    return countSse2(hours, n, lo, hi);
+#else
+    return countScalar(hours, n, lo, hi);
+#endif
+}
+
+void histogramHours(const double* hours, size_t n, double lo, double hi, std::vector<size_t>& buckets) {
+    std::fill(buckets.begin(), buckets.end(), 0);
+    if (buckets.empty() || !(lo <= hi)) return;
+    if (lo == hi || !std::isfinite(hi - lo)) {
+        buckets[0] = countHoursInRange(hours, n, lo, hi);
+        return;
+    }
+    double scale = static_cast<double>(buckets.size()) / (hi - lo);
+#ifdef COLUMN_AVX2
+    if (hasAvx2()) {
+        histogramAvx2(hours, n, lo, hi, scale, buckets);
+        return;
+    }
+#endif
+    histogramScalar(hours, n, lo, hi, scale, buckets);
+}
+
+void ColumnStore::grow(size_t n) {
+    if (n <= nums.size()) return;
+    nums.resize(n, FREE_RECORD_ID);
+    hours.resize(n, std::numeric_limits<double>::quiet_NaN());
+    names.resize(n, std::array<char, NAME_SIZE>{});
+}
+
+void ColumnStore::rebuild(const std::vector<Employee>& all) {
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    nums.clear();
+    hours.clear();
+    names.clear();
+    nums.reserve(all.size());
+    hours.reserve(all.size());
+    names.reserve(all.size());
+    for (const Employee& e : all) {
+        bool live = e.num != FREE_RECORD_ID;
+        nums.push_back(e.num);
+        hours.push_back(live ? e.hours : std::numeric_limits<double>::quiet_NaN());
+        names.emplace_back();
+        std::memcpy(names.back().data(), e.name, NAME_SIZE);
+    }
+}
+
+void ColumnStore::set(size_t idx, const Employee& e) {
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    grow(idx + 1);
+    nums[idx] = e.num;
+    hours[idx] = e.num != FREE_RECORD_ID ? e.hours : std::numeric_limits<double>::quiet_NaN();
+    std::memcpy(names[idx].data(), e.name, NAME_SIZE);
+}
+
+size_t ColumnStore::size() const {
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    return nums.size();
+}
+
+HoursSummary ColumnStore::summary() const {
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    return summarizeHours(hours.data(), hours.size());
+}
+
+size_t ColumnStore::countInRange(double lo, double hi) const {
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    return countHoursInRange(hours.data(), hours.size(), lo, hi);
+}
+
+void ColumnStore::histogram(double lo, double hi, std::vector<size_t>& buckets) const {
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    histogramHours(hours.data(), hours.size(), lo, hi, buckets);
+}
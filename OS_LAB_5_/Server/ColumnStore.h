@@ -0,0 +1,48 @@
+#pragma once
+#include "../common/Employee.h"
+#include <array>
+#include <cstddef>
+#include <shared_mutex>
+#include <vector>
+
+struct HoursSummary {
+    size_t count;
+    double sum;
+    double min;
+    double max;
+};
+
+// Kernels over a column of hours. NaN entries are skipped, which is how free
+// slots are kept out of the results. They use AVX2 when the CPU has it and
+// SSE2 otherwise on x86-64, and a plain loop elsewhere.
+HoursSummary summarizeHours(const double* hours, size_t n);
+// Values in [lo, hi].
+size_t countHoursInRange(const double* hours, size_t n, double lo, double hi);
+// buckets.size() equal-width buckets over [lo, hi]; the last one includes hi
+// and values outside the range are not counted.
+void histogramHours(const double* hours, size_t n, double lo, double hi, std::vector<size_t>& buckets);
+
+// Column-wise copy of the records, one array per field, indexed like the
+// records themselves. Free slots hold FREE_RECORD_ID and NaN hours.
+// Aggregates hold the lock shared for a whole pass; a record update takes it
+// exclusively for the one element.
+class ColumnStore {
+public:
+    void rebuild(const std::vector<Employee>& all);
+    // Grows the columns when idx is past the end. A record with
+    // FREE_RECORD_ID is stored as a free slot.
+    void set(size_t idx, const Employee& e);
+    size_t size() const;
+
+    HoursSummary summary() const;
+    size_t countInRange(double lo, double hi) const;
+    void histogram(double lo, double hi, std::vector<size_t>& buckets) const;
+
+public:
+    std::vector<int> nums;
+    std::vector<double> hours;
+    std::vector<std::array<char, NAME_SIZE>> names;
+    mutable std::shared_mutex mutex;
+
+    void grow(size_t n);
+};
@@ -0,0 +1,234 @@
+#include "ConcurrentIndex.h"
+#include <mutex>
+#include <thread>
+#include <utility>
+
+static const size_t MIN_CAPACITY = 16;
+
+// Threads take the reader stripes in turn.
+static size_t readerStripe() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % ConcurrentIndex::READER_STRIPES;
+    return stripe;
+}
+
+ConcurrentIndex::Table::Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<uint64_t>[capacity]) {
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].store(EMPTY_SLOT, std::memory_order_relaxed);
+    }
+}
+
+ConcurrentIndex::ConcurrentIndex()
+    : current(nullptr), readers(new ReaderCount[READER_STRIPES]), epoch(0), flatCount(0), deletedCount(0),
+      directBase(0), directSize(0), denseCount(0) {
+    tables.push_back(std::make_unique<Table>(MIN_CAPACITY));
+    current.store(tables.back().get(), std::memory_order_release);
+}
+
+size_t ConcurrentIndex::slotFor(int key, size_t mask) {
+    return (static_cast<uint32_t>(key) * 2654435761u) & mask;
+}
+
+// The empty pattern is never a real entry because NO_VALUE is not a valid
+// record index.
+bool ConcurrentIndex::find(int key, size_t& value) const {
+    uint64_t offset = static_cast<uint64_t>(key - directBase);
+    if (offset < directSize) {
+        uint32_t v = direct[offset].load(std::memory_order_acquire);
+        if (v == NO_VALUE) return false;
+        value = v;
+        return true;
+    }
+
+    // Counted before the table is loaded, so a rebuild either waits for this
+    // lookup or has published its table before the lookup loads one.
+    std::atomic<size_t>& running = readers[readerStripe()].running[epoch.load(std::memory_order_seq_cst) & 1];
+    running.fetch_add(1, std::memory_order_seq_cst);
+    const Table* t = current.load(std::memory_order_seq_cst);
+    bool found = false;
+    for (size_t i = slotFor(key, t->mask);; i = (i + 1) & t->mask) {
+        uint64_t slot = t->slots[i].load(std::memory_order_acquire);
+        if (slot == EMPTY_SLOT) break;
+        if (keyOf(slot) == key) {
+            found = valueOf(slot) != DELETED;
+            if (found) value = valueOf(slot);
+            break;
+        }
+    }
+    running.fetch_sub(1, std::memory_order_release);
+    return found;
+}
+
+// Slots are only ever claimed, never released, so a key seen once stays put.
+ConcurrentIndex::PlaceResult ConcurrentIndex::place(Table& table, int key, uint32_t value) {
+    uint64_t entry = pack(key, value);
+    for (size_t i = slotFor(key, table.mask);; i = (i + 1) & table.mask) {
+        uint64_t slot = table.slots[i].load(std::memory_order_acquire);
+        if (slot == EMPTY_SLOT &&
+            table.slots[i].compare_exchange_strong(slot, entry, std::memory_order_acq_rel)) {
+            return PLACED;
+        }
+        if (keyOf(slot) != key) continue;
+        while (valueOf(slot) == DELETED) {
+            if (table.slots[i].compare_exchange_weak(slot, entry, std::memory_order_acq_rel)) return REVIVED;
+        }
+        return DUPLICATE;
+    }
+}
+
+// The flat table is kept at most half full; an insert that would cross that
+// line grows it first.
+bool ConcurrentIndex::insert(int key, size_t value) {
+    if (value >= DELETED) return false;
+    uint32_t v = static_cast<uint32_t>(value);
+
+    uint64_t offset = static_cast<uint64_t>(key - directBase);
+    if (offset < directSize) {
+        uint32_t expected = NO_VALUE;
+        if (!direct[offset].compare_exchange_strong(expected, v, std::memory_order_acq_rel)) return false;
+        denseCount.fetch_add(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    while (true) {
+        {
+            std::shared_lock<std::shared_mutex> lk(growMutex);
+            Table* t = current.load(std::memory_order_relaxed);
+            if (flatCount.fetch_add(1, std::memory_order_acq_rel) < t->capacity() / 2) {
+                PlaceResult r = place(*t, key, v);
+                if (r == PLACED) return true;
+                flatCount.fetch_sub(1, std::memory_order_acq_rel);
+                if (r == DUPLICATE) return false;
+                deletedCount.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+            flatCount.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        // Leaves room for half as many again, so a rebuild that only drops
+        // tombstones is not repeated on the next insert.
+        size_t live = flatCount.load(std::memory_order_acquire) - deletedCount.load(std::memory_order_acquire);
+        growTo(live + live / 2 + 1);
+    }
+}
+
+bool ConcurrentIndex::erase(int key) {
+    uint64_t offset = static_cast<uint64_t>(key - directBase);
+    if (offset < directSize) {
+        uint32_t v = direct[offset].load(std::memory_order_acquire);
+        while (v != NO_VALUE) {
+            if (direct[offset].compare_exchange_weak(v, NO_VALUE, std::memory_order_acq_rel)) {
+                denseCount.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_lock<std::shared_mutex> lk(growMutex);
+    Table* t = current.load(std::memory_order_relaxed);
+    for (size_t i = slotFor(key, t->mask);; i = (i + 1) & t->mask) {
+        uint64_t slot = t->slots[i].load(std::memory_order_acquire);
+        if (slot == EMPTY_SLOT) return false;
+        if (keyOf(slot) != key) continue;
+        while (valueOf(slot) != DELETED) {
+            if (t->slots[i].compare_exchange_weak(slot, pack(key, DELETED), std::memory_order_acq_rel)) {
+                deletedCount.fetch_add(1, std::memory_order_acq_rel);
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+void ConcurrentIndex::reserve(size_t n) {
+    growTo(n);
+}
+
+// Picks dense mode when the direct array would be no larger than the flat
+// table it replaces (4 bytes per ID in range against at least 16 per record).
+void ConcurrentIndex::reserveRange(int minKey, int maxKey, size_t count) {
+    uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(maxKey) - minKey) + 1;
+    if (count == 0 || minKey > maxKey || range > 2 * static_cast<uint64_t>(count) || flatCount.load() != 0) {
+        reserve(count);
+        return;
+    }
+    direct.reset(new std::atomic<uint32_t>[range]);
+    for (uint64_t i = 0; i < range; ++i) {
+        direct[i].store(NO_VALUE, std::memory_order_relaxed);
+    }
+    directBase = minKey;
+    directSize = static_cast<size_t>(range);
+    denseCount.store(0, std::memory_order_release);
+}
+
+void ConcurrentIndex::growTo(size_t needed) {
+    std::unique_lock<std::shared_mutex> lk(growMutex);
+    Table* old = current.load(std::memory_order_relaxed);
+    size_t capacity = old->capacity();
+    while (capacity / 2 < needed) capacity *= 2;
+    size_t deleted = deletedCount.load(std::memory_order_relaxed);
+    if (capacity == old->capacity() && (deleted == 0 || flatCount.load(std::memory_order_relaxed) < capacity / 2)) {
+        return;
+    }
+
+    auto grown = std::make_unique<Table>(capacity);
+    for (size_t i = 0; i < old->capacity(); ++i) {
+        uint64_t slot = old->slots[i].load(std::memory_order_relaxed);
+        if (slot != EMPTY_SLOT && valueOf(slot) != DELETED) {
+            place(*grown, keyOf(slot), valueOf(slot));
+        }
+    }
+    flatCount.fetch_sub(deleted, std::memory_order_acq_rel);
+    deletedCount.store(0, std::memory_order_release);
+    current.store(grown.get(), std::memory_order_seq_cst);
+    tables.push_back(std::move(grown));
+    waitForReaders();
+    tables.erase(tables.begin(), tables.end() - 1);
+}
+
+// Waits until every lookup that started before the call is done. Each epoch
+// flip moves new lookups to the other parity, so the one waited for drains
+// even under steady lookup traffic. Two rounds drain both parities, since a
+// lookup may have read the epoch long before it counted itself.
+void ConcurrentIndex::waitForReaders() {
+    for (int round = 0; round < 2; ++round) {
+        size_t old = epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+        for (size_t i = 0; i < READER_STRIPES; ++i) {
+            while (readers[i].running[old].load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+void ConcurrentIndex::clear() {
+    tables.clear();
+    tables.push_back(std::make_unique<Table>(MIN_CAPACITY));
+    current.store(tables.back().get(), std::memory_order_release);
+    flatCount.store(0, std::memory_order_release);
+    deletedCount.store(0, std::memory_order_release);
+    direct.reset();
+    directBase = 0;
+    directSize = 0;
+    denseCount.store(0, std::memory_order_release);
+}
+
+void ConcurrentIndex::swap(ConcurrentIndex& other) {
+    tables.swap(other.tables);
+    Table* mine = current.load(std::memory_order_relaxed);
+    current.store(other.current.load(std::memory_order_relaxed), std::memory_order_release);
+    other.current.store(mine, std::memory_order_release);
+    size_t n = flatCount.load(std::memory_order_relaxed);
+    flatCount.store(other.flatCount.load(std::memory_order_relaxed), std::memory_order_release);
+    other.flatCount.store(n, std::memory_order_release);
+    n = deletedCount.load(std::memory_order_relaxed);
+    deletedCount.store(other.deletedCount.load(std::memory_order_relaxed), std::memory_order_release);
+    other.deletedCount.store(n, std::memory_order_release);
+
+    direct.swap(other.direct);
+    std::swap(directBase, other.directBase);
+    std::swap(directSize, other.directSize);
+    n = denseCount.load(std::memory_order_relaxed);
+    denseCount.store(other.denseCount.load(std::memory_order_relaxed), std::memory_order_release);
+    other.denseCount.store(n, std::memory_order_release);
+}
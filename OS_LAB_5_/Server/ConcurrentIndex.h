@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+// Map from employee ID to record index. find() takes no lock.
+//
+// Flat mode: open addressing with linear probing over 8-byte slots, each one
+// atomic word holding the ID and a 32-bit record index, so a slot is claimed
+// and filled by a single CAS. Inserts may run in parallel; growing the table
+// excludes inserts, rehashes into a table twice as large and publishes it.
+// The rebuild frees the replaced table once every lookup that may hold it is
+// done: lookups count themselves in per-thread stripes, under one of two
+// epochs, and the rebuild waits out the old epoch, which only lookups already
+// running can be in. erase() leaves the ID in its slot
+// with a DELETED index so probe chains stay intact; inserting the ID again
+// revives the slot, and the next rebuild drops the rest.
+//
+// Dense mode: reserveRange() with an ID range no wider than twice the record
+// count adds a direct-addressed array of 32-bit indices for that range. IDs
+// outside it still go to the flat table.
+class ConcurrentIndex {
+public:
+    ConcurrentIndex();
+    ConcurrentIndex(const ConcurrentIndex&) = delete;
+    ConcurrentIndex& operator=(const ConcurrentIndex&) = delete;
+
+    bool find(int key, size_t& value) const;
+    // Returns false (and keeps the old value) if the key is already present
+    // or the value is not below DELETED.
+    bool insert(int key, size_t value);
+    bool erase(int key);
+    void reserve(size_t count);
+    size_t size() const {
+        size_t used = flatCount.load(std::memory_order_acquire);
+        size_t deleted = deletedCount.load(std::memory_order_acquire);
+        return (used > deleted ? used - deleted : 0) + denseCount.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    bool dense() const { return directSize != 0; }
+
+    // Not safe while other threads use the index.
+    void reserveRange(int minKey, int maxKey, size_t count);
+    void clear();
+    void swap(ConcurrentIndex& other);
+
+public:
+    static const uint32_t NO_VALUE = UINT32_MAX;
+    static const uint32_t DELETED = UINT32_MAX - 1;
+    static const uint64_t EMPTY_SLOT = UINT64_MAX;
+
+    struct Table {
+        explicit Table(size_t capacity);
+        size_t capacity() const { return mask + 1; }
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    };
+
+    static const size_t READER_STRIPES = 16;
+
+    // Lookups running, by epoch parity.
+    struct alignas(64) ReaderCount {
+        std::atomic<size_t> running[2] = {0, 0};
+    };
+
+    std::atomic<Table*> current;
+    // current is the last one; the others are only here while a rebuild
+    // waits for the lookups that may still hold them.
+    std::vector<std::unique_ptr<Table>> tables;
+    std::unique_ptr<ReaderCount[]> readers;
+    std::atomic<uint64_t> epoch;
+    // Flat slots in use, tombstones included, and tombstones alone.
+    std::atomic<size_t> flatCount;
+    std::atomic<size_t> deletedCount;
+    std::shared_mutex growMutex;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> direct;
+    int64_t directBase;
+    size_t directSize;
+    std::atomic<size_t> denseCount;
+
+    static uint64_t pack(int key, uint32_t value) { return static_cast<uint64_t>(static_cast<uint32_t>(key)) << 32 | value; }
+    static int keyOf(uint64_t slot) { return static_cast<int>(static_cast<uint32_t>(slot >> 32)); }
+    static uint32_t valueOf(uint64_t slot) { return static_cast<uint32_t>(slot); }
+    static size_t slotFor(int key, size_t mask);
+    enum PlaceResult { PLACED, REVIVED, DUPLICATE };
+    static PlaceResult place(Table& table, int key, uint32_t value);
+    void growTo(size_t needed);
+    void waitForReaders();
+};
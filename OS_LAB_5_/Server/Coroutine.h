@@ -0,0 +1,74 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+
+// Coroutine that runs once it is started and frees its own frame when it
+// returns. onEnd, if set, is called from the frame's destructor, whether the
+// coroutine finished or was destroyed while suspended.
+struct DetachedTask {
+    struct promise_type {
+        std::function<void()> onEnd;
+
+        ~promise_type() {
+            if (onEnd) onEnd();
+        }
+        DetachedTask get_return_object() {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Lazily started coroutine returning a T to the coroutine that awaits it.
+// The awaiting coroutine is resumed directly when this one returns.
+template <typename T>
+class Task {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Resume {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    return h.promise().continuation;
+                }
+                void await_resume() noexcept {}
+            };
+            return Resume{};
+        }
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return std::move(*handle.promise().value); }
+
+public:
+    std::coroutine_handle<promise_type> handle;
+};
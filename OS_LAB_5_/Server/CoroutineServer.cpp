@@ -0,0 +1,424 @@
+#include "CoroutineServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const int MAX_EVENTS = 256;
+
+void ReceiveAwaiter::await_suspend(std::coroutine_handle<> h) {
+    conn.reader = h;
+    server.updateEvents(conn);
+}
+
+bool ReceiveAwaiter::await_resume() {
+    if (conn.inbox.empty()) return false;
+    msg = conn.inbox.front();
+    conn.inbox.pop_front();
+    return true;
+}
+
+void FlushAwaiter::await_suspend(std::coroutine_handle<> h) {
+    conn.flusher = h;
+    server.updateEvents(conn);
+}
+
+// The wake-up runs on the lock waits' notifier thread and only hands the
+// coroutine back to the loop.
+void RecordLockAwaiter::await_suspend(std::coroutine_handle<> h) {
+    CoroutineServer* s = &server;
+    server.app.waitForLock(session, msg, s, deadline, [s, h]() { s->post(h); });
+}
+
+// Races with the completion callback: whichever of the two moves the state
+// second knows the other has run, so the coroutine is resumed exactly once.
+bool WriteAwaiter::await_suspend(std::coroutine_handle<> h) {
+    done.waiter = h;
+    int expected = 0;
+    return done.state.compare_exchange_strong(expected, 1);
+}
+
+CoroutineServer::CoroutineServer(ServerApp& app, int listenFd) : app(app), listenFd(listenFd) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+// Frames still alive belong to requests left waiting for a lock, or to
+// sessions cut short by stop(); destroying the last frame of a session ends it.
+CoroutineServer::~CoroutineServer() {
+    app.manager->lockWaits.cancel(this);
+    while (inflightWrites > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::vector<void*> frames(live.begin(), live.end());
+    for (void* frame : frames) {
+        std::coroutine_handle<>::from_address(frame).destroy();
+    }
+    for (auto& p : conns) {
+        ::close(p.first);
+    }
+    conns.clear();
+    ::close(epfd);
+    ::close(wakeFd);
+}
+
+void CoroutineServer::run(int nClients) {
+    maxClients = nClients;
+    if (maxClients <= 0) return;
+
+    int flags = fcntl(listenFd, F_GETFL, 0);
+    fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev);
+    ev.data.fd = listenFd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev) < 0) {
+        std::cerr << "epoll_ctl(listen) failed: " << std::strerror(errno) << "\n";
+        return;
+    }
+
+    running = true;
+    loopMain();
+    epoll_ctl(epfd, EPOLL_CTL_DEL, listenFd, nullptr);
+}
+
+void CoroutineServer::stop() {
+    running = false;
+    uint64_t one = 1;
+    ssize_t r = ::write(wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+// Events name connections by fd, so one closed by an earlier event of the
+// same batch is simply not found.
+void CoroutineServer::loopMain() {
+    epoll_event events[MAX_EVENTS];
+    while (running) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptClients();
+                continue;
+            }
+            if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t r = ::read(wakeFd, &value, sizeof(value));
+                (void)r;
+                runPosted();
+                continue;
+            }
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            std::shared_ptr<CoConnection> conn = it->second;
+            onEvents(*conn, events[i].events);
+        }
+
+        // Responses produced by this round leave in as few packets as possible.
+        while (!dirty.empty()) {
+            std::vector<std::shared_ptr<CoConnection>> pending;
+            pending.swap(dirty);
+            for (auto& conn : pending) {
+                conn->queuedFlush = false;
+                flush(*conn);
+            }
+        }
+    }
+}
+
+void CoroutineServer::acceptClients() {
+    while (true) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+            }
+            return;
+        }
+        if (accepted++ >= maxClients) {
+            ::close(fd);
+            continue;
+        }
+
+        auto conn = std::make_shared<CoConnection>();
+        conn->fd = fd;
+        epoll_event ev{};
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "epoll_ctl(client) failed: " << std::strerror(errno) << "\n";
+            ::close(fd);
+            if (++finished >= maxClients) running = false;
+            continue;
+        }
+        conns[fd] = conn;
+        spawn(serveSession(conn));
+    }
+}
+
+// Reads only while the inbox is empty, so a session busy with earlier
+// requests is not handed more than it asked for.
+void CoroutineServer::onEvents(CoConnection& conn, uint32_t events) {
+    if (events & EPOLLOUT) flush(conn);
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+
+    Message batch[MAX_BATCH_MESSAGES];
+    while (!conn.eof && conn.inbox.empty()) {
+        ssize_t n = ::recv(conn.fd, batch, sizeof(batch), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            conn.eof = true;
+            break;
+        }
+        if (n == 0 || n % sizeof(Message) != 0) {
+            conn.eof = true;
+            break;
+        }
+        conn.inbox.insert(conn.inbox.end(), batch, batch + n / sizeof(Message));
+    }
+    if (conn.reader && (!conn.inbox.empty() || conn.eof)) {
+        std::coroutine_handle<> h = std::exchange(conn.reader, nullptr);
+        updateEvents(conn);
+        h.resume();
+    }
+}
+
+void CoroutineServer::flush(CoConnection& conn) {
+    Message batch[MAX_BATCH_MESSAGES];
+    while (!conn.outbox.empty() && !conn.eof) {
+        size_t count = std::min(conn.outbox.size(), static_cast<size_t>(MAX_BATCH_MESSAGES));
+        std::copy(conn.outbox.begin(), conn.outbox.begin() + count, batch);
+
+        ssize_t n = ::send(conn.fd, batch, count * sizeof(Message), MSG_NOSIGNAL);
+        if (n == static_cast<ssize_t>(count * sizeof(Message))) {
+            conn.outbox.erase(conn.outbox.begin(), conn.outbox.begin() + count);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+        conn.eof = true;
+    }
+    if (conn.eof) conn.outbox.clear();
+    updateEvents(conn);
+
+    if (conn.outbox.empty() && conn.flusher) {
+        std::exchange(conn.flusher, nullptr).resume();
+    }
+}
+
+void CoroutineServer::updateEvents(CoConnection& conn) {
+    if (conn.fd < 0) return;
+    uint32_t wanted = 0;
+    if (conn.reader && !conn.eof) wanted |= EPOLLIN;
+    if (!conn.outbox.empty() && !conn.eof) wanted |= EPOLLOUT;
+    if (wanted == conn.events) return;
+
+    epoll_event ev{};
+    ev.events = wanted;
+    ev.data.fd = conn.fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.events = wanted;
+}
+
+// Any thread.
+void CoroutineServer::post(std::coroutine_handle<> h) {
+    {
+        std::lock_guard<std::mutex> lk(postedMutex);
+        posted.push_back(h);
+    }
+    uint64_t one = 1;
+    ssize_t r = ::write(wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+// Any thread.
+void CoroutineServer::push(std::weak_ptr<CoConnection> conn, const Message& msg) {
+    {
+        std::lock_guard<std::mutex> lk(postedMutex);
+        pushed.emplace_back(std::move(conn), msg);
+    }
+    uint64_t one = 1;
+    ssize_t r = ::write(wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+void CoroutineServer::runPosted() {
+    std::vector<std::coroutine_handle<>> ready;
+    std::vector<std::pair<std::weak_ptr<CoConnection>, Message>> messages;
+    {
+        std::lock_guard<std::mutex> lk(postedMutex);
+        ready.swap(posted);
+        messages.swap(pushed);
+    }
+    for (auto& p : messages) {
+        std::shared_ptr<CoConnection> conn = p.first.lock();
+        if (!conn || conn->eof) continue;
+        conn->outbox.push_back(p.second);
+        if (!conn->queuedFlush) {
+            conn->queuedFlush = true;
+            dirty.push_back(conn);
+        }
+    }
+    for (std::coroutine_handle<> h : ready) {
+        h.resume();
+    }
+}
+
+void CoroutineServer::spawn(DetachedTask task) {
+    void* frame = task.handle.address();
+    live.insert(frame);
+    task.handle.promise().onEnd = [this, frame]() { live.erase(frame); };
+    task.handle.resume();
+}
+
+DetachedTask CoroutineServer::serveSession(std::shared_ptr<CoConnection> conn) {
+    auto state = std::make_shared<CoSession>();
+    state->app = &app;
+    state->conn = conn;
+    std::weak_ptr<CoConnection> target = conn;
+    app.leases.attach(state->session.leases, [this, target](const Message& msg) { push(target, msg); });
+
+    Message msg;
+    while (co_await receive(*conn, msg)) {
+        Message resp;
+        if (msg.type == SHM_ATTACH) {
+            resp = {SHM_ATTACH, -1, msg.reqId, {}};
+            reply(*state, resp);
+            continue;
+        }
+
+        int key = ServerApp::orderKey(msg);
+        auto queued = state->waiting.find(key);
+        bool behindWrite = msg.type == UNLOCK &&
+                           std::find(state->writing.begin(), state->writing.end(), key) != state->writing.end();
+        if (queued != state->waiting.end() && (behindWrite || ServerApp::ordersBehindPending(state->session, msg))) {
+            queued->second.push_back({msg, app.lockDeadline(), false});
+            continue;
+        }
+
+        RequestStatus status = co_await execute(*state, msg, resp);
+        if (status == REQUEST_BLOCKED) {
+            state->waiting[key].push_back({msg, app.lockDeadline(), false});
+            spawn(drainWaiting(state, key));
+            continue;
+        }
+        if (status == REQUEST_SILENT) continue;
+        reply(*state, resp);
+        if (status == REQUEST_CLOSE) break;
+    }
+
+    co_await flushed(*conn);
+    state->closed = true;
+    state->waiting.clear();
+    app.endSession(state->session);
+    closeConnection(*conn);
+}
+
+// Runs the requests queued under key in order. The head starts out blocked:
+// it waits for its record, retries, and gets LOCK_TIMEOUT once its deadline
+// has passed. Ends when the queue is empty or the session is over.
+DetachedTask CoroutineServer::drainWaiting(std::shared_ptr<CoSession> state, int key) {
+    bool blocked = true;
+    while (!state->closed) {
+        auto it = state->waiting.find(key);
+        if (it == state->waiting.end()) break;
+        if (it->second.empty()) {
+            state->waiting.erase(it);
+            break;
+        }
+        ParkedRequest head = it->second.front();
+
+        Message resp;
+        RequestStatus status;
+        if (blocked) {
+            if (std::chrono::steady_clock::now() < head.deadline) {
+                co_await recordReleased(state->session, head.msg, head.deadline);
+                blocked = false;
+                continue;
+            }
+            ServerApp::lockTimedOut(state->session, head.msg, resp);
+            status = REQUEST_DONE;
+        } else {
+            status = co_await execute(*state, head.msg, resp);
+            if (status == REQUEST_BLOCKED) {
+                blocked = true;
+                continue;
+            }
+        }
+        if (state->closed) break;
+        state->waiting[key].pop_front();
+        if (status != REQUEST_SILENT) reply(*state, resp);
+    }
+}
+
+// A WRITE_UPDATE or TXN_COMMIT that gets to its disk write suspends the
+// calling coroutine until the write completes on io_uring or on writer().
+Task<RequestStatus> CoroutineServer::execute(CoSession& state, const Message& msg, Message& resp) {
+    if (msg.type != WRITE_UPDATE && msg.type != TXN_COMMIT) {
+        co_return app.processRequest(state.session, msg, resp, false);
+    }
+
+    auto done = std::make_shared<WriteCompletion>();
+    inflightWrites.fetch_add(1);
+    RequestStatus status = app.processRequest(
+        state.session, msg, resp, false,
+        [this, done](const Message& r) {
+            done->resp = r;
+            if (done->state.exchange(2) == 1) post(done->waiter);
+            inflightWrites.fetch_sub(1);
+        },
+        [this](std::function<void()> write) { writer().submit(std::move(write)); });
+    if (status != REQUEST_PENDING) {
+        inflightWrites.fetch_sub(1);
+        co_return status;
+    }
+    int key = ServerApp::orderKey(msg);
+    state.writing.push_back(key);
+    resp = co_await WriteAwaiter{*done};
+    state.writing.erase(std::find(state.writing.begin(), state.writing.end(), key));
+    co_return REQUEST_DONE;
+}
+
+// Loop thread only.
+WorkStealingPool& CoroutineServer::writer() {
+    if (app.pool) return *app.pool;
+    if (!disk) disk.reset(new WorkStealingPool(1));
+    return *disk;
+}
+
+void CoroutineServer::reply(CoSession& state, const Message& resp) {
+    if (state.closed) return;
+    CoConnection& conn = *state.conn;
+    conn.outbox.insert(conn.outbox.end(), state.session.streamed.begin(), state.session.streamed.end());
+    state.session.streamed.clear();
+    conn.outbox.push_back(resp);
+    if (!conn.queuedFlush) {
+        conn.queuedFlush = true;
+        dirty.push_back(state.conn);
+    }
+}
+
+void CoroutineServer::closeConnection(CoConnection& conn) {
+    int fd = conn.fd;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    conn.fd = -1;
+    conn.eof = true;
+    conns.erase(fd);
+    if (++finished >= maxClients) running = false;
+}
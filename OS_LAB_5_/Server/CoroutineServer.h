@@ -0,0 +1,158 @@
+#pragma once
+#include "Coroutine.h"
+#include "ServerApp.h"
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class CoroutineServer;
+
+// A client socket as its session coroutine sees it. The loop reads packets
+// into inbox and sends outbox; only the loop thread touches it.
+struct CoConnection {
+    int fd;
+    std::deque<Message> inbox;
+    std::deque<Message> outbox;
+    // The peer is gone or the socket failed; nothing more comes in.
+    bool eof = false;
+    bool queuedFlush = false;
+    uint32_t events = 0;
+    std::coroutine_handle<> reader;
+    std::coroutine_handle<> flusher;
+};
+
+// State shared by a session's coroutines: the one reading requests and one
+// per order key with requests waiting for a record lock. A session whose
+// frames are destroyed before it closed releases its locks here.
+struct CoSession {
+    ServerApp* app = nullptr;
+    Session session;
+    std::shared_ptr<CoConnection> conn;
+    std::map<int, std::deque<ParkedRequest>> waiting;
+    // Order keys whose queue head is waiting for its disk write.
+    std::vector<int> writing;
+    bool closed = false;
+
+    ~CoSession() {
+        if (!closed && app) app->endSession(session);
+    }
+};
+
+// Response of an asynchronous write, handed from the I/O completion thread
+// to the coroutine waiting for it.
+struct WriteCompletion {
+    std::atomic<int> state{0};
+    Message resp;
+    std::coroutine_handle<> waiter;
+};
+
+// Completes once the next request is in msg; false once the peer is gone.
+struct ReceiveAwaiter {
+    CoroutineServer& server;
+    CoConnection& conn;
+    Message& msg;
+
+    bool await_ready() const { return !conn.inbox.empty() || conn.eof; }
+    void await_suspend(std::coroutine_handle<> h);
+    bool await_resume();
+};
+
+// Completes once everything queued for the connection has been sent.
+struct FlushAwaiter {
+    CoroutineServer& server;
+    CoConnection& conn;
+
+    bool await_ready() const { return conn.outbox.empty() || conn.eof; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() {}
+};
+
+// Completes when the record a blocked request waits for is released or the
+// request's deadline passes; the request still has to retry the lock.
+struct RecordLockAwaiter {
+    CoroutineServer& server;
+    const Session& session;
+    const Message& msg;
+    LockDeadline deadline;
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() {}
+};
+
+struct WriteAwaiter {
+    WriteCompletion& done;
+
+    bool await_ready() const { return done.state.load() == 2; }
+    bool await_suspend(std::coroutine_handle<> h);
+    Message await_resume() { return done.resp; }
+};
+
+// Serves every client from one thread with a coroutine per session. A
+// session suspends, keeping only its coroutine frame, while it waits for a
+// request, for its responses to drain, for a record lock (through the record
+// manager's LockWaits) or for an asynchronous disk write. Requests that wait
+// for a lock are queued per order key like on the other paths, so the session
+// keeps answering its other requests. Disk writes never run on the loop: they
+// go to io_uring, or to the pool (a disk thread of the server's without one).
+// SHM_ATTACH is refused.
+class CoroutineServer {
+public:
+    CoroutineServer(ServerApp& app, int listenFd);
+    ~CoroutineServer();
+
+    void run(int nClients);
+    void stop();
+
+public:
+    ServerApp& app;
+    int listenFd;
+    int epfd;
+    int wakeFd;
+    std::atomic<bool> running{false};
+    int maxClients = 0;
+    int accepted = 0;
+    int finished = 0;
+    std::unordered_map<int, std::shared_ptr<CoConnection>> conns;
+    // Connections with responses queued this round.
+    std::vector<std::shared_ptr<CoConnection>> dirty;
+    // Coroutines resumed from other threads, run by the loop.
+    std::mutex postedMutex;
+    std::vector<std::coroutine_handle<>> posted;
+    // INVALIDATEs pushed to connections from other threads.
+    std::vector<std::pair<std::weak_ptr<CoConnection>, Message>> pushed;
+    // Frames of the session coroutines still alive.
+    std::unordered_set<void*> live;
+    std::atomic<int> inflightWrites{0};
+    // Runs writes without io_uring when the app has no pool.
+    std::unique_ptr<WorkStealingPool> disk;
+
+    void loopMain();
+    void acceptClients();
+    void onEvents(CoConnection& conn, uint32_t events);
+    void flush(CoConnection& conn);
+    void updateEvents(CoConnection& conn);
+    void post(std::coroutine_handle<> h);
+    void push(std::weak_ptr<CoConnection> conn, const Message& msg);
+    void runPosted();
+    void spawn(DetachedTask task);
+    WorkStealingPool& writer();
+
+    DetachedTask serveSession(std::shared_ptr<CoConnection> conn);
+    DetachedTask drainWaiting(std::shared_ptr<CoSession> state, int key);
+    Task<RequestStatus> execute(CoSession& state, const Message& msg, Message& resp);
+    void reply(CoSession& state, const Message& resp);
+    void closeConnection(CoConnection& conn);
+
+    ReceiveAwaiter receive(CoConnection& conn, Message& msg) { return {*this, conn, msg}; }
+    FlushAwaiter flushed(CoConnection& conn) { return {*this, conn}; }
+    RecordLockAwaiter recordReleased(const Session& session, const Message& msg, LockDeadline deadline) {
+        return {*this, session, msg, deadline};
+    }
+};
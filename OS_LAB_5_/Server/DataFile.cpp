@@ -0,0 +1,238 @@
+#include "DataFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define DATA_FILE_SSE42 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSE42_KERNEL
+#else
+#define SSE42_KERNEL __attribute__((target("sse4.2")))
+#endif
+#endif
+
+static const size_t MIN_BLOCKS_PER_THREAD = 64;
+static const uint64_t BLOCK_BYTES = PACKED_RECORDS_PER_BLOCK * PACKED_RECORD_SIZE + sizeof(uint32_t);
+
+static const uint32_t* crcTable() {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+    return table;
+}
+
+static uint32_t crc32cSoftware(const unsigned char* p, size_t len, uint32_t crc) {
+    const uint32_t* table = crcTable();
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef DATA_FILE_SSE42
+static bool hasSse42() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    static const bool has = (info[2] & (1 << 20)) != 0;
+#else
+    static const bool has = __builtin_cpu_supports("sse4.2");
+#endif
+    return has;
+}
+
+SSE42_KERNEL static uint32_t crc32cHardware(const unsigned char* p, size_t len, uint32_t crc) {
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        c = _mm_crc32_u64(c, word);
+    }
+    crc = static_cast<uint32_t>(c);
+    for (; len > 0; ++p, --len) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const void* data, size_t len, uint32_t crc) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+#ifdef DATA_FILE_SSE42
+    if (hasSse42()) return ~crc32cHardware(p, len, ~crc);
+#endif
+    return ~crc32cSoftware(p, len, ~crc);
+}
+
+void packRecord(const Employee& e, unsigned char* out) {
+    std::memcpy(out, &e.num, sizeof(e.num));
+    std::memcpy(out + sizeof(e.num), e.name, NAME_SIZE);
+    std::memcpy(out + sizeof(e.num) + NAME_SIZE, &e.hours, sizeof(e.hours));
+}
+
+void unpackRecord(const unsigned char* in, Employee& e) {
+    std::memcpy(&e.num, in, sizeof(e.num));
+    std::memcpy(e.name, in + sizeof(e.num), NAME_SIZE);
+    std::memcpy(&e.hours, in + sizeof(e.num) + NAME_SIZE, sizeof(e.hours));
+}
+
+PackedHeader makePackedHeader(uint64_t recordCount) {
+    PackedHeader h{};
+    std::memcpy(h.magic, PACKED_MAGIC, sizeof(h.magic));
+    h.version = PACKED_VERSION;
+    h.headerSize = sizeof(PackedHeader);
+    h.recordCount = recordCount;
+    h.recordsPerBlock = PACKED_RECORDS_PER_BLOCK;
+    h.recordSize = PACKED_RECORD_SIZE;
+    h.fieldCount = 3;
+    h.fieldSizes[0] = sizeof(int);
+    h.fieldSizes[1] = NAME_SIZE;
+    h.fieldSizes[2] = sizeof(double);
+    h.headerCrc = crc32c(&h, offsetof(PackedHeader, headerCrc));
+    return h;
+}
+
+uint64_t packedBlockOffset(size_t block) {
+    return sizeof(PackedHeader) + block * BLOCK_BYTES;
+}
+
+uint64_t packedRecordOffset(size_t idx) {
+    return packedBlockOffset(idx / PACKED_RECORDS_PER_BLOCK) + (idx % PACKED_RECORDS_PER_BLOCK) * PACKED_RECORD_SIZE;
+}
+
+uint64_t packedFileSize(size_t count) {
+    size_t tail = count % PACKED_RECORDS_PER_BLOCK;
+    return packedBlockOffset(count / PACKED_RECORDS_PER_BLOCK) + (tail ? tail * PACKED_RECORD_SIZE + sizeof(uint32_t) : 0);
+}
+
+bool isPackedFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(PACKED_MAGIC)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, PACKED_MAGIC, sizeof(magic)) == 0;
+}
+
+bool writePackedFile(const std::string& path, const std::vector<Employee>& records) {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Error openning file: " << path << "\n";
+        return false;
+    }
+
+    PackedHeader header = makePackedHeader(records.size());
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+    std::vector<unsigned char> block(BLOCK_BYTES);
+    for (size_t first = 0; ok && first < records.size(); first += PACKED_RECORDS_PER_BLOCK) {
+        size_t n = std::min(PACKED_RECORDS_PER_BLOCK, records.size() - first);
+        for (size_t i = 0; i < n; ++i) {
+            packRecord(records[first + i], block.data() + i * PACKED_RECORD_SIZE);
+        }
+        uint32_t crc = crc32c(block.data(), n * PACKED_RECORD_SIZE);
+        std::memcpy(block.data() + n * PACKED_RECORD_SIZE, &crc, sizeof(crc));
+        size_t len = n * PACKED_RECORD_SIZE + sizeof(crc);
+        ok = std::fwrite(block.data(), 1, len, f) == len;
+    }
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Error writing in file\n";
+    }
+    return ok;
+}
+
+static bool checkHeader(const PackedHeader& h, uint64_t fileSize, const std::string& path) {
+    if (h.headerCrc != crc32c(&h, offsetof(PackedHeader, headerCrc))) {
+        std::cerr << "Header checksum mismatch in " << path << "\n";
+        return false;
+    }
+    if (h.version != PACKED_VERSION || h.headerSize != sizeof(PackedHeader)) {
+        std::cerr << "Unsupported data file version " << h.version << " in " << path << "\n";
+        return false;
+    }
+    PackedHeader expected = makePackedHeader(h.recordCount);
+    if (h.recordsPerBlock != expected.recordsPerBlock || h.recordSize != expected.recordSize ||
+        h.fieldCount != expected.fieldCount ||
+        std::memcmp(h.fieldSizes, expected.fieldSizes, sizeof(h.fieldSizes)) != 0) {
+        std::cerr << "Record schema of " << path << " does not match this build\n";
+        return false;
+    }
+    if (fileSize != packedFileSize(static_cast<size_t>(h.recordCount))) {
+        std::cerr << "File " << path << " should hold " << h.recordCount << " records but is " << fileSize
+                  << " bytes\n";
+        return false;
+    }
+    return true;
+}
+
+bool readPackedFile(const std::string& path, std::vector<Employee>& out, unsigned nThreads) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        std::cerr << "Error openning file: " << path << "\n";
+        return false;
+    }
+    uint64_t size = static_cast<uint64_t>(in.tellg());
+    std::vector<unsigned char> data(static_cast<size_t>(size));
+    in.seekg(0);
+    if (size < sizeof(PackedHeader) || !in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size))) {
+        std::cerr << "Error reading file: " << path << "\n";
+        return false;
+    }
+
+    PackedHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (!checkHeader(header, size, path)) {
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(header.recordCount);
+    size_t blocks = (count + PACKED_RECORDS_PER_BLOCK - 1) / PACKED_RECORDS_PER_BLOCK;
+    unsigned n = nThreads ? nThreads : std::max(1u, std::thread::hardware_concurrency());
+    n = static_cast<unsigned>(std::min<size_t>(n, std::max<size_t>(1, blocks / MIN_BLOCKS_PER_THREAD)));
+
+    out.resize(count);
+    std::vector<size_t> badBlock(n, blocks);
+    auto work = [&](unsigned t) {
+        for (size_t b = blocks * t / n; b < blocks * (t + 1) / n; ++b) {
+            size_t first = b * PACKED_RECORDS_PER_BLOCK;
+            size_t records = std::min(PACKED_RECORDS_PER_BLOCK, count - first);
+            const unsigned char* p = data.data() + packedBlockOffset(b);
+            uint32_t stored;
+            std::memcpy(&stored, p + records * PACKED_RECORD_SIZE, sizeof(stored));
+            if (crc32c(p, records * PACKED_RECORD_SIZE) != stored) {
+                badBlock[t] = b;
+                return;
+            }
+            for (size_t i = 0; i < records; ++i) {
+                unpackRecord(p + i * PACKED_RECORD_SIZE, out[first + i]);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < n; ++t) {
+        workers.emplace_back(work, t);
+    }
+    work(0);
+    for (auto& w : workers) w.join();
+
+    for (size_t b : badBlock) {
+        if (b != blocks) {
+            std::cerr << "Checksum mismatch in block " << b << " (records " << b * PACKED_RECORDS_PER_BLOCK + 1
+                      << "..) of " << path << "\n";
+            out.clear();
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "../common/Employee.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packed data file, version 1 (little-endian):
+//
+//   header   64 bytes, see PackedHeader
+//   block 0  up to recordsPerBlock records of 44 bytes (num, name, hours;
+//            no padding), then the CRC32C of those record bytes
+//   block 1  ...
+//
+// Only the last block may hold fewer records. A file that does not start
+// with the magic is the legacy layout: a raw array of Employee structs.
+const char PACKED_MAGIC[8] = {'E', 'M', 'P', 'L', 'D', 'A', 'T', 'A'};
+const uint32_t PACKED_VERSION = 1;
+const size_t PACKED_RECORD_SIZE = sizeof(int) + NAME_SIZE + sizeof(double);
+const size_t PACKED_RECORDS_PER_BLOCK = 256;
+
+struct PackedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t recordCount;
+    uint32_t recordsPerBlock;
+    // Schema: record size and field count, then the byte size of each field.
+    uint32_t recordSize;
+    uint32_t fieldCount;
+    uint32_t fieldSizes[3];
+    uint8_t reserved[12];
+    // CRC32C of everything above.
+    uint32_t headerCrc;
+};
+static_assert(sizeof(PackedHeader) == 64, "packed header is 64 bytes on disk");
+
+// Uses the SSE4.2 crc32 instruction when the CPU has it.
+uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0);
+
+void packRecord(const Employee& e, unsigned char* out);
+void unpackRecord(const unsigned char* in, Employee& e);
+
+PackedHeader makePackedHeader(uint64_t recordCount);
+uint64_t packedBlockOffset(size_t block);
+uint64_t packedRecordOffset(size_t idx);
+// Size of a file holding count records.
+uint64_t packedFileSize(size_t count);
+
+bool isPackedFile(const std::string& path);
+bool writePackedFile(const std::string& path, const std::vector<Employee>& records);
+// Checks the header and every block checksum on nThreads threads (0 = one per
+// core) while unpacking. On error, returns false after describing the problem.
+bool readPackedFile(const std::string& path, std::vector<Employee>& out, unsigned nThreads = 0);
@@ -0,0 +1,532 @@
+#include "EpollServer.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const int MAX_EVENTS = 256;
+static const int MAX_BURST = 64;
+static const size_t MAX_PARKED_PER_CONNECTION = 1024;
+
+static char listenTag;
+static char wakeTag;
+
+EpollServer::EpollServer(ServerApp& app, int listenFd, int nLoops) : app(app), listenFd(listenFd), maxClients(0) {
+    if (nLoops <= 0) {
+        nLoops = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < nLoops; ++i) {
+        auto loop = std::make_unique<EpollLoop>();
+        loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        loops.push_back(std::move(loop));
+    }
+}
+
+EpollServer::~EpollServer() {
+    stop();
+    app.manager->lockWaits.cancel(this);
+    for (auto& t : shmThreads) {
+        if (t.joinable()) t.join();
+    }
+    for (auto& loop : loops) {
+        if (loop->thread.joinable()) loop->thread.join();
+        for (auto& p : loop->conns) {
+            app.endSession(p.second->session);
+            ::close(p.first);
+        }
+        loop->conns.clear();
+        ::close(loop->epfd);
+        ::close(loop->wakeFd);
+    }
+}
+
+void EpollServer::run(int nClients) {
+    maxClients = nClients;
+    if (maxClients <= 0) return;
+
+    rlimit lim{};
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    int flags = fcntl(listenFd, F_GETFL, 0);
+    fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+
+    running = true;
+    for (auto& loop : loops) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &wakeTag;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakeFd, &ev);
+
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &listenTag;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, listenFd, &ev) < 0) {
+            std::cerr << "epoll_ctl(listen) failed: " << std::strerror(errno) << "\n";
+        }
+    }
+
+    for (auto& loop : loops) {
+        EpollLoop* l = loop.get();
+        loop->thread = std::thread([this, l]() { loopMain(*l); });
+    }
+    for (auto& loop : loops) {
+        if (loop->thread.joinable()) loop->thread.join();
+    }
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lk(shmMutex);
+        threads.swap(shmThreads);
+    }
+    for (auto& t : threads) {
+        if (t.joinable()) t.join();
+    }
+    while (inflightWrites > 0 || inflightTasks > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void EpollServer::stop() {
+    running = false;
+    for (auto& loop : loops) {
+        uint64_t one = 1;
+        ssize_t r = ::write(loop->wakeFd, &one, sizeof(one));
+        (void)r;
+    }
+}
+
+void EpollServer::loopMain(EpollLoop& loop) {
+    epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        int n = epoll_wait(loop.epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            void* tag = events[i].data.ptr;
+            uint32_t ev = events[i].events;
+
+            if (tag == &listenTag) {
+                acceptClients(loop);
+                continue;
+            }
+            if (tag == &wakeTag) {
+                uint64_t value;
+                ssize_t r = ::read(loop.wakeFd, &value, sizeof(value));
+                (void)r;
+                drainCompletions(loop);
+                drainWakes(loop);
+                continue;
+            }
+
+            EpollConnection* c = static_cast<EpollConnection*>(tag);
+            bool alive = true;
+            if (ev & EPOLLOUT) {
+                alive = onWritable(loop, c);
+            }
+            if (!alive) continue;
+
+            if ((ev & (EPOLLHUP | EPOLLERR)) && c->closeAfterFlush) {
+                closeConnection(loop, c);
+            } else if (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                onReadable(loop, c);
+            }
+        }
+    }
+}
+
+void EpollServer::acceptClients(EpollLoop& loop) {
+    while (true) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+            }
+            return;
+        }
+
+        if (accepted.fetch_add(1) >= maxClients) {
+            ::close(fd);
+            continue;
+        }
+
+        auto c = std::make_unique<EpollConnection>();
+        c->fd = fd;
+        c->serial = nextSerial.fetch_add(1);
+        c->pendingResponses = 0;
+        c->closeAfterFlush = false;
+        c->events = EPOLLIN;
+        EpollLoop* owner = &loop;
+        uint64_t serial = c->serial;
+        app.leases.attach(c->session.leases,
+                          [this, owner, fd, serial](const Message& msg) { postPush(*owner, fd, serial, msg); });
+
+        epoll_event ev{};
+        ev.events = c->events;
+        ev.data.ptr = c.get();
+        if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "epoll_ctl(client) failed: " << std::strerror(errno) << "\n";
+            ::close(fd);
+            finishSession();
+            continue;
+        }
+        loop.conns[fd] = std::move(c);
+    }
+}
+
+bool EpollServer::onReadable(EpollLoop& loop, EpollConnection* c) {
+    Message batch[MAX_BATCH_MESSAGES];
+    for (int i = 0; i < MAX_BURST && !c->closeAfterFlush && c->parked.size() < MAX_PARKED_PER_CONNECTION; ++i) {
+        ssize_t n = ::recv(c->fd, batch, sizeof(batch), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            closeConnection(loop, c);
+            return false;
+        }
+        if (n == 0 || n % sizeof(Message) != 0) {
+            closeConnection(loop, c);
+            return false;
+        }
+
+        size_t count = n / sizeof(Message);
+        if (count == 1 && batch[0].type == SHM_ATTACH) {
+            if (attachSharedMemory(loop, c, batch[0])) return false;
+            continue;
+        }
+        for (size_t k = 0; k < count; ++k) {
+            dispatch(loop, c, batch[k]);
+        }
+    }
+    return onWritable(loop, c);
+}
+
+// Responses are collected in the outbox and flushed here, so everything produced
+// by one incoming packet or one retry pass leaves in as few packets as possible.
+bool EpollServer::onWritable(EpollLoop& loop, EpollConnection* c) {
+    Message batch[MAX_BATCH_MESSAGES];
+    while (!c->outbox.empty()) {
+        size_t count = std::min(c->outbox.size(), static_cast<size_t>(MAX_BATCH_MESSAGES));
+        std::copy(c->outbox.begin(), c->outbox.begin() + count, batch);
+
+        ssize_t n = ::send(c->fd, batch, count * sizeof(Message), MSG_NOSIGNAL);
+        if (n == static_cast<ssize_t>(count * sizeof(Message))) {
+            c->outbox.erase(c->outbox.begin(), c->outbox.begin() + count);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+        closeConnection(loop, c);
+        return false;
+    }
+
+    if (c->closeAfterFlush && c->outbox.empty() && c->pendingResponses == 0) {
+        closeConnection(loop, c);
+        return false;
+    }
+    updateEvents(loop, c);
+    return true;
+}
+
+// Requests on a record the connection is still writing asynchronously: a
+// second write could land first, and an UNLOCK would let another session
+// write the record too.
+static bool behindWrite(const EpollConnection* c, const Message& msg) {
+    if (c->writing.empty()) return false;
+    if (!ServerApp::ordersBehindPending(c->session, msg) && msg.type != UNLOCK) return false;
+    return std::find(c->writing.begin(), c->writing.end(), ServerApp::orderKey(msg)) != c->writing.end();
+}
+
+void EpollServer::dispatch(EpollLoop& loop, EpollConnection* c, const Message& msg) {
+    // The write's completion retries it.
+    if (behindWrite(c, msg)) {
+        c->parked.push_back({msg, app.lockDeadline(), false});
+        updateEvents(loop, c);
+        return;
+    }
+    if (ServerApp::ordersBehindPending(c->session, msg)) {
+        int key = ServerApp::orderKey(msg);
+        for (const ParkedRequest& p : c->parked) {
+            if (ServerApp::orderKey(p.msg) == key) {
+                c->parked.push_back({msg, app.lockDeadline(), false});
+                updateEvents(loop, c);
+                return;
+            }
+        }
+    }
+    if (execute(loop, c, msg)) return;
+
+    c->parked.push_back({msg, app.lockDeadline(), false});
+    park(loop, c, c->parked.back());
+    updateEvents(loop, c);
+}
+
+// The wake-up names the connection by fd and serial, so one that comes after
+// the connection is gone, or its fd reused, is dropped.
+void EpollServer::park(EpollLoop& loop, EpollConnection* c, ParkedRequest& parked) {
+    parked.registered = true;
+    EpollLoop* owner = &loop;
+    int fd = c->fd;
+    uint64_t serial = c->serial;
+    int key = ServerApp::orderKey(parked.msg);
+    app.waitForLock(c->session, parked.msg, this, parked.deadline,
+                    [this, owner, fd, serial, key]() { postWake(*owner, fd, serial, key); });
+}
+
+bool EpollServer::execute(EpollLoop& loop, EpollConnection* c, const Message& msg) {
+    Message resp;
+    RequestStatus status;
+    if (msg.type == WRITE_UPDATE) {
+        EpollLoop* owner = &loop;
+        int fd = c->fd;
+        uint64_t serial = c->serial;
+        int key = ServerApp::orderKey(msg);
+        inflightWrites.fetch_add(1);
+        status = app.processRequest(c->session, msg, resp, false, [this, owner, fd, serial, key](const Message& done) {
+            postWritten(*owner, fd, serial, key, done);
+            inflightWrites.fetch_sub(1);
+        });
+        if (status != REQUEST_PENDING) inflightWrites.fetch_sub(1);
+        else c->writing.push_back(key);
+    } else if (app.pool && (msg.type == SCAN || msg.type == AGGREGATE)) {
+        offload(loop, c, msg);
+        return true;
+    } else {
+        status = app.processRequest(c->session, msg, resp, false);
+    }
+    if (status == REQUEST_BLOCKED) return false;
+    if (status == REQUEST_SILENT) return true;
+    if (status == REQUEST_PENDING) {
+        c->pendingResponses++;
+        return true;
+    }
+
+    if (status == REQUEST_CLOSE) {
+        c->closeAfterFlush = true;
+    }
+    c->outbox.insert(c->outbox.end(), c->session.streamed.begin(), c->session.streamed.end());
+    c->session.streamed.clear();
+    c->outbox.push_back(resp);
+    return true;
+}
+
+// A long scan or histogram would otherwise hold up every connection of this
+// loop. They take no locks and use no session state but the rows they stream.
+void EpollServer::offload(EpollLoop& loop, EpollConnection* c, const Message& msg) {
+    EpollLoop* owner = &loop;
+    int fd = c->fd;
+    uint64_t serial = c->serial;
+    c->pendingResponses++;
+    inflightTasks.fetch_add(1);
+    app.pool->submit([this, owner, fd, serial, msg]() {
+        Session scratch;
+        Message resp;
+        app.processRequest(scratch, msg, resp, false);
+        postCompletion(*owner, fd, serial, resp, std::move(scratch.streamed));
+        inflightTasks.fetch_sub(1);
+    });
+}
+
+// Runs the connection's parked requests in order. Under each order key the
+// first one still blocked stops the rest; it is answered with LOCK_TIMEOUT if
+// its deadline has passed, else parked again unless a wake-up is still queued.
+void EpollServer::retryParked(EpollLoop& loop, EpollConnection* c, int key) {
+    std::vector<ParkedRequest> waiting;
+    waiting.swap(c->parked);
+    for (ParkedRequest& p : waiting) {
+        if (ServerApp::orderKey(p.msg) == key) {
+            p.registered = false;
+            break;
+        }
+    }
+
+    LockDeadline now = std::chrono::steady_clock::now();
+    std::vector<int> blockedKeys;
+    for (ParkedRequest& p : waiting) {
+        int k = ServerApp::orderKey(p.msg);
+        if (std::find(blockedKeys.begin(), blockedKeys.end(), k) != blockedKeys.end() || behindWrite(c, p.msg)) {
+            c->parked.push_back(p);
+            continue;
+        }
+        if (execute(loop, c, p.msg)) continue;
+        if (now >= p.deadline) {
+            Message resp;
+            ServerApp::lockTimedOut(c->session, p.msg, resp);
+            c->outbox.push_back(resp);
+            continue;
+        }
+        c->parked.push_back(p);
+        if (!c->parked.back().registered) park(loop, c, c->parked.back());
+        blockedKeys.push_back(k);
+    }
+    onWritable(loop, c);
+}
+
+void EpollServer::updateEvents(EpollLoop& loop, EpollConnection* c) {
+    uint32_t wanted = 0;
+    if (!c->closeAfterFlush && c->parked.size() < MAX_PARKED_PER_CONNECTION) wanted |= EPOLLIN;
+    if (!c->outbox.empty()) wanted |= EPOLLOUT;
+    if (wanted == c->events) return;
+
+    epoll_event ev{};
+    ev.events = wanted;
+    ev.data.ptr = c;
+    epoll_ctl(loop.epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = wanted;
+}
+
+void EpollServer::closeConnection(EpollLoop& loop, EpollConnection* c) {
+    app.endSession(c->session);
+
+    int fd = c->fd;
+    ::close(fd);
+    loop.conns.erase(fd);
+    finishSession();
+}
+
+bool EpollServer::attachSharedMemory(EpollLoop& loop, EpollConnection* c, const Message& msg) {
+    Message resp{};
+    resp.type = SHM_ATTACH;
+    resp.id = -1;
+
+    char shmName[NAME_SIZE];
+    std::memcpy(shmName, msg.emp.name, NAME_SIZE);
+    shmName[NAME_SIZE - 1] = '\0';
+    ShmWaitMode mode = msg.id == SHM_WAIT_BUSY_POLL ? SHM_WAIT_BUSY_POLL : SHM_WAIT_FUTEX;
+
+    auto shm = std::make_unique<ShmTransport>();
+    // An INVALIDATE for a lease taken on the socket could get lost on the way.
+    if (!c->outbox.empty() || !c->parked.empty() || c->pendingResponses > 0 || app.leases.holdsAny(c->session.leases) ||
+        !shm->open(shmName, mode)) {
+        c->outbox.push_back(resp);
+        return false;
+    }
+
+    resp.id = 0;
+    if (::send(c->fd, &resp, sizeof(resp), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(resp))) {
+        c->closeAfterFlush = true;
+        return false;
+    }
+
+    int fd = c->fd;
+    epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, nullptr);
+    shm->peerFd = fd;
+    Session session = std::move(c->session);
+    loop.conns.erase(fd);
+
+    std::lock_guard<std::mutex> lk(shmMutex);
+    shmThreads.emplace_back([this, fd, session = std::move(session), shm = std::move(shm)]() mutable {
+        runShmSession(fd, session, *shm);
+    });
+    return true;
+}
+
+void EpollServer::runShmSession(int fd, Session& session, ShmTransport& shm) {
+    app.serveSession(shm, session);
+    shm.close();
+    ::close(fd);
+    finishSession();
+}
+
+void EpollServer::finishSession() {
+    if (finished.fetch_add(1) + 1 >= maxClients) {
+        stop();
+    }
+}
+
+// Runs on the lock waits' notifier thread.
+void EpollServer::postWake(EpollLoop& loop, int fd, uint64_t serial, int key) {
+    {
+        std::lock_guard<std::mutex> lk(loop.completedMutex);
+        loop.woken.push_back({fd, serial, key});
+    }
+    uint64_t one = 1;
+    ssize_t r = ::write(loop.wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+void EpollServer::drainWakes(EpollLoop& loop) {
+    std::vector<LoopWake> woken;
+    {
+        std::lock_guard<std::mutex> lk(loop.completedMutex);
+        woken.swap(loop.woken);
+    }
+    for (const LoopWake& w : woken) {
+        auto it = loop.conns.find(w.fd);
+        if (it == loop.conns.end() || it->second->serial != w.serial) continue;
+        retryParked(loop, it->second.get(), w.key);
+    }
+}
+
+// Runs on the I/O completion thread or a pool worker. The caller drops its
+// inflight count after this, so run() does not return while a callback still
+// touches this server.
+void EpollServer::postCompletion(EpollLoop& loop, int fd, uint64_t serial, const Message& resp,
+                                 std::vector<Message> rows) {
+    {
+        std::lock_guard<std::mutex> lk(loop.completedMutex);
+        loop.completed.push_back({fd, serial, std::move(rows), resp});
+    }
+    uint64_t one = 1;
+    ssize_t r = ::write(loop.wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+// Runs on the I/O completion thread, like postCompletion.
+void EpollServer::postWritten(EpollLoop& loop, int fd, uint64_t serial, int key, const Message& resp) {
+    {
+        std::lock_guard<std::mutex> lk(loop.completedMutex);
+        loop.completed.push_back({fd, serial, {}, resp, true, true, key});
+    }
+    uint64_t one = 1;
+    ssize_t r = ::write(loop.wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+// Runs on the thread that changed a record this connection leases.
+void EpollServer::postPush(EpollLoop& loop, int fd, uint64_t serial, const Message& msg) {
+    {
+        std::lock_guard<std::mutex> lk(loop.completedMutex);
+        loop.completed.push_back({fd, serial, {}, msg, false});
+    }
+    uint64_t one = 1;
+    ssize_t r = ::write(loop.wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+void EpollServer::drainCompletions(EpollLoop& loop) {
+    std::vector<LoopCompletion> done;
+    {
+        std::lock_guard<std::mutex> lk(loop.completedMutex);
+        done.swap(loop.completed);
+    }
+    for (const LoopCompletion& item : done) {
+        auto it = loop.conns.find(item.fd);
+        if (it == loop.conns.end() || it->second->serial != item.serial) continue;
+
+        EpollConnection* c = it->second.get();
+        if (item.response) c->pendingResponses--;
+        c->outbox.insert(c->outbox.end(), item.rows.begin(), item.rows.end());
+        c->outbox.push_back(item.resp);
+        if (item.written) {
+            c->writing.erase(std::find(c->writing.begin(), c->writing.end(), item.key));
+            retryParked(loop, c, item.key);
+            continue;
+        }
+        onWritable(loop, c);
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "ServerApp.h"
+#include "../common/ShmTransport.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Connection state owned by exactly one event loop.
+struct EpollConnection {
+    int fd;
+    uint64_t serial;
+    Session session;
+    std::deque<Message> outbox;
+    std::vector<ParkedRequest> parked;
+    // Asynchronous writes and pool tasks whose response has not come back yet.
+    int pendingResponses;
+    // Order keys with an asynchronous write in flight; requests under them
+    // stay parked until it completes.
+    std::vector<int> writing;
+    bool closeAfterFlush;
+    uint32_t events;
+};
+
+// Response of an asynchronous write or of a request run on the worker pool,
+// posted from the thread that finished it, with the rows streamed ahead of it.
+// serial tells a reused fd apart from the connection that issued the request.
+// An INVALIDATE pushed to the connection comes the same way, as no response.
+struct LoopCompletion {
+    int fd;
+    uint64_t serial;
+    std::vector<Message> rows;
+    Message resp;
+    bool response = true;
+    // The asynchronous write under this order key is done.
+    bool written = false;
+    int key = 0;
+};
+
+// A record the parked requests of a connection under an order key may now be
+// able to lock, or a deadline that passed.
+struct LoopWake {
+    int fd;
+    uint64_t serial;
+    int key;
+};
+
+struct EpollLoop {
+    int epfd;
+    int wakeFd;
+    std::thread thread;
+    std::unordered_map<int, std::unique_ptr<EpollConnection>> conns;
+    std::mutex completedMutex;
+    std::vector<LoopCompletion> completed;
+    std::vector<LoopWake> woken;
+};
+
+// Reactor that multiplexes all client sockets over one epoll loop per core.
+// Requests run through ServerApp::processRequest without blocking; a request
+// that would wait for a record lock is parked in its connection and queued in
+// the record manager's LockWaits, which wakes this loop when that record is
+// released or the request's lock deadline passes. Meanwhile the connection
+// keeps serving its other requests (responses are matched by reqId). Packets may carry up to
+// MAX_BATCH_MESSAGES requests and responses are coalesced the same way. A client that attaches a shared memory
+// channel (SHM_ATTACH) leaves the loop and is served by its own thread.
+// WRITE_UPDATEs whose disk write runs asynchronously are acknowledged when the
+// completion is posted back to the owning loop; until then the connection's
+// later requests on that record wait, since the ring does not order writes. With the server's worker pool,
+// SCAN and AGGREGATE run on the pool and come back the same way.
+class EpollServer {
+public:
+    EpollServer(ServerApp& app, int listenFd, int nLoops = 0);
+    ~EpollServer();
+
+    void run(int nClients);
+    void stop();
+
+public:
+    ServerApp& app;
+    int listenFd;
+    std::vector<std::unique_ptr<EpollLoop>> loops;
+    std::atomic<bool> running{false};
+    std::atomic<int> accepted{0};
+    std::atomic<int> finished{0};
+    std::atomic<uint64_t> nextSerial{1};
+    std::atomic<int> inflightWrites{0};
+    std::atomic<int> inflightTasks{0};
+    int maxClients;
+    std::vector<std::thread> shmThreads;
+    std::mutex shmMutex;
+
+    void loopMain(EpollLoop& loop);
+    void acceptClients(EpollLoop& loop);
+    bool onReadable(EpollLoop& loop, EpollConnection* c);
+    bool onWritable(EpollLoop& loop, EpollConnection* c);
+    void dispatch(EpollLoop& loop, EpollConnection* c, const Message& msg);
+    bool execute(EpollLoop& loop, EpollConnection* c, const Message& msg);
+    void offload(EpollLoop& loop, EpollConnection* c, const Message& msg);
+    void retryParked(EpollLoop& loop, EpollConnection* c, int key);
+    void park(EpollLoop& loop, EpollConnection* c, ParkedRequest& parked);
+    void updateEvents(EpollLoop& loop, EpollConnection* c);
+    void closeConnection(EpollLoop& loop, EpollConnection* c);
+    bool attachSharedMemory(EpollLoop& loop, EpollConnection* c, const Message& msg);
+    void runShmSession(int fd, Session& session, ShmTransport& shm);
+    void finishSession();
+    void postWake(EpollLoop& loop, int fd, uint64_t serial, int key);
+    void drainWakes(EpollLoop& loop);
+    void postCompletion(EpollLoop& loop, int fd, uint64_t serial, const Message& resp,
+                        std::vector<Message> rows = {});
+    void postWritten(EpollLoop& loop, int fd, uint64_t serial, int key, const Message& resp);
+    void drainCompletions(EpollLoop& loop);
+    void postPush(EpollLoop& loop, int fd, uint64_t serial, const Message& msg);
+};
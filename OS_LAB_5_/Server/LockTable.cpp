@@ -0,0 +1,165 @@
+#include "LockTable.h"
+#include <cstring>
+#include <thread>
+
+LockTable::LockTable()
+    : count(0), stripedMode(false), stripes(new Stripe[PARKING_STRIPES]), stripeCount(PARKING_STRIPES) {}
+
+// Not safe while any lock is held.
+void LockTable::resize(size_t n) {
+    versions.clear();
+    words.clear();
+    count = 0;
+    grow(n);
+}
+
+// New slots are added behind the existing ones without moving them.
+void LockTable::grow(size_t n) {
+    if (n <= count) return;
+    versions.resize(n);
+    if (!stripedMode) {
+        words.resize(n);
+    }
+    count = n;
+}
+
+void LockTable::useStripes(size_t n) {
+    stripedMode = true;
+    words.clear();
+    stripeCount = n ? n : 1;
+    stripes.reset(new Stripe[stripeCount]);
+}
+
+bool LockTable::tryWord(size_t idx, bool exclusive) {
+    std::atomic<uint32_t>& w = words[idx];
+    uint32_t cur = w.load(std::memory_order_relaxed);
+    if (exclusive) {
+        return cur == 0 && w.compare_exchange_strong(cur, WRITER, std::memory_order_seq_cst);
+    }
+    while (!(cur & WRITER)) {
+        if (w.compare_exchange_weak(cur, cur + 1, std::memory_order_seq_cst)) return true;
+    }
+    return false;
+}
+
+bool LockTable::tryHeld(Stripe& s, size_t idx, bool exclusive) {
+    auto it = s.held.find(idx);
+    if (it == s.held.end()) {
+        s.held.emplace(idx, exclusive ? -1 : 1);
+        return true;
+    }
+    if (exclusive || it->second < 0) return false;
+    ++it->second;
+    return true;
+}
+
+bool LockTable::tryLock(size_t idx, bool exclusive) {
+    if (!stripedMode) return tryWord(idx, exclusive);
+    Stripe& s = stripeFor(idx);
+    std::lock_guard<std::mutex> lk(s.mutex);
+    return tryHeld(s, idx, exclusive);
+}
+
+// The waiter count is raised before the retry and read by unlock after the
+// release, so one of the two always sees the other.
+void LockTable::lock(size_t idx, bool exclusive) {
+    if (!stripedMode && tryWord(idx, exclusive)) return;
+
+    Stripe& s = stripeFor(idx);
+    std::unique_lock<std::mutex> lk(s.mutex);
+    if (stripedMode) {
+        s.cv.wait(lk, [&]() { return tryHeld(s, idx, exclusive); });
+        return;
+    }
+    s.waiters.fetch_add(1, std::memory_order_seq_cst);
+    s.cv.wait(lk, [&]() { return tryWord(idx, exclusive); });
+    s.waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void LockTable::unlock(size_t idx, bool exclusive) {
+    Stripe& s = stripeFor(idx);
+    if (stripedMode) {
+        {
+            std::lock_guard<std::mutex> lk(s.mutex);
+            auto it = s.held.find(idx);
+            if (it == s.held.end() || (it->second < 0) != exclusive) return;
+            if (exclusive || --it->second == 0) s.held.erase(it);
+        }
+        s.cv.notify_all();
+        return;
+    }
+
+    std::atomic<uint32_t>& w = words[idx];
+    uint32_t cur = w.load(std::memory_order_relaxed);
+    if (exclusive) {
+        if (cur != WRITER || !w.compare_exchange_strong(cur, 0, std::memory_order_seq_cst)) return;
+    }
+    else {
+        do {
+            if (cur == 0 || (cur & WRITER)) return;
+        } while (!w.compare_exchange_weak(cur, cur - 1, std::memory_order_seq_cst));
+        if (cur - 1 != 0) return;
+    }
+
+    if (s.waiters.load(std::memory_order_seq_cst) > 0) {
+        { std::lock_guard<std::mutex> lk(s.mutex); }
+        s.cv.notify_all();
+    }
+}
+
+bool LockTable::isFree(size_t idx, bool exclusive) {
+    if (!stripedMode) {
+        uint32_t cur = words[idx].load(std::memory_order_seq_cst);
+        return exclusive ? cur == 0 : !(cur & WRITER);
+    }
+    Stripe& s = stripeFor(idx);
+    std::lock_guard<std::mutex> lk(s.mutex);
+    auto it = s.held.find(idx);
+    return it == s.held.end() || (!exclusive && it->second > 0);
+}
+
+// The record image is copied in 8-byte words with relaxed atomic accesses, so
+// a copy that overlaps a write is a detectable torn read rather than a data
+// race.
+static void copyWords(void* dst, const void* src, size_t len) {
+    uint64_t* d = static_cast<uint64_t*>(dst);
+    const uint64_t* s = static_cast<const uint64_t*>(src);
+    for (size_t i = 0; i < len / sizeof(uint64_t); ++i) {
+#ifdef _MSC_VER
+        d[i] = *reinterpret_cast<const volatile uint64_t*>(s + i);
+#else
+        __atomic_store_n(d + i, __atomic_load_n(s + i, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+#endif
+    }
+    size_t tail = len % sizeof(uint64_t);
+    if (tail) std::memcpy(static_cast<char*>(dst) + len - tail, static_cast<const char*>(src) + len - tail, tail);
+}
+
+bool LockTable::readConsistent(size_t idx, void* dst, const void* src, size_t len, int attempts) const {
+    const std::atomic<uint32_t>& v = versions[idx];
+    for (int i = 0; attempts <= 0 || i < attempts; ++i) {
+        uint32_t before = v.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        copyWords(dst, src, len);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (v.load(std::memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
+
+void LockTable::writeConsistent(size_t idx, void* dst, const void* src, size_t len) {
+    std::atomic<uint32_t>& v = versions[idx];
+    uint32_t cur = v.load(std::memory_order_relaxed);
+    while ((cur & 1) || !v.compare_exchange_weak(cur, cur + 1, std::memory_order_acquire)) {
+        if (cur & 1) {
+            std::this_thread::yield();
+            cur = v.load(std::memory_order_relaxed);
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    copyWords(dst, src, len);
+    v.store(cur + 2, std::memory_order_release);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "SegmentedArray.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Reader-writer locks for the records, addressed by record index.
+//
+// Per-record mode (default): one 4-byte lock word per record, the writer bit
+// or a reader count, taken and released with a CAS. A thread that has to
+// block parks on one of a fixed set of cache-line-sized stripes and is woken
+// by the unlock that frees its record.
+//
+// Striped mode: no per-record state at all. Each stripe keeps, under its
+// mutex, the holders of the locked records hashed to it, so memory depends
+// on how many records are locked rather than how many exist. Records sharing
+// a stripe never block each other.
+//
+// Unlocking a record that is not held in that mode does nothing.
+//
+// Every record also has a seqlock version, odd while its in-memory image is
+// being replaced. readConsistent() copies a record without writing any shared
+// state and retries if the version moved; writeConsistent() bumps the version
+// around the copy. Writers of one record are serialized on the version itself.
+class LockTable {
+public:
+    LockTable();
+
+    void resize(size_t count);
+    // Unlike resize(), safe while other records are locked and read.
+    void grow(size_t count);
+    void useStripes(size_t stripes);
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool striped() const { return stripedMode; }
+
+    void lock(size_t idx, bool exclusive);
+    bool tryLock(size_t idx, bool exclusive);
+    void unlock(size_t idx, bool exclusive);
+    // Whether lock() would succeed right now; nothing is reserved.
+    bool isFree(size_t idx, bool exclusive);
+
+    bool readConsistent(size_t idx, void* dst, const void* src, size_t len, int attempts) const;
+    void writeConsistent(size_t idx, void* dst, const void* src, size_t len);
+    uint32_t version(size_t idx) const { return versions[idx].load(std::memory_order_acquire); }
+
+public:
+    static const uint32_t WRITER = 0x80000000u;
+    static const size_t PARKING_STRIPES = 64;
+
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<int> waiters{0};
+        // Striped mode: record index -> -1 for a writer, else the reader count.
+        std::unordered_map<size_t, int> held;
+    };
+
+    std::atomic<size_t> count;
+    bool stripedMode;
+    SegmentedArray<std::atomic<uint32_t>> words;
+    SegmentedArray<std::atomic<uint32_t>> versions;
+    std::unique_ptr<Stripe[]> stripes;
+    size_t stripeCount;
+
+    Stripe& stripeFor(size_t idx) { return stripes[(idx * 0x9E3779B97F4A7C15ull >> 32) % stripeCount]; }
+    bool tryWord(size_t idx, bool exclusive);
+    bool tryHeld(Stripe& s, size_t idx, bool exclusive);
+};
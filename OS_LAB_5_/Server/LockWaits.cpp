@@ -0,0 +1,135 @@
+#include "LockWaits.h"
+#include <algorithm>
+
+LockWaits::LockWaits() : stripes(new Stripe[STRIPES]), queued(0), stopping(false), runningOwner(nullptr) {}
+
+LockWaits::~LockWaits() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (notifier.joinable()) {
+        notifier.join();
+    }
+}
+
+// The count goes up before available() looks at the lock and released() runs
+// after the unlock, so either the check sees the record free or released()
+// sees the count and finds the waiter in its queue.
+void LockWaits::wait(int id, const void* owner, LockDeadline deadline, std::function<void()> wake,
+                     const std::function<bool()>& available) {
+    WaiterPtr w = std::make_shared<Waiter>();
+    w->wake = std::move(wake);
+    w->owner = owner;
+    w->id = id;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (!notifier.joinable()) {
+            notifier = std::thread(&LockWaits::notifierLoop, this);
+        }
+        if (deadline != NO_LOCK_DEADLINE) {
+            timers.emplace(deadline, w);
+        }
+    }
+    cv.notify_all();
+
+    Stripe& s = stripeFor(id);
+    std::lock_guard<std::mutex> lk(s.mutex);
+    queued.fetch_add(1);
+    if (available()) {
+        queued.fetch_sub(1);
+        fire(w);
+        return;
+    }
+    s.queues[id].push_back(w);
+}
+
+void LockWaits::released(int id) {
+    if (queued.load() == 0) return;
+    std::vector<WaiterPtr> woken;
+    {
+        Stripe& s = stripeFor(id);
+        std::lock_guard<std::mutex> lk(s.mutex);
+        auto it = s.queues.find(id);
+        if (it == s.queues.end()) return;
+        woken.swap(it->second);
+        s.queues.erase(it);
+        queued.fetch_sub(static_cast<int>(woken.size()));
+    }
+    for (const WaiterPtr& w : woken) {
+        fire(w);
+    }
+}
+
+// A waiter is claimed once, by the release, the deadline or cancel(),
+// whichever comes first; the losers just drop their reference.
+void LockWaits::fire(const WaiterPtr& w) {
+    if (w->claimed.exchange(true)) return;
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        ready.push_back(w);
+    }
+    cv.notify_all();
+}
+
+void LockWaits::cancel(const void* owner) {
+    for (size_t i = 0; i < STRIPES; ++i) {
+        Stripe& s = stripes[i];
+        std::lock_guard<std::mutex> lk(s.mutex);
+        for (auto q = s.queues.begin(); q != s.queues.end();) {
+            auto& list = q->second;
+            auto mine = std::stable_partition(list.begin(), list.end(),
+                                              [owner](const WaiterPtr& w) { return w->owner != owner; });
+            for (auto w = mine; w != list.end(); ++w) (*w)->claimed = true;
+            queued.fetch_sub(static_cast<int>(list.end() - mine));
+            list.erase(mine, list.end());
+            q = list.empty() ? s.queues.erase(q) : std::next(q);
+        }
+    }
+    std::unique_lock<std::mutex> lk(mutex);
+    ready.erase(std::remove_if(ready.begin(), ready.end(), [owner](const WaiterPtr& w) { return w->owner == owner; }),
+                ready.end());
+    cv.wait(lk, [&]() { return runningOwner != owner; });
+}
+
+// A waiter whose deadline passed is still queued under its record.
+void LockWaits::forget(const WaiterPtr& w) {
+    Stripe& s = stripeFor(w->id);
+    std::lock_guard<std::mutex> lk(s.mutex);
+    auto it = s.queues.find(w->id);
+    if (it == s.queues.end()) return;
+    auto& list = it->second;
+    auto pos = std::find(list.begin(), list.end(), w);
+    if (pos == list.end()) return;
+    list.erase(pos);
+    queued.fetch_sub(1);
+    if (list.empty()) s.queues.erase(it);
+}
+
+void LockWaits::notifierLoop() {
+    std::unique_lock<std::mutex> lk(mutex);
+    while (!stopping) {
+        LockDeadline now = std::chrono::steady_clock::now();
+        while (!timers.empty() && timers.begin()->first <= now) {
+            WaiterPtr w = timers.begin()->second;
+            timers.erase(timers.begin());
+            if (!w->claimed.exchange(true)) ready.push_back(w);
+        }
+        if (ready.empty()) {
+            if (timers.empty()) cv.wait(lk);
+            else cv.wait_until(lk, timers.begin()->first);
+            continue;
+        }
+
+        WaiterPtr w = ready.front();
+        ready.pop_front();
+        runningOwner = w->owner;
+        lk.unlock();
+        forget(w);
+        w->wake();
+        lk.lock();
+        runningOwner = nullptr;
+        cv.notify_all();
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using LockDeadline = std::chrono::steady_clock::time_point;
+const LockDeadline NO_LOCK_DEADLINE = LockDeadline::max();
+
+// Requests waiting for record locks, queued per record ID. No thread waits on
+// a lock: a waiter is a callback that runs once, when the record is released
+// or when its deadline passes, and the woken request retries the lock itself.
+// Callbacks run on one notifier thread shared by all waiters, never inside
+// wait() or released(), so they may take any lock the caller held.
+class LockWaits {
+public:
+    LockWaits();
+    ~LockWaits();
+    LockWaits(const LockWaits&) = delete;
+    LockWaits& operator=(const LockWaits&) = delete;
+
+    // available() says whether the lock could be taken now; it is checked
+    // after the waiter is queued, so a release racing with wait() is never
+    // missed. owner only matters to cancel().
+    void wait(int id, const void* owner, LockDeadline deadline, std::function<void()> wake,
+              const std::function<bool()>& available);
+    // Called after the lock of id is released. Wakes every waiter of id.
+    void released(int id);
+    // Drops the owner's waiters and returns once none of its callbacks runs.
+    void cancel(const void* owner);
+    size_t waiting() const { return static_cast<size_t>(queued.load()); }
+
+public:
+    struct Waiter {
+        std::function<void()> wake;
+        const void* owner;
+        int id;
+        std::atomic<bool> claimed{false};
+    };
+    using WaiterPtr = std::shared_ptr<Waiter>;
+
+    static const size_t STRIPES = 64;
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::unordered_map<int, std::vector<WaiterPtr>> queues;
+    };
+
+    std::unique_ptr<Stripe[]> stripes;
+    // Waiters in the stripe queues; released() skips the stripe when it is zero.
+    std::atomic<int> queued;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<WaiterPtr> ready;
+    std::multimap<LockDeadline, WaiterPtr> timers;
+    bool stopping;
+    std::thread notifier;
+    // Owner of the callback running now, if any.
+    const void* runningOwner;
+
+    Stripe& stripeFor(int id) { return stripes[(static_cast<uint32_t>(id) * 2654435761u >> 16) % STRIPES]; }
+    void fire(const WaiterPtr& w);
+    void forget(const WaiterPtr& w);
+    void notifierLoop();
+};
@@ -0,0 +1,138 @@
+#include "MappedFile.h"
+#include <iostream>
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : data(nullptr), size(0), capacity(0), hFile(INVALID_HANDLE_VALUE), hMapping(NULL) {}
+#else
+static const size_t MAPPING_RESERVE = size_t(256) << 20;
+
+MappedFile::MappedFile() : data(nullptr), size(0), capacity(0), fd(-1) {}
+#endif
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::syncAll() {
+    return sync(0, size);
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+    hFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        std::cerr << "error opening " << path << ": " << GetLastError() << "\n";
+        return false;
+    }
+
+    // A mapping of an empty file cannot be created, nor could it grow.
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    capacity = size;
+
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+    if (hMapping) {
+        data = static_cast<char*>(MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    }
+    if (!data) {
+        std::cerr << "error mapping " << path << ": " << GetLastError() << "\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+// A view cannot outgrow its mapping object, so only shrinking or no-op
+// requests succeed here.
+bool MappedFile::grow(size_t newSize) {
+    return data && newSize <= size;
+}
+
+bool MappedFile::sync(size_t offset, size_t length) {
+    if (!data) return false;
+    return FlushViewOfFile(data + offset, length) && FlushFileBuffers(hFile);
+}
+
+void MappedFile::close() {
+    if (data) {
+        UnmapViewOfFile(data);
+        data = nullptr;
+    }
+    if (hMapping) {
+        CloseHandle(hMapping);
+        hMapping = NULL;
+    }
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+    size = 0;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "error opening " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    // An empty file is mapped too: grow() gives it its first records.
+    struct stat st{};
+    if (fstat(fd, &st) < 0) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    capacity = size + MAPPING_RESERVE;
+
+    void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        std::cerr << "error mapping " << path << ": " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+    data = static_cast<char*>(p);
+    return true;
+}
+
+// Pages past the old end become usable once the file covers them.
+bool MappedFile::grow(size_t newSize) {
+    if (!data || newSize > capacity) return false;
+    if (newSize <= size) return true;
+    if (ftruncate(fd, static_cast<off_t>(newSize)) < 0) {
+        std::cerr << "ftruncate failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    size = newSize;
+    return true;
+}
+
+// msync wants a page-aligned start, so the range is widened to whole pages.
+bool MappedFile::sync(size_t offset, size_t length) {
+    if (!data) return false;
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset - offset % pageSize;
+    return msync(data + start, offset + length - start, MS_SYNC) == 0;
+}
+
+void MappedFile::close() {
+    if (data) {
+        munmap(data, capacity);
+        data = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    size = 0;
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Read-write shared mapping of a whole file (mmap / MapViewOfFile).
+// On Linux the mapping reserves address space past the end of the file, so
+// grow() can extend the file in place while other threads use the mapping.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    bool sync(size_t offset, size_t length);
+    bool syncAll();
+    bool grow(size_t newSize);
+    void close();
+
+public:
+    char* data;
+    std::atomic<size_t> size;
+    size_t capacity;
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#else
+    int fd;
+#endif
+};
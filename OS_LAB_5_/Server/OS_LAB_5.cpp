@@ -1,10 +1,188 @@
 ﻿#include "ServerApp.h"
 #include <iostream>
 #include <limits> 
+#include <clocale>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <chrono>
+#include <string>
 
-int main() {
+// --mmap[=per-write|periodic|shutdown] keeps the records in a memory-mapped file.
+// --wal logs updates with group commit and checkpoints the file in the background.
+// --uring[=fsync] submits record writes through io_uring (Linux), optionally
+// each linked to an fdatasync.
+// --import <file> [--format csv|binary] [--data <file>] bulk-loads the records
+// instead of asking for them one by one.
+// --open <file> reopens an existing data file (warm start) and reports how long it took.
+// --lock-stripes N replaces the per-record lock words with N shared stripes.
+// --scan-index keeps ordered name and hours indexes so SCAN requests do not
+// read every record.
+// --columns keeps a column-wise copy of the records for AGGREGATE requests.
+// --packed stores the data file in the versioned packed layout with block
+// checksums (file streams only); --open recognizes either layout.
+// --lock-timeout MS answers LOCK_TIMEOUT to a request still waiting for a
+// record lock after MS milliseconds.
+// --pool runs requests on a work-stealing pool with one worker per hardware
+// thread: threaded sessions hand every request to it, the epoll loops their
+// SCAN and AGGREGATE requests.
+// --coroutines (Linux) serves every client from one thread, each session a
+// coroutine that suspends while it waits for a request, a lock or a write;
+// writes run on io_uring, the pool or a disk thread, never on that thread.
+// --shards N splits the records by ID hash over N shards, each owned by a
+// thread pinned to its own CPU (file streams only, no snapshots).
+int main(int argc, char** argv) {
     setlocale(LC_ALL, "rus");
-    ServerApp server; 
-    server.run();
+    bool useLog = false;
+    bool useUring = false;
+    bool uringSync = false;
+    bool useMapping = false;
+    SyncPolicy policy = SYNC_PERIODIC;
+    std::string importPath;
+    std::string openPath;
+    std::string dataPath;
+    std::string format;
+    size_t lockStripes = 0;
+    bool scanIndex = false;
+    bool columns = false;
+    bool packed = false;
+    int lockTimeoutMs = 0;
+    bool usePool = false;
+    bool useCoroutines = false;
+    size_t shardCount = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--mmap") == 0 || std::strcmp(argv[i], "--mmap=periodic") == 0) {
+            useMapping = true;
+            policy = SYNC_PERIODIC;
+        }
+        else if (std::strcmp(argv[i], "--mmap=per-write") == 0) {
+            useMapping = true;
+            policy = SYNC_PER_WRITE;
+        }
+        else if (std::strcmp(argv[i], "--mmap=shutdown") == 0) {
+            useMapping = true;
+            policy = SYNC_ON_SHUTDOWN;
+        }
+        else if (std::strcmp(argv[i], "--wal") == 0) {
+            useLog = true;
+        }
+        else if (std::strcmp(argv[i], "--uring") == 0 || std::strcmp(argv[i], "--uring=fsync") == 0) {
+            useUring = true;
+            uringSync = std::strcmp(argv[i], "--uring=fsync") == 0;
+        }
+        else if (std::strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+            importPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--open") == 0 && i + 1 < argc) {
+            openPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            dataPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--lock-stripes") == 0 && i + 1 < argc) {
+            lockStripes = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--scan-index") == 0) {
+            scanIndex = true;
+        }
+        else if (std::strcmp(argv[i], "--columns") == 0) {
+            columns = true;
+        }
+        else if (std::strcmp(argv[i], "--packed") == 0) {
+            packed = true;
+        }
+        else if (std::strcmp(argv[i], "--lock-timeout") == 0 && i + 1 < argc) {
+            lockTimeoutMs = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--pool") == 0) {
+            usePool = true;
+        }
+        else if (std::strcmp(argv[i], "--coroutines") == 0) {
+            useCoroutines = true;
+        }
+        else if (std::strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shardCount = std::strtoul(argv[++i], nullptr, 10);
+        }
+    }
+    if (packed && (useLog || useMapping || useUring)) {
+        std::cerr << "--packed cannot be combined with --wal, --mmap or --uring\n";
+        return 1;
+    }
+    if (useLog && useMapping) {
+        std::cerr << "--wal cannot be combined with --mmap\n";
+        return 1;
+    }
+    if (shardCount > 0 && (packed || useLog || useMapping || useUring || lockStripes > 0)) {
+        std::cerr << "--shards cannot be combined with --packed, --wal, --mmap, --uring or --lock-stripes\n";
+        return 1;
+    }
+
+    RecordManager* manager = nullptr;
+    if (!openPath.empty()) {
+        // A log left by a crash is replayed before the file is read.
+        auto start = std::chrono::steady_clock::now();
+        manager = new RecordManager(openPath);
+        if (useLog && !manager->enableWriteAheadLog()) {
+            std::cerr << "Write-ahead log unavailable, updates go straight to the file\n";
+        }
+        bool opened = useMapping ? manager->useMappedStorage(policy) : manager->openExisting();
+        if (!opened) {
+            delete manager;
+            return 1;
+        }
+        useLog = false;
+        useMapping = false;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Warm start: " << manager->idToIndex.size() << " records ready in " << ms << " ms\n";
+    }
+    else if (!importPath.empty()) {
+        if (dataPath.empty()) {
+            std::cout << "file name: ";
+            std::cin >> dataPath;
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        ImportFormat importFormat = format.empty() ? guessImportFormat(importPath)
+            : (format == "csv" ? IMPORT_CSV : IMPORT_BINARY);
+        manager = new RecordManager(dataPath);
+        if (!manager->importRecords(importPath, importFormat)) {
+            delete manager;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<ServerApp> server(manager ? new ServerApp(manager) : new ServerApp());
+    if (packed && !server->manager->packedFile && !server->manager->savePacked()) {
+        return 1;
+    }
+    if (useLog && !server->manager->enableWriteAheadLog()) {
+        std::cerr << "Write-ahead log unavailable, updates go straight to the file\n";
+    }
+    if (useMapping && !server->manager->useMappedStorage(policy)) {
+        std::cerr << "Memory mapping failed, using file streams\n";
+    }
+    if (useUring && !server->manager->useIoUring(uringSync)) {
+        std::cerr << "io_uring unavailable, using file streams\n";
+    }
+    if (shardCount > 0 && !server->manager->useShards(shardCount)) {
+        return 1;
+    }
+    if (lockStripes > 0) {
+        server->manager->recordLocks.useStripes(lockStripes);
+    }
+    if (scanIndex) {
+        server->manager->enableScanIndex();
+    }
+    if (columns) {
+        server->manager->enableColumnStore();
+    }
+    server->lockTimeoutMs = lockTimeoutMs;
+    if (usePool) {
+        server->pool.reset(new WorkStealingPool());
+    }
+    server->useCoroutines = useCoroutines;
+    server->run();
     return 0;
 }
\ No newline at end of file
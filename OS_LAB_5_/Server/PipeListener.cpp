@@ -0,0 +1,75 @@
+#include "PipeListener.h"
+#include "../common/Platform.h"
+#include <iostream>
+
+PipeConnection::PipeConnection(HANDLE hPipe) : hPipe(hPipe), inboxCount(0), inboxPos(0) {}
+PipeConnection::~PipeConnection() { close(); }
+
+bool PipeConnection::sendMessage(const Message& msg) {
+    DWORD bytesTransferred = 0;
+    Message copy = msg;
+    return overlappedTransfer(hPipe, true, &copy, sizeof(Message), bytesTransferred) && bytesTransferred == sizeof(Message);
+}
+
+bool PipeConnection::recvMessage(Message& msg) {
+    if (inboxPos == inboxCount) {
+        DWORD bytesTransferred = 0;
+        if (!overlappedTransfer(hPipe, false, inbox, sizeof(inbox), bytesTransferred) ||
+            bytesTransferred == 0 || bytesTransferred % sizeof(Message) != 0) {
+            return false;
+        }
+        inboxCount = static_cast<int>(bytesTransferred / sizeof(Message));
+        inboxPos = 0;
+    }
+    msg = inbox[inboxPos++];
+    return true;
+}
+
+void PipeConnection::close() {
+    if (hPipe != INVALID_HANDLE_VALUE) {
+        FlushFileBuffers(hPipe);
+        DisconnectNamedPipe(hPipe);
+        CloseHandle(hPipe);
+        hPipe = INVALID_HANDLE_VALUE;
+    }
+}
+
+PipeListener::PipeListener(const std::string& pipeName) : pipeName(pipeName) {}
+
+bool PipeListener::listen() {
+    return true;
+}
+
+std::unique_ptr<Transport> PipeListener::accept() {
+    HANDLE hPipe = CreateNamedPipeA(pipeName.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
+        PIPE_UNLIMITED_INSTANCES,
+        4096, 4096,
+        0, NULL);
+
+    if (hPipe == INVALID_HANDLE_VALUE) {
+        std::cerr << "error creating named pipe: " << GetLastError() << "\n";
+        return nullptr;
+    }
+
+    OVERLAPPED ov{};
+    ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    BOOL connected = ConnectNamedPipe(hPipe, &ov);
+    if (!connected) {
+        DWORD err = GetLastError();
+        DWORD unused;
+        connected = err == ERROR_PIPE_CONNECTED ||
+            (err == ERROR_IO_PENDING && GetOverlappedResult(hPipe, &ov, &unused, TRUE));
+    }
+    CloseHandle(ov.hEvent);
+    if (!connected) {
+        CloseHandle(hPipe);
+        return nullptr;
+    }
+    return std::make_unique<PipeConnection>(hPipe);
+}
+
+std::unique_ptr<TransportListener> createListener(const std::string& endpoint) {
+    return std::make_unique<PipeListener>(endpoint);
+}
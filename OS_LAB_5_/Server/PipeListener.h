@@ -0,0 +1,31 @@
+#pragma once
+#include "../common/Transport.h"
+#include <windows.h>
+
+class PipeConnection : public Transport {
+public:
+    PipeConnection(HANDLE hPipe);
+    ~PipeConnection();
+
+    bool sendMessage(const Message& msg) override;
+    bool recvMessage(Message& msg) override;
+    void close() override;
+
+public:
+    HANDLE hPipe;
+    Message inbox[MAX_BATCH_MESSAGES];
+    int inboxCount;
+    int inboxPos;
+};
+
+class PipeListener : public TransportListener {
+public:
+    PipeListener(const std::string& pipeName);
+
+    bool listen() override;
+    std::unique_ptr<Transport> accept() override;
+    void close() override {}
+
+public:
+    std::string pipeName;
+};
@@ -0,0 +1,80 @@
+#include "ReadLeases.h"
+#include <algorithm>
+#include <cstring>
+
+ReadLeases::ReadLeases() : stripes(new Stripe[STRIPES]), granted(0) {}
+
+void ReadLeases::attach(std::shared_ptr<LeaseHolder>& holder, std::function<void(const Message& msg)> push) {
+    if (!holder) {
+        holder = std::make_shared<LeaseHolder>();
+    }
+    std::lock_guard<std::mutex> lk(holder->mutex);
+    holder->push = std::move(push);
+}
+
+// No two locks are ever held together here, so push may take the
+// connection's own locks.
+void ReadLeases::grant(int id, const std::shared_ptr<LeaseHolder>& holder) {
+    {
+        std::lock_guard<std::mutex> lk(holder->mutex);
+        if (holder->closed || !holder->ids.insert(id).second) return;
+    }
+    Stripe& s = stripeFor(id);
+    std::lock_guard<std::mutex> lk(s.mutex);
+    s.holders[id].push_back(holder);
+    granted.fetch_add(1);
+}
+
+void ReadLeases::revoke(int id) {
+    if (granted.load() == 0) return;
+
+    std::vector<std::shared_ptr<LeaseHolder>> leased;
+    {
+        Stripe& s = stripeFor(id);
+        std::lock_guard<std::mutex> lk(s.mutex);
+        auto it = s.holders.find(id);
+        if (it == s.holders.end()) return;
+        leased.swap(it->second);
+        s.holders.erase(it);
+    }
+    granted.fetch_sub(leased.size());
+
+    Message msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.type = INVALIDATE;
+    msg.id = id;
+    for (auto& holder : leased) {
+        std::lock_guard<std::mutex> lk(holder->mutex);
+        if (holder->ids.erase(id) && !holder->closed && holder->push) holder->push(msg);
+    }
+}
+
+bool ReadLeases::holdsAny(const std::shared_ptr<LeaseHolder>& holder) {
+    if (!holder) return false;
+    std::lock_guard<std::mutex> lk(holder->mutex);
+    return !holder->ids.empty();
+}
+
+// Once this returns push is never called again; dropping it also breaks any
+// reference cycle through the connection it captured.
+void ReadLeases::release(const std::shared_ptr<LeaseHolder>& holder) {
+    std::unordered_set<int> ids;
+    {
+        std::lock_guard<std::mutex> lk(holder->mutex);
+        holder->closed = true;
+        holder->push = nullptr;
+        ids.swap(holder->ids);
+    }
+    for (int id : ids) {
+        Stripe& s = stripeFor(id);
+        std::lock_guard<std::mutex> lk(s.mutex);
+        auto it = s.holders.find(id);
+        if (it == s.holders.end()) continue;
+        auto& list = it->second;
+        auto pos = std::find(list.begin(), list.end(), holder);
+        if (pos == list.end()) continue;
+        list.erase(pos);
+        granted.fetch_sub(1);
+        if (list.empty()) s.holders.erase(it);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "../common/Message.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A session's side of its read leases. push hands a message to the session's
+// client from any thread; it is only called under mutex and never after the
+// holder is released.
+struct LeaseHolder {
+    std::mutex mutex;
+    std::function<void(const Message& msg)> push;
+    std::unordered_set<int> ids;
+    bool closed = false;
+};
+
+// Records clients keep cached (READ_CACHED). Every change of a leased record
+// pushes one INVALIDATE to each holder and ends those leases; the client
+// reads the record again to get a new one. Leases are kept in stripes by ID,
+// and a change of a record nobody leases costs one atomic load.
+class ReadLeases {
+public:
+    ReadLeases();
+
+    // Gives the session a holder, or points its existing one at a new
+    // connection.
+    void attach(std::shared_ptr<LeaseHolder>& holder, std::function<void(const Message& msg)> push);
+    // Take the lease before reading the record, so a change that comes after
+    // the read is sure to find it.
+    void grant(int id, const std::shared_ptr<LeaseHolder>& holder);
+    // Call once the record's new image is in place.
+    void revoke(int id);
+    void release(const std::shared_ptr<LeaseHolder>& holder);
+    bool holdsAny(const std::shared_ptr<LeaseHolder>& holder);
+
+public:
+    static const size_t STRIPES = 64;
+
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::unordered_map<int, std::vector<std::shared_ptr<LeaseHolder>>> holders;
+    };
+
+    std::unique_ptr<Stripe[]> stripes;
+    // Leases granted and not yet revoked or released.
+    std::atomic<size_t> granted;
+
+    Stripe& stripeFor(int id) { return stripes[static_cast<uint32_t>(id) % STRIPES]; }
+};
@@ -1,26 +1,221 @@
 #include "RecordManager.h"
+#include "RecordShards.h"
+#include "../common/Platform.h"
 #include <fstream>
 #include <iostream>
 #include <cstring>
+#include <chrono>
+#include <future>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <limits>
 
-RecordManager::RecordManager(const std::string& filename) : filename(filename) {}
+static const size_t MIN_RECORDS_PER_THREAD = 16384;
+static const int OPTIMISTIC_READ_ATTEMPTS = 4;
 
-bool RecordManager::getIndexForId(int id, size_t &outIdx) {
-    auto it = idToIndex.find(id);
-    if (it == idToIndex.end()) return false;
-    outIdx = it->second;
+RecordManager::RecordManager(const std::string& filename)
+    : filename(filename), scanIndexed(false), columnar(false), packedFile(false), packedCount(0),
+      syncPolicy(SYNC_PER_WRITE), dirty(false), syncStop(false) {}
+
+RecordManager::~RecordManager() {
+    shards.reset();
+#ifdef __linux__
+    uring.reset();
+#endif
+    wal.reset();
+    if (syncThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(syncMutex);
+            syncStop = true;
+        }
+        syncCv.notify_all();
+        syncThread.join();
+    }
+    if (mapped && syncPolicy != SYNC_PER_WRITE && !mapped->syncAll()) {
+        std::cerr << "msync of " << filename << " failed on shutdown\n";
+    }
+}
+
+Employee& RecordManager::recordAt(size_t idx) {
+    if (mapped) {
+        return reinterpret_cast<Employee*>(mapped->data)[idx];
+    }
+    return records[idx];
+}
+
+void RecordManager::loadRecord(size_t idx, Employee& out) {
+    recordLocks.readConsistent(idx, &out, &recordAt(idx), sizeof(Employee), 0);
+}
+
+void RecordManager::storeRecord(size_t idx, const Employee& e) {
+    Employee before;
+    loadRecord(idx, before);
+    snapshots.write(before, e, [&]() { recordLocks.writeConsistent(idx, &recordAt(idx), &e, sizeof(Employee)); });
+}
+
+uint64_t RecordManager::openSnapshot() {
+    return snapshots.openSnapshot();
+}
+
+void RecordManager::closeSnapshot(uint64_t ts) {
+    snapshots.closeSnapshot(ts);
+}
+
+// Takes no record lock and never waits for a writer of the record. Shards
+// keep no common timestamps, so sharded mode has no snapshots.
+bool RecordManager::readSnapshot(uint64_t ts, int id, Employee& out) {
+    if (shards) return false;
+    return snapshots.read(ts, id, [&](Employee& now) {
+        size_t idx;
+        if (!getIndexForId(id, idx)) return false;
+        loadRecord(idx, now);
+        return now.num == id;
+    }, out);
+}
+
+// Copies the record without touching its lock. LOCK_BUSY means the image kept
+// changing under the copy; the caller falls back to the shared lock.
+LockResult RecordManager::readRecordOptimistic(int id, Employee& out) {
+    if (shards) {
+        LockResult r;
+        shards->run(id, [&](RecordManager& m) { r = m.readRecordOptimistic(id, out); });
+        return r;
+    }
+    size_t idx;
+    if (!getIndexForId(id, idx)) {
+        return LOCK_NOT_FOUND;
+    }
+    if (!recordLocks.readConsistent(idx, &out, &recordAt(idx), sizeof(Employee), OPTIMISTIC_READ_ATTEMPTS)) {
+        return LOCK_BUSY;
+    }
+    // The slot was freed or reused after the lookup.
+    return out.num == id ? LOCK_OK : LOCK_NOT_FOUND;
+}
+
+// Maps the employee file once and serves reads and updates in place. The file
+// must hold exactly the loaded records; if none are loaded, the index is built
+// from the file.
+bool RecordManager::useMappedStorage(SyncPolicy policy, int periodMs) {
+    if (packedFile || isPackedFile(filename)) {
+        std::cerr << "Packed data files are not mapped; use file streams\n";
+        return false;
+    }
+    // The kernel writes mapped pages back whenever it likes, ahead of the log.
+    if (wal) {
+        std::cerr << "The data file is not mapped while the write-ahead log is on\n";
+        return false;
+    }
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(filename)) {
+        return false;
+    }
+    if (file->size % sizeof(Employee) != 0 ||
+        (!records.empty() && file->size != records.size() * sizeof(Employee))) {
+        std::cerr << "File " << filename << " does not match the loaded records\n";
+        return false;
+    }
+
+    if (records.empty() &&
+        !buildIndex(reinterpret_cast<const Employee*>(file->data), file->size / sizeof(Employee), 0)) {
+        return false;
+    }
+
+    mapped = std::move(file);
+    syncPolicy = policy;
+    records.clear();
+
+    if (policy == SYNC_PERIODIC) {
+        syncThread = std::thread(&RecordManager::syncLoop, this, periodMs);
+    }
     return true;
 }
 
+// Replays a log left by a crash into the data file, so call it before records
+// are loaded from that file.
+bool RecordManager::enableWriteAheadLog(int checkpointMs) {
+    if (packedFile || isPackedFile(filename)) {
+        std::cerr << "The write-ahead log only works with raw data files\n";
+        return false;
+    }
+    if (mapped) {
+        std::cerr << "The write-ahead log cannot be used with a mapped data file\n";
+        return false;
+    }
+    auto log = std::make_unique<WriteAheadLog>(filename);
+    if (!log->open(checkpointMs)) {
+        return false;
+    }
+    wal = std::move(log);
+    return true;
+}
+
+bool RecordManager::useIoUring(bool linkedSync) {
+#ifdef __linux__
+    if (mapped || wal || packedFile) {
+        std::cerr << "io_uring writes are only used with raw file stream storage\n";
+        return false;
+    }
+    auto engine = std::make_unique<UringEngine>();
+    if (!engine->open(filename, linkedSync)) {
+        return false;
+    }
+    uring = std::move(engine);
+    return true;
+#else
+    (void)linkedSync;
+    std::cerr << "io_uring is only available on Linux\n";
+    return false;
+#endif
+}
+
+// Returns false when no asynchronous engine is configured; otherwise done is
+// called exactly once, possibly before this function returns.
+bool RecordManager::writeRecordAsync(const Employee& e, std::function<void(bool ok)> done) {
+#ifdef __linux__
+    if (!uring) return false;
+
+    size_t idx;
+    if (!getIndexForId(e.num, idx)) {
+        done(false);
+        return true;
+    }
+    Employee before;
+    loadRecord(idx, before);
+    storeRecord(idx, e);
+    noteChange(idx, before, e);
+    uring->submitWrite(static_cast<uint64_t>(idx) * sizeof(Employee), e, std::move(done));
+    return true;
+#else
+    (void)e;
+    (void)done;
+    return false;
+#endif
+}
+
+void RecordManager::syncLoop(int periodMs) {
+    std::unique_lock<std::mutex> lk(syncMutex);
+    while (!syncCv.wait_for(lk, std::chrono::milliseconds(periodMs), [this]() { return syncStop; })) {
+        if (!dirty.exchange(false)) continue;
+        lk.unlock();
+        if (!mapped->syncAll()) {
+            std::cerr << "periodic msync of " << filename << " failed\n";
+        }
+        lk.lock();
+    }
+}
+
+bool RecordManager::getIndexForId(int id, size_t &outIdx) {
+    return idToIndex.find(id, outIdx);
+}
+
 void RecordManager::initRecords() {
     int nRecords;
     std::cout << "Number of records: ";
     std::cin >> nRecords;
     if (nRecords <= 0) return;
 
-    records.clear();
-    records.resize(nRecords);
-
+    std::vector<Employee> entered(nRecords);
     for (int i = 0; i < nRecords; ++i) {
         Employee e{};
         std::cout << "ID: "; std::cin >> e.num;
@@ -28,80 +223,319 @@ void RecordManager::initRecords() {
         strncpy_s(e.name, name.c_str(), sizeof(e.name) - 1);
         e.name[sizeof(e.name)-1] = '\0';
         std::cout << "hours: "; std::cin >> e.hours;
-        records[i] = e;
+        entered[i] = e;
     }
 
-    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
-    if (!fout) {
-        std::cerr << "Error openning file: " << filename << "\n";
+    if (!writeEmployeeFile(filename, entered)) {
         return;
     }
-    for (auto& e : records) {
-        fout.write(reinterpret_cast<const char*>(&e), sizeof(e));
-        if (!fout) {
-            std::cerr << "Error writing in file\n";
-            break;
+    WriteAheadLog::discard(filename);
+    packedFile = false;
+
+    records = entered;
+    idToIndex.clear();
+    idToIndex.reserve(entered.size());
+    for (size_t i = 0; i < entered.size(); ++i) {
+        idToIndex.insert(entered[i].num, i);
+    }
+    recordLocks.resize(entered.size());
+}
+
+// Builds idToIndex, recordLocks and the free list for data[0..count). Each
+// thread takes a contiguous slice and inserts those IDs into a presized index
+// (direct-addressed if the IDs are dense), which also catches duplicates.
+// Slots holding FREE_RECORD_ID go to the free list. On a duplicate ID nothing
+// is changed.
+bool RecordManager::buildIndex(const Employee* data, size_t count, unsigned nThreads) {
+    if (count >= ConcurrentIndex::DELETED) {
+        std::cerr << "Too many records: " << count << "\n";
+        return false;
+    }
+    unsigned n = nThreads ? nThreads : std::max(1u, std::thread::hardware_concurrency());
+    n = static_cast<unsigned>(std::min<size_t>(n, std::max<size_t>(1, count / MIN_RECORDS_PER_THREAD)));
+
+    int minId = INT_MAX;
+    int maxId = INT_MIN;
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (data[i].num == FREE_RECORD_ID) continue;
+        minId = std::min(minId, data[i].num);
+        maxId = std::max(maxId, data[i].num);
+        ++used;
+    }
+    ConcurrentIndex index;
+    index.reserveRange(minId, maxId, used);
+    std::vector<size_t> duplicateAt(n, count);
+    std::vector<std::vector<size_t>> freeParts(n);
+
+    auto work = [&](unsigned t) {
+        for (size_t i = count * t / n; i < count * (t + 1) / n; ++i) {
+            if (data[i].num == FREE_RECORD_ID) {
+                freeParts[t].push_back(i);
+            }
+            else if (!index.insert(data[i].num, i)) {
+                duplicateAt[t] = i;
+                return;
+            }
         }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < n; ++t) {
+        workers.emplace_back(work, t);
     }
-    fout.close();
+    work(0);
+    for (auto& w : workers) w.join();
 
-    idToIndex.clear();
-    recordLocks.clear();
-    recordLocks.reserve(records.size());
-    for (size_t i = 0; i < records.size(); ++i) {
-        idToIndex[records[i].num] = i;
-        recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    for (size_t at : duplicateAt) {
+        if (at != count) {
+            std::cerr << "Duplicate ID " << data[at].num << " at record " << at + 1 << "\n";
+            return false;
+        }
     }
 
+    idToIndex.swap(index);
+    recordLocks.resize(count);
+    freeSlots.clear();
+    for (auto& part : freeParts) {
+        freeSlots.insert(freeSlots.end(), part.begin(), part.end());
+    }
+    return true;
+}
 
+// Reopens the data file as it is: one sequential read, then a parallel index
+// build. A packed file has its checksums verified and is unpacked in parallel.
+bool RecordManager::openExisting(unsigned nThreads) {
+    auto start = std::chrono::steady_clock::now();
+    if (isPackedFile(filename)) {
+        std::vector<Employee> loaded;
+        if (!readPackedFile(filename, loaded, nThreads)) {
+            return false;
+        }
+        auto readDone = std::chrono::steady_clock::now();
+        if (!buildIndex(loaded.data(), loaded.size(), nThreads)) {
+            return false;
+        }
+        records = loaded;
+        packedFile = true;
+        packedCount = loaded.size();
+        reportOpen(start, readDone);
+        return true;
+    }
+
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in) {
+        std::cerr << "Error openning file: " << filename << "\n";
+        return false;
+    }
+    std::streamsize size = in.tellg();
+    if (size % static_cast<std::streamsize>(sizeof(Employee)) != 0) {
+        std::cerr << "File " << filename << " is not a whole number of records\n";
+        return false;
+    }
 
+    std::vector<Employee> loaded(static_cast<size_t>(size) / sizeof(Employee));
+    in.seekg(0);
+    if (size > 0 && !in.read(reinterpret_cast<char*>(loaded.data()), size)) {
+        std::cerr << "Error reading file: " << filename << "\n";
+        return false;
+    }
+    auto readDone = std::chrono::steady_clock::now();
+
+    if (!buildIndex(loaded.data(), loaded.size(), nThreads)) {
+        return false;
+    }
+    records = loaded;
+    packedFile = false;
+    reportOpen(start, readDone);
+    return true;
 }
 
-bool RecordManager::readRecordById(int id, Employee& out) {
+void RecordManager::reportOpen(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point readDone) {
+    auto end = std::chrono::steady_clock::now();
+    auto ms = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+    std::cout << "Opened " << records.size() << " records from " << filename << (packedFile ? " (packed)" : "")
+              << ": read " << ms(readDone - start) << " ms, index " << ms(end - readDone) << " ms\n";
+}
+
+// Rewrites the data file in the packed layout from the records in memory;
+// later writes keep that layout. Only the file stream backend supports it.
+bool RecordManager::savePacked() {
+    if (mapped || wal) {
+        std::cerr << "Packed data files need file stream storage\n";
+        return false;
+    }
+#ifdef __linux__
+    if (uring) {
+        std::cerr << "Packed data files need file stream storage\n";
+        return false;
+    }
+#endif
+    std::vector<Employee> all(recordCount());
+    for (size_t i = 0; i < all.size(); ++i) {
+        loadRecord(i, all[i]);
+    }
+    if (!writePackedFile(filename, all)) {
+        return false;
+    }
+    packedFile = true;
+    packedCount = all.size();
+    return true;
+}
 
+// Non-interactive replacement for initRecords: the source is parsed in
+// parallel, IDs must be unique, and the data file is written in one pass.
+bool RecordManager::importRecords(const std::string& source, ImportFormat format, unsigned nThreads) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Employee> loaded;
+    if (!loadEmployees(source, format, loaded, nThreads)) {
+        return false;
+    }
+
+    if (!buildIndex(loaded.data(), loaded.size(), nThreads) || !writeEmployeeFile(filename, loaded)) {
+        idToIndex.clear();
+        recordLocks.resize(0);
+        return false;
+    }
+    WriteAheadLog::discard(filename);
+    packedFile = false;
+    records = loaded;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Imported " << records.size() << " records from " << source << " in " << ms << " ms\n";
+    return true;
+}
+
+bool RecordManager::readRecordById(int id, Employee& out) {
+    if (shards) {
+        bool found;
+        shards->run(id, [&](RecordManager& m) { found = m.readRecordById(id, out); });
+        return found;
+    }
     
     size_t idx;
-    {
-        std::lock_guard<std::mutex> lk(indexMutex);
-        if (!getIndexForId(id, idx)) {
-            std::cout << "RECORD MANAGER: ERROR - ID " << id << " not found in index!\n";
-            return false;
-        }
+    if (!getIndexForId(id, idx)) {
+        std::cout << "RECORD MANAGER: ERROR - ID " << id << " not found in index!\n";
+        return false;
     }
  
-    out = records[idx];
+    loadRecord(idx, out);
     return true;
 }
 
 bool RecordManager::readRecordByIdNoLock(int id, Employee& out) {
- 
+    // A shard's thread must never block on a record lock.
+    if (shards) {
+        if (!lockRecord(id, false)) return false;
+        bool found = readRecordById(id, out);
+        unlockRecord(id, false);
+        return found;
+    }
     size_t idx;
-    {
-        std::lock_guard<std::mutex> lk(indexMutex);
-        if (!getIndexForId(id, idx)) {
-           
-            return false;
-        }
+    if (!getIndexForId(id, idx)) {
+       
+        return false;
     }
     
    
-    recordLocks[idx]->lock_shared();
-    out = records[idx];
-    recordLocks[idx]->unlock_shared();
+    recordLocks.lock(idx, false);
+    loadRecord(idx, out);
+    recordLocks.unlock(idx, false);
     return true;
 }
 
 bool RecordManager::writeRecord(const Employee& e) {
-
+    if (shards) {
+        bool ok;
+        shards->run(e.num, [&](RecordManager& m) { ok = m.writeRecord(e); });
+        return ok;
+    }
     size_t idx;
-    {
-        std::lock_guard<std::mutex> lk(indexMutex);
-        if (!getIndexForId(e.num, idx)) {
+    if (!getIndexForId(e.num, idx)) {
+        return false;
+    }
+    if (!scanIndexed && !columnar) {
+        return persistRecord(idx, e);
+    }
+    // The caller holds the write lock, so nobody else replaces the image
+    // between this read and the update below; the image is replaced even if
+    // the write to disk fails, so the derived copies follow it either way.
+    Employee before;
+    loadRecord(idx, before);
+    bool ok = persistRecord(idx, e);
+    noteChange(idx, before, e);
+    return ok;
+}
+
+// The caller holds the write lock of every record. All images are replaced
+// under one snapshot timestamp, then written to disk as one batch: a single
+// log append with the WAL, a single sync of the mapping, one pass over the
+// data file otherwise. Sharded, every shard writes its part of the batch.
+bool RecordManager::writeRecords(const std::vector<Employee>& batch) {
+    if (shards) {
+        std::vector<std::vector<Employee>> parts(shards->size());
+        for (const Employee& e : batch) {
+            parts[shards->shardOf(e.num)].push_back(e);
+        }
+        std::atomic<bool> ok{true};
+        shards->each([&](size_t k, RecordManager& m) {
+            if (!parts[k].empty() && !m.writeRecords(parts[k])) ok = false;
+        });
+        return ok;
+    }
+    std::vector<size_t> idx(batch.size());
+    std::vector<Employee> before(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (!getIndexForId(batch[i].num, idx[i])) {
             return false;
         }
+        loadRecord(idx[i], before[i]);
+    }
+    snapshots.writeBatch(before, batch, [&]() {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            recordLocks.writeConsistent(idx[i], &recordAt(idx[i]), &batch[i], sizeof(Employee));
+        }
+    });
+    bool ok = persistBatch(idx, batch);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        noteChange(idx[i], before[i], batch[i]);
+    }
+    return ok;
+}
+
+// Replaces the image in memory and writes it to slot idx of the data file
+// through whichever backend is configured.
+bool RecordManager::persistRecord(size_t idx, const Employee& e) {
+    if (wal) {
+        storeRecord(idx, e);
+        return wal->append(idx, e);
+    }
+
+#ifdef __linux__
+    if (uring) {
+        std::promise<bool> written;
+        std::future<bool> result = written.get_future();
+        storeRecord(idx, e);
+        uring->submitWrite(static_cast<uint64_t>(idx) * sizeof(Employee), e,
+                           [&written](bool ok) { written.set_value(ok); });
+        return result.get();
+    }
+#endif
+
+    if (mapped) {
+        storeRecord(idx, e);
+        if (syncPolicy == SYNC_PER_WRITE) {
+            return mapped->sync(idx * sizeof(Employee), sizeof(Employee));
+        }
+        dirty = true;
+        return true;
     }
 
-    records[idx] = e;
+    storeRecord(idx, e);
+    if (packedFile) {
+        return writePackedBlock(idx);
+    }
 
     std::fstream fio(filename, std::ios::in | std::ios::out | std::ios::binary);
     if (!fio) {
@@ -109,7 +543,7 @@ bool RecordManager::writeRecord(const Employee& e) {
         return false;
     }
 
-    std::streamoff pos = static_cast<std::streamoff>(idx) * static_cast<std::streamoff>(sizeof(Employee));
+    std::streamoff pos = static_cast<std::streamoff>(fileSlot(idx)) * static_cast<std::streamoff>(sizeof(Employee));
     fio.seekp(pos, std::ios::beg);
     if (!fio) {
         std::cerr << "seekp failed\n";
@@ -127,36 +561,541 @@ bool RecordManager::writeRecord(const Employee& e) {
     return true;
 }
 
+// Writes images already stored in memory to their slots of the data file.
+bool RecordManager::persistBatch(const std::vector<size_t>& idx, const std::vector<Employee>& batch) {
+    if (wal) {
+        return wal->appendBatch(idx.data(), batch.data(), batch.size());
+    }
+
+#ifdef __linux__
+    if (uring) {
+        std::vector<std::promise<bool>> written(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            std::promise<bool>* p = &written[i];
+            uring->submitWrite(static_cast<uint64_t>(idx[i]) * sizeof(Employee), batch[i],
+                               [p](bool ok) { p->set_value(ok); });
+        }
+        bool ok = true;
+        for (auto& w : written) {
+            ok = w.get_future().get() && ok;
+        }
+        return ok;
+    }
+#endif
+
+    if (mapped) {
+        if (syncPolicy != SYNC_PER_WRITE) {
+            dirty = true;
+            return true;
+        }
+        auto span = std::minmax_element(idx.begin(), idx.end());
+        if (span.first == idx.end()) return true;
+        return mapped->sync(*span.first * sizeof(Employee), (*span.second - *span.first + 1) * sizeof(Employee));
+    }
+
+    if (packedFile) {
+        std::vector<size_t> blocks;
+        for (size_t i : idx) {
+            blocks.push_back(i / PACKED_RECORDS_PER_BLOCK);
+        }
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        bool ok = true;
+        for (size_t b : blocks) {
+            ok = writePackedBlock(b * PACKED_RECORDS_PER_BLOCK) && ok;
+        }
+        return ok;
+    }
+
+    std::fstream fio(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (!fio) {
+        std::cerr << "Error oppening file: " << filename << "\n";
+        return false;
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+        fio.seekp(static_cast<std::streamoff>(fileSlot(idx[i])) * static_cast<std::streamoff>(sizeof(Employee)),
+                  std::ios::beg);
+        fio.write(reinterpret_cast<const char*>(&batch[i]), sizeof(Employee));
+    }
+    fio.flush();
+    if (!fio) {
+        std::cerr << "write failed\n";
+        return false;
+    }
+    return true;
+}
+
+// Rewrites the whole block holding idx from memory, checksum included, and
+// the header if idx is a new record. Writers of one block are serialized so
+// the checksum covers exactly what ends up in the file.
+bool RecordManager::writePackedBlock(size_t idx) {
+    size_t block = idx / PACKED_RECORDS_PER_BLOCK;
+    std::lock_guard<std::mutex> lk(blockLocks[block % BLOCK_LOCKS]);
+    size_t count = std::max(packedCount.load(), idx + 1);
+    size_t first = block * PACKED_RECORDS_PER_BLOCK;
+    size_t n = std::min(PACKED_RECORDS_PER_BLOCK, count - first);
+
+    std::vector<unsigned char> bytes(n * PACKED_RECORD_SIZE + sizeof(uint32_t));
+    Employee e;
+    for (size_t i = 0; i < n; ++i) {
+        loadRecord(first + i, e);
+        packRecord(e, bytes.data() + i * PACKED_RECORD_SIZE);
+    }
+    uint32_t crc = crc32c(bytes.data(), n * PACKED_RECORD_SIZE);
+    std::memcpy(bytes.data() + n * PACKED_RECORD_SIZE, &crc, sizeof(crc));
+
+    std::fstream fio(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (!fio) {
+        std::cerr << "Error oppening file: " << filename << "\n";
+        return false;
+    }
+    fio.seekp(static_cast<std::streamoff>(packedBlockOffset(block)), std::ios::beg);
+    fio.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (count > packedCount.load()) {
+        PackedHeader header = makePackedHeader(count);
+        fio.seekp(0, std::ios::beg);
+        fio.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    fio.flush();
+    if (!fio) {
+        std::cerr << "write failed\n";
+        return false;
+    }
+    if (count > packedCount.load()) packedCount = count;
+    return true;
+}
+
+// The record may be deleted, and its slot reused, while we wait for its
+// lock, so the ID is looked up again once the lock is held. Sharded, the
+// calling thread waits through lockWaits rather than on the shard's lock.
 bool RecordManager::lockRecord(int id, bool exclusive) {
+    if (shards) {
+        while (true) {
+            LockResult r = tryLockRecord(id, exclusive);
+            if (r != LOCK_BUSY) return r == LOCK_OK;
+            std::mutex m;
+            std::condition_variable cv;
+            bool woken = false;
+            waitForLock(id, exclusive, &woken, NO_LOCK_DEADLINE, [&]() {
+                std::lock_guard<std::mutex> lk(m);
+                woken = true;
+                cv.notify_one();
+            });
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&]() { return woken; });
+        }
+    }
     size_t idx;
-    {
-        std::lock_guard<std::mutex> lk(indexMutex);
-        if (!getIndexForId(id, idx)) {
+    while (getIndexForId(id, idx)) {
+        recordLocks.lock(idx, exclusive);
+        size_t now;
+        if (getIndexForId(id, now) && now == idx) return true;
+        recordLocks.unlock(idx, exclusive);
+    }
+    return false;
+}
+
+LockResult RecordManager::tryLockRecord(int id, bool exclusive) {
+    if (shards) {
+        LockResult r;
+        shards->run(id, [&](RecordManager& m) { r = m.tryLockRecord(id, exclusive); });
+        return r;
+    }
+    size_t idx;
+    while (getIndexForId(id, idx)) {
+        if (!recordLocks.tryLock(idx, exclusive)) return LOCK_BUSY;
+        size_t now;
+        if (getIndexForId(id, now) && now == idx) return LOCK_OK;
+        recordLocks.unlock(idx, exclusive);
+    }
+    return LOCK_NOT_FOUND;
+}
+
+size_t RecordManager::recordCount() const {
+    return mapped ? mapped->size / sizeof(Employee) : records.size();
+}
+
+// Takes a slot from the free list or appends one. Storage, lock table and
+// index all grow in place, so requests on other records carry on; only
+// creates and deletes are serialized. A shard appends at the shared end of
+// the data file.
+bool RecordManager::createRecord(const Employee& e) {
+    if (e.num == FREE_RECORD_ID) {
+        return false;
+    }
+    if (shards) {
+        bool ok;
+        shards->run(e.num, [&](RecordManager& m) { ok = m.createRecord(e); });
+        return ok;
+    }
+    std::lock_guard<std::mutex> lk(createMutex);
+    size_t idx;
+    if (getIndexForId(e.num, idx)) {
+        return false;
+    }
+
+    Employee free{};
+    free.num = FREE_RECORD_ID;
+    bool reused = !freeSlots.empty();
+    if (reused) {
+        idx = freeSlots.back();
+    } else {
+        // The lock table grows first and the new slot starts out free, so
+        // whoever walks all slots never meets one it cannot read.
+        idx = recordCount();
+        if (idx + 1 >= ConcurrentIndex::DELETED) {
             return false;
         }
+        recordLocks.grow(idx + 1);
+        if (mapped) {
+            if (!mapped->grow((idx + 1) * sizeof(Employee))) {
+                std::cerr << "Mapping of " << filename << " is full, restart to add records\n";
+                return false;
+            }
+            recordLocks.writeConsistent(idx, &recordAt(idx), &free, sizeof(Employee));
+        } else {
+            records.push_back(free);
+        }
+        if (fileEnd) fileSlots.push_back(fileEnd->fetch_add(1));
     }
-   
-    if (exclusive) {
-        recordLocks[idx]->lock();
-    } else {
-        recordLocks[idx]->lock_shared();
+
+    if (!persistRecord(idx, e)) {
+        storeRecord(idx, free);
+        if (!reused) freeSlots.push_back(idx);
+        return false;
     }
+    if (reused) freeSlots.pop_back();
+    idToIndex.insert(e.num, idx);
+    noteChange(idx, free, e);
     return true;
 }
 
-void RecordManager::unlockRecord(int id, bool exclusive) {
+// The caller holds the record's write lock; it is released here, after the
+// ID is gone from the index, so whoever waited for it finds the record deleted.
+// The free image is stored before the index entry goes, so a snapshot that
+// still finds the ID also finds the deleted image in the version history.
+bool RecordManager::deleteRecord(int id) {
+    if (shards) {
+        bool ok;
+        shards->run(id, [&](RecordManager& m) { ok = m.deleteRecord(id); });
+        if (ok) lockWaits.released(id);
+        return ok;
+    }
+    std::lock_guard<std::mutex> lk(createMutex);
     size_t idx;
-    {
-        std::lock_guard<std::mutex> lk(indexMutex);
-        if (!getIndexForId(id, idx)) {
-         
-            return;
+    if (!getIndexForId(id, idx)) {
+        return false;
+    }
+
+    Employee old;
+    loadRecord(idx, old);
+    Employee free{};
+    free.num = FREE_RECORD_ID;
+    if (!persistRecord(idx, free)) {
+        storeRecord(idx, old);
+        return false;
+    }
+    idToIndex.erase(id);
+    noteChange(idx, old, free);
+    recordLocks.unlock(idx, true);
+    lockWaits.released(id);
+    freeSlots.push_back(idx);
+    return true;
+}
+
+std::vector<Employee> RecordManager::liveRecords() {
+    if (shards) {
+        std::vector<std::vector<Employee>> parts(shards->size());
+        shards->each([&](size_t k, RecordManager& m) { parts[k] = m.liveRecords(); });
+        std::vector<Employee> live;
+        for (auto& part : parts) {
+            live.insert(live.end(), part.begin(), part.end());
+        }
+        return live;
+    }
+    std::vector<Employee> live;
+    live.reserve(recordCount());
+    Employee e;
+    for (size_t i = 0; i < recordCount(); ++i) {
+        loadRecord(i, e);
+        if (e.num != FREE_RECORD_ID) live.push_back(e);
+    }
+    return live;
+}
+
+// Call once the records are loaded and before clients are served; from then
+// on every write, create and delete keeps the indexes current.
+void RecordManager::enableScanIndex() {
+    if (shards) {
+        shards->each([](size_t, RecordManager& m) { m.enableScanIndex(); });
+        return;
+    }
+    scanIndex.rebuild(liveRecords());
+    scanIndexed = true;
+}
+
+// Same contract as enableScanIndex.
+void RecordManager::enableColumnStore() {
+    if (shards) {
+        shards->each([](size_t, RecordManager& m) { m.enableColumnStore(); });
+        return;
+    }
+    std::vector<Employee> all(recordCount());
+    for (size_t i = 0; i < all.size(); ++i) {
+        loadRecord(i, all[i]);
+    }
+    columns.rebuild(all);
+    columnar = true;
+}
+
+// Keeps the scan index and the column mirror in line with a slot whose image
+// went from before to after; either side may be a free slot.
+void RecordManager::noteChange(size_t idx, const Employee& before, const Employee& after) {
+    if (scanIndexed) {
+        if (before.num == FREE_RECORD_ID) scanIndex.insert(after);
+        else if (after.num == FREE_RECORD_ID) scanIndex.erase(before);
+        else scanIndex.update(before, after);
+    }
+    if (columnar) columns.set(idx, after);
+}
+
+// Without the mirror the hours are gathered into a column first and the same
+// kernels run over that.
+std::vector<double> RecordManager::hoursColumn() {
+    std::vector<double> hours(recordCount());
+    Employee e;
+    for (size_t i = 0; i < hours.size(); ++i) {
+        loadRecord(i, e);
+        hours[i] = e.num != FREE_RECORD_ID ? e.hours : std::numeric_limits<double>::quiet_NaN();
+    }
+    return hours;
+}
+
+HoursSummary RecordManager::hoursSummary() {
+    if (shards) {
+        std::vector<HoursSummary> parts(shards->size());
+        shards->each([&](size_t k, RecordManager& m) { parts[k] = m.hoursSummary(); });
+        HoursSummary s{0, 0.0, std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()};
+        for (const HoursSummary& p : parts) {
+            if (p.count == 0) continue;
+            s.min = s.count ? std::min(s.min, p.min) : p.min;
+            s.max = s.count ? std::max(s.max, p.max) : p.max;
+            s.count += p.count;
+            s.sum += p.sum;
+        }
+        return s;
+    }
+    if (columnar) return columns.summary();
+    std::vector<double> hours = hoursColumn();
+    return summarizeHours(hours.data(), hours.size());
+}
+
+size_t RecordManager::hoursInRange(double lo, double hi) {
+    if (shards) {
+        std::atomic<size_t> n{0};
+        shards->each([&](size_t, RecordManager& m) { n += m.hoursInRange(lo, hi); });
+        return n;
+    }
+    if (columnar) return columns.countInRange(lo, hi);
+    std::vector<double> hours = hoursColumn();
+    return countHoursInRange(hours.data(), hours.size(), lo, hi);
+}
+
+void RecordManager::hoursHistogram(double lo, double hi, std::vector<size_t>& buckets) {
+    if (shards) {
+        std::vector<std::vector<size_t>> parts(shards->size(), std::vector<size_t>(buckets.size()));
+        shards->each([&](size_t k, RecordManager& m) { m.hoursHistogram(lo, hi, parts[k]); });
+        std::fill(buckets.begin(), buckets.end(), 0);
+        for (const auto& part : parts) {
+            for (size_t i = 0; i < buckets.size(); ++i) buckets[i] += part[i];
         }
+        return;
+    }
+    if (columnar) {
+        columns.histogram(lo, hi, buckets);
+        return;
+    }
+    std::vector<double> hours = hoursColumn();
+    histogramHours(hours.data(), hours.size(), lo, hi, buckets);
+}
+
+static bool nameOrder(const Employee& a, const Employee& b) {
+    int c = std::strncmp(a.name, b.name, NAME_SIZE);
+    return c != 0 ? c < 0 : a.num < b.num;
+}
+
+static bool hoursOrder(const Employee& a, const Employee& b) {
+    return a.hours != b.hours ? a.hours < b.hours : a.num < b.num;
+}
+
+// An index entry can be a step behind a record updated since the scan, so
+// each record is read and checked again; ones that no longer match are left
+// out, and the index is asked for more until limit rows are left or it has
+// no more. A record that still matches with a changed key is sorted by its
+// new one.
+void RecordManager::collectScan(const std::function<void(size_t want, std::vector<int>& ids)>& lookup,
+                                const std::function<bool(const Employee&)>& matches,
+                                bool (*order)(const Employee&, const Employee&), size_t limit,
+                                std::vector<Employee>& out) {
+    std::vector<int> ids;
+    size_t want = limit;
+    while (true) {
+        lookup(want, ids);
+        out.clear();
+        out.reserve(ids.size());
+        Employee e;
+        for (int id : ids) {
+            size_t idx;
+            if (!getIndexForId(id, idx)) continue;
+            loadRecord(idx, e);
+            if (e.num == id && matches(e)) out.push_back(e);
+        }
+        if (limit == 0 || out.size() >= limit || ids.size() < want) break;
+        want *= 2;
+    }
+    std::sort(out.begin(), out.end(), order);
+    if (limit && out.size() > limit) out.resize(limit);
+}
+
+// Every shard scans its own records up to the limit; their results are
+// merged into one ordered list.
+static void mergeScans(std::vector<std::vector<Employee>>& parts, size_t limit,
+                       bool (*order)(const Employee&, const Employee&), std::vector<Employee>& out) {
+    out.clear();
+    for (auto& part : parts) {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+    std::sort(out.begin(), out.end(), order);
+    if (limit && out.size() > limit) out.resize(limit);
+}
+
+// Results are ordered by name, then ID, with or without the index.
+void RecordManager::scanByName(const std::string& prefix, size_t limit, std::vector<Employee>& out) {
+    if (shards) {
+        std::vector<std::vector<Employee>> parts(shards->size());
+        shards->each([&](size_t k, RecordManager& m) { m.scanByName(prefix, limit, parts[k]); });
+        mergeScans(parts, limit, nameOrder, out);
+        return;
+    }
+    auto matches = [&prefix](const Employee& e) {
+        return SecondaryIndex::nameOf(e).compare(0, prefix.size(), prefix) == 0;
+    };
+    if (scanIndexed) {
+        auto lookup = [&](size_t want, std::vector<int>& ids) { scanIndex.scanNamePrefix(prefix, want, ids); };
+        collectScan(lookup, matches, nameOrder, limit, out);
+        return;
+    }
+
+    out.clear();
+    for (const Employee& e : liveRecords()) {
+        if (matches(e)) out.push_back(e);
+    }
+    std::sort(out.begin(), out.end(), nameOrder);
+    if (limit && out.size() > limit) out.resize(limit);
+}
+
+// Results are ordered by hours, then ID; both bounds are inclusive.
+void RecordManager::scanByHours(double lo, double hi, size_t limit, std::vector<Employee>& out) {
+    if (shards) {
+        std::vector<std::vector<Employee>> parts(shards->size());
+        shards->each([&](size_t k, RecordManager& m) { m.scanByHours(lo, hi, limit, parts[k]); });
+        mergeScans(parts, limit, hoursOrder, out);
+        return;
+    }
+    auto matches = [lo, hi](const Employee& e) { return e.hours >= lo && e.hours <= hi; };
+    if (scanIndexed) {
+        auto lookup = [&](size_t want, std::vector<int>& ids) { scanIndex.scanHours(lo, hi, want, ids); };
+        collectScan(lookup, matches, hoursOrder, limit, out);
+        return;
+    }
+
+    out.clear();
+    for (const Employee& e : liveRecords()) {
+        if (matches(e)) out.push_back(e);
+    }
+    std::sort(out.begin(), out.end(), hoursOrder);
+    if (limit && out.size() > limit) out.resize(limit);
+}
+
+void RecordManager::unlockRecord(int id, bool exclusive) {
+    if (shards) {
+        shards->run(id, [&](RecordManager& m) { m.unlockRecord(id, exclusive); });
+        lockWaits.released(id);
+        return;
+    }
+    size_t idx;
+    if (!getIndexForId(id, idx)) {
+     
+        return;
     }
     
-    if (exclusive) {
-        recordLocks[idx]->unlock();
-    } else {
-        recordLocks[idx]->unlock_shared();
+    recordLocks.unlock(idx, exclusive);
+    lockWaits.released(id);
+}
+
+// wake runs once the record may be lockable again, has been deleted, or the
+// deadline has passed; the caller then retries whatever it was doing.
+void RecordManager::waitForLock(int id, bool exclusive, const void* owner, LockDeadline deadline,
+                                std::function<void()> wake) {
+    lockWaits.wait(id, owner, deadline, std::move(wake), [this, id, exclusive]() { return lockAvailable(id, exclusive); });
+}
+
+// Also true once the record is gone: the waiter then finds out by retrying.
+bool RecordManager::lockAvailable(int id, bool exclusive) {
+    if (shards) {
+        bool free;
+        shards->run(id, [&](RecordManager& m) { free = m.lockAvailable(id, exclusive); });
+        return free;
+    }
+    size_t idx;
+    return !getIndexForId(id, idx) || recordLocks.isFree(idx, exclusive);
+}
+
+// Whether someone holds the record's write lock right now.
+bool RecordManager::writeLocked(int id) {
+    if (shards) {
+        bool locked;
+        shards->run(id, [&](RecordManager& m) { locked = m.writeLocked(id); });
+        return locked;
+    }
+    size_t idx;
+    return getIndexForId(id, idx) && !recordLocks.isFree(idx, false);
+}
+
+// Splits the loaded records over count shards by ID hash; free slots are
+// dealt round-robin. Each shard goes on writing its own slots of the data
+// file, so the file stays readable by --open. Call it before the scan index
+// or column store are enabled; they are then kept per shard.
+bool RecordManager::useShards(size_t count) {
+    if (count == 0 || shards) {
+        return false;
+    }
+    bool streams = !mapped && !wal && !packedFile && !recordLocks.striped() && !scanIndexed && !columnar;
+#ifdef __linux__
+    streams = streams && !uring;
+#endif
+    if (!streams) {
+        std::cerr << "Sharding needs raw file stream storage with per-record locks\n";
+        return false;
+    }
+
+    auto split = std::make_unique<RecordShards>(filename, count, recordCount());
+    std::vector<std::vector<Employee>> parts(count);
+    std::vector<std::vector<size_t>> slots(count);
+    Employee e;
+    for (size_t i = 0; i < recordCount(); ++i) {
+        loadRecord(i, e);
+        size_t k = e.num == FREE_RECORD_ID ? i % count : split->shardOf(e.num);
+        parts[k].push_back(e);
+        slots[k].push_back(i);
     }
+    if (!split->load(parts, slots)) {
+        return false;
+    }
+    shards = std::move(split);
+    records.clear();
+    idToIndex.clear();
+    recordLocks.resize(0);
+    freeSlots.clear();
+    return true;
 }
\ No newline at end of file
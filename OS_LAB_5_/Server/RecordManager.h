@@ -1,28 +1,154 @@
 #pragma once
 #include "../common/Employee.h"
+#include "MappedFile.h"
+#include "WriteAheadLog.h"
+#include "BulkLoader.h"
+#include "ConcurrentIndex.h"
+#include "LockTable.h"
+#include "LockWaits.h"
+#include "SegmentedArray.h"
+#include "SecondaryIndex.h"
+#include "ColumnStore.h"
+#include "DataFile.h"
+#include "VersionStore.h"
+#include <climits>
 #include <string>
 #include <vector>
 #include <memory>
-#include <shared_mutex>
-#include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <chrono>
+#ifdef __linux__
+#include "UringEngine.h"
+#endif
+
+class RecordShards;
+
+enum LockResult {
+    LOCK_OK,
+    LOCK_BUSY,
+    LOCK_NOT_FOUND
+};
+
+// When updates of a memory-mapped store reach the disk.
+enum SyncPolicy {
+    SYNC_PER_WRITE,
+    SYNC_PERIODIC,
+    SYNC_ON_SHUTDOWN
+};
 
 class RecordManager {
 public:
     RecordManager(const std::string& filename);
+    ~RecordManager();
     void initRecords();
+    bool importRecords(const std::string& source, ImportFormat format, unsigned nThreads = 0);
+    bool openExisting(unsigned nThreads = 0);
+    bool savePacked();
+    bool buildIndex(const Employee* data, size_t count, unsigned nThreads);
+    bool useMappedStorage(SyncPolicy policy, int periodMs = 1000);
+    bool enableWriteAheadLog(int checkpointMs = 1000);
+    bool useIoUring(bool linkedSync);
+    bool writeRecordAsync(const Employee& e, std::function<void(bool ok)> done);
+    Employee& recordAt(size_t idx);
     bool readRecordById(int id, Employee& out);           
     bool readRecordByIdNoLock(int id, Employee& out);   
+    LockResult readRecordOptimistic(int id, Employee& out);
     bool writeRecord(const Employee& e);
+    bool writeRecords(const std::vector<Employee>& batch);
+    bool createRecord(const Employee& e);
+    bool deleteRecord(int id);
+    void enableScanIndex();
+    void scanByName(const std::string& prefix, size_t limit, std::vector<Employee>& out);
+    void scanByHours(double lo, double hi, size_t limit, std::vector<Employee>& out);
+    void enableColumnStore();
+    HoursSummary hoursSummary();
+    size_t hoursInRange(double lo, double hi);
+    void hoursHistogram(double lo, double hi, std::vector<size_t>& buckets);
+    uint64_t openSnapshot();
+    void closeSnapshot(uint64_t ts);
+    bool readSnapshot(uint64_t ts, int id, Employee& out);
     bool lockRecord(int id, bool exclusive);
+    LockResult tryLockRecord(int id, bool exclusive);
     void unlockRecord(int id, bool exclusive);
+    void waitForLock(int id, bool exclusive, const void* owner, LockDeadline deadline, std::function<void()> wake);
+    bool lockAvailable(int id, bool exclusive);
+    bool writeLocked(int id);
+    bool useShards(size_t count);
 
 public:
     std::string filename;
-    std::vector<std::unique_ptr<std::shared_mutex>> recordLocks;
-    std::unordered_map<int, size_t> idToIndex;
-    std::mutex indexMutex;
-    std::vector<Employee> records;
+    LockTable recordLocks;
+    // Requests waiting for a lock without a thread; every unlock goes past it.
+    LockWaits lockWaits;
+    // Lookups are lock-free; see ConcurrentIndex.
+    ConcurrentIndex idToIndex;
+    SegmentedArray<Employee, 14> records;
+    // Slots of deleted records; guarded by createMutex.
+    std::vector<size_t> freeSlots;
+    std::mutex createMutex;
+    // Older images kept for open snapshots; every storeRecord goes through it.
+    VersionStore snapshots;
+
+    // Name and hours indexes for scans, maintained once enableScanIndex() has
+    // run. Without them a scan reads every record.
+    SecondaryIndex scanIndex;
+    std::atomic<bool> scanIndexed;
+    // Columnar copy of the records for aggregates, maintained once
+    // enableColumnStore() has run.
+    ColumnStore columns;
+    std::atomic<bool> columnar;
+
+    // The data file uses the packed layout (DataFile.h) rather than a raw
+    // Employee array; only the file stream backend writes it. packedCount is
+    // the record count in its header, blockLocks serialize rewrites of a block.
+    bool packedFile;
+    std::atomic<size_t> packedCount;
+    static const size_t BLOCK_LOCKS = 64;
+    std::mutex blockLocks[BLOCK_LOCKS];
+
+    // Mapped mode: records live only in the mapping and `records` stays empty.
+    std::unique_ptr<MappedFile> mapped;
+    SyncPolicy syncPolicy;
+    std::atomic<bool> dirty;
+    std::thread syncThread;
+    std::mutex syncMutex;
+    std::condition_variable syncCv;
+    bool syncStop;
+
+    // With a log, writeRecord returns once the update is durable in the WAL
+    // and the data file is brought up to date by checkpoints.
+    std::unique_ptr<WriteAheadLog> wal;
+#ifdef __linux__
+    // Stream mode only: file writes are submitted to io_uring instead of fstream.
+    std::unique_ptr<UringEngine> uring;
+#endif
+
+    // Sharded mode: the records live in the shards and every request is
+    // routed to the one owning its ID; this manager keeps only lockWaits.
+    std::unique_ptr<RecordShards> shards;
+    // In a shard: the data file slot of each of its slots, and the shared
+    // end of the file that appended records are placed at.
+    std::vector<size_t> fileSlots;
+    std::atomic<size_t>* fileEnd = nullptr;
 
     bool getIndexForId(int id, size_t &outIdx);
+    void loadRecord(size_t idx, Employee& out);
+    void storeRecord(size_t idx, const Employee& e);
+    bool persistRecord(size_t idx, const Employee& e);
+    bool persistBatch(const std::vector<size_t>& idx, const std::vector<Employee>& batch);
+    bool writePackedBlock(size_t idx);
+    size_t recordCount() const;
+    size_t fileSlot(size_t idx) const { return fileSlots.empty() ? idx : fileSlots[idx]; }
+    void reportOpen(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point readDone);
+    std::vector<Employee> liveRecords();
+    std::vector<double> hoursColumn();
+    void noteChange(size_t idx, const Employee& before, const Employee& after);
+    void collectScan(const std::function<void(size_t want, std::vector<int>& ids)>& lookup,
+                     const std::function<bool(const Employee&)>& matches,
+                     bool (*order)(const Employee&, const Employee&), size_t limit, std::vector<Employee>& out);
+    void syncLoop(int periodMs);
 };
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "RecordShards.h"
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Pins the calling thread to the k-th CPU it may run on; if that fails the
+// shard just runs unpinned.
+static void pinToCpu(size_t k) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) return;
+    size_t nth = k % static_cast<size_t>(CPU_COUNT(&allowed));
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        if (nth-- > 0) continue;
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+        return;
+    }
+#elif defined(_WIN32)
+    unsigned n = std::max(1u, std::thread::hardware_concurrency());
+    SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << (k % std::min(n, 64u)));
+#else
+    (void)k;
+#endif
+}
+
+RecordShards::RecordShards(const std::string& filename, size_t n, size_t fileSlots)
+    : filename(filename), count(n ? n : 1), fileEnd(fileSlots), stopping(false) {
+    shards.reset(new Shard[count]);
+    for (size_t k = 0; k < count; ++k) {
+        Shard& s = shards[k];
+        s.head.store(&s.stub);
+        s.tail = &s.stub;
+        s.manager.reset(new RecordManager(filename));
+        s.manager->fileEnd = &fileEnd;
+        s.thread = std::thread(&RecordShards::shardMain, this, k);
+    }
+}
+
+RecordShards::~RecordShards() {
+    stopping = true;
+    for (size_t k = 0; k < count; ++k) {
+        shards[k].pushed.fetch_add(1);
+        shards[k].pushed.notify_all();
+    }
+    for (size_t k = 0; k < count; ++k) {
+        shards[k].thread.join();
+    }
+}
+
+// Each shard indexes its part on its own thread, so its memory is first
+// touched by the CPU that will use it.
+bool RecordShards::load(std::vector<std::vector<Employee>>& parts, std::vector<std::vector<size_t>>& slots) {
+    std::unique_ptr<bool[]> ok(new bool[count]);
+    each([&](size_t k, RecordManager& m) {
+        m.fileSlots = std::move(slots[k]);
+        ok[k] = m.buildIndex(parts[k].data(), parts[k].size(), 1);
+        if (ok[k]) m.records = parts[k];
+        parts[k].clear();
+    });
+    for (size_t k = 0; k < count; ++k) {
+        if (!ok[k]) return false;
+    }
+    return true;
+}
+
+// Multi-producer single-consumer queue after Vyukov: a producer swaps itself
+// in as head and then links the previous head to it.
+void RecordShards::submit(ShardOp& op) {
+    Shard& s = shards[op.shard];
+    op.next.store(nullptr, std::memory_order_relaxed);
+    ShardOp* prev = s.head.exchange(&op, std::memory_order_acq_rel);
+    prev->next.store(&op, std::memory_order_release);
+    s.pushed.fetch_add(1, std::memory_order_release);
+    s.pushed.notify_one();
+}
+
+// Owner thread only. Returns nullptr when the queue is empty or a producer
+// is between its two steps; its pushed bump then wakes the owner again.
+ShardOp* RecordShards::pop(Shard& s) {
+    ShardOp* tail = s.tail;
+    ShardOp* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &s.stub) {
+        if (!next) return nullptr;
+        s.tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        s.tail = next;
+        return tail;
+    }
+    if (tail != s.head.load(std::memory_order_acquire)) return nullptr;
+    // tail is the last op: put the stub behind it so it can be handed out.
+    s.stub.next.store(nullptr, std::memory_order_relaxed);
+    ShardOp* prev = s.head.exchange(&s.stub, std::memory_order_acq_rel);
+    prev->next.store(&s.stub, std::memory_order_release);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        s.tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void RecordShards::waitFor(ShardOp& op) {
+    while (true) {
+        int state = op.done.load(std::memory_order_acquire);
+        if (state == 2) return;
+        if (state == 0) op.done.wait(0, std::memory_order_acquire);
+    }
+}
+
+void RecordShards::shardMain(size_t k) {
+    pinToCpu(k);
+    Shard& s = shards[k];
+    while (true) {
+        uint64_t seen = s.pushed.load(std::memory_order_acquire);
+        if (ShardOp* op = pop(s)) {
+            op->fn(*op, *s.manager);
+            op->done.store(1, std::memory_order_release);
+            op->done.notify_one();
+            op->done.store(2, std::memory_order_release);
+            continue;
+        }
+        if (stopping) return;
+        s.pushed.wait(seen, std::memory_order_acquire);
+    }
+}
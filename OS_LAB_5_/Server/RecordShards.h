@@ -0,0 +1,98 @@
+#pragma once
+#include "RecordManager.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A request handed to a shard: fn runs on the shard's thread with the
+// shard's RecordManager. It lives on the caller's stack until done reaches 2.
+struct ShardOp {
+    std::atomic<ShardOp*> next{nullptr};
+    void (*fn)(ShardOp& op, RecordManager& m) = nullptr;
+    void* ctx = nullptr;
+    size_t shard = 0;
+    // 0 queued, 1 finished but the caller may still be notified, 2 released.
+    std::atomic<int> done{0};
+};
+
+// Records partitioned by ID hash over shards that share nothing. Every shard
+// owns a RecordManager of its own (index, lock table, records) and a thread,
+// pinned to one CPU, which is the only one to touch it. Callers hand the
+// shard work through its lock-free queue and wait for the answer. The shards
+// keep writing the same data file, each only the slots it owns.
+class RecordShards {
+public:
+    RecordShards(const std::string& filename, size_t count, size_t fileSlots);
+    ~RecordShards();
+    RecordShards(const RecordShards&) = delete;
+    RecordShards& operator=(const RecordShards&) = delete;
+
+    size_t size() const { return count; }
+    // Fibonacci hash of the ID, scaled to the shard count by its top bits.
+    size_t shardOf(int id) const {
+        uint64_t h = (static_cast<uint32_t>(id) * 0x9E3779B97F4A7C15ull) >> 32;
+        return static_cast<size_t>((h * count) >> 32);
+    }
+
+    // Hands shard k the records in its part: images (free ones included) and
+    // the data file slot each of them lives in.
+    bool load(std::vector<std::vector<Employee>>& parts, std::vector<std::vector<size_t>>& slots);
+
+    // Runs fn(RecordManager&) on the shard owning id and waits for it.
+    template <typename F>
+    void run(int id, F&& fn) {
+        using Fn = std::remove_reference_t<F>;
+        ShardOp op;
+        op.ctx = &fn;
+        op.fn = [](ShardOp& o, RecordManager& m) { (*static_cast<Fn*>(o.ctx))(m); };
+        op.shard = shardOf(id);
+        submit(op);
+        waitFor(op);
+    }
+
+    // Runs fn(k, RecordManager&) on every shard k at once and waits for all.
+    template <typename F>
+    void each(F&& fn) {
+        using Fn = std::remove_reference_t<F>;
+        std::unique_ptr<ShardOp[]> ops(new ShardOp[count]);
+        for (size_t k = 0; k < count; ++k) {
+            ops[k].ctx = &fn;
+            ops[k].fn = [](ShardOp& o, RecordManager& m) { (*static_cast<Fn*>(o.ctx))(o.shard, m); };
+            ops[k].shard = k;
+            submit(ops[k]);
+        }
+        for (size_t k = 0; k < count; ++k) {
+            waitFor(ops[k]);
+        }
+    }
+
+public:
+    // One per cache line pair: producers only touch head and pushed, the
+    // owning thread the rest.
+    struct alignas(64) Shard {
+        std::atomic<ShardOp*> head;
+        // Bumped after every push; the owner sleeps on it when idle.
+        std::atomic<uint64_t> pushed{0};
+        alignas(64) ShardOp* tail;
+        ShardOp stub;
+        std::unique_ptr<RecordManager> manager;
+        std::thread thread;
+    };
+
+    std::string filename;
+    size_t count;
+    std::unique_ptr<Shard[]> shards;
+    // The data file slot the next appended record gets, whichever shard adds it.
+    std::atomic<size_t> fileEnd;
+    std::atomic<bool> stopping;
+
+    void submit(ShardOp& op);
+    ShardOp* pop(Shard& s);
+    static void waitFor(ShardOp& op);
+    void shardMain(size_t k);
+};
@@ -0,0 +1,86 @@
+#include "SecondaryIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+std::string SecondaryIndex::nameOf(const Employee& e) {
+    return std::string(e.name, strnlen(e.name, NAME_SIZE));
+}
+
+void SecondaryIndex::rebuild(const std::vector<Employee>& live) {
+    std::vector<std::pair<std::string, int>> names;
+    std::vector<std::pair<double, int>> hours;
+    names.reserve(live.size());
+    hours.reserve(live.size());
+    for (const Employee& e : live) {
+        names.emplace_back(nameOf(e), e.num);
+        if (!std::isnan(e.hours)) hours.emplace_back(e.hours, e.num);
+    }
+    std::sort(names.begin(), names.end());
+    std::sort(hours.begin(), hours.end());
+
+    std::set<std::pair<std::string, int>> nameSet(names.begin(), names.end());
+    std::set<std::pair<double, int>> hoursSet(hours.begin(), hours.end());
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    byName.swap(nameSet);
+    byHours.swap(hoursSet);
+}
+
+void SecondaryIndex::insert(const Employee& e) {
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    byName.emplace(nameOf(e), e.num);
+    if (!std::isnan(e.hours)) byHours.emplace(e.hours, e.num);
+}
+
+void SecondaryIndex::erase(const Employee& e) {
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    byName.erase({nameOf(e), e.num});
+    byHours.erase({e.hours, e.num});
+}
+
+void SecondaryIndex::update(const Employee& before, const Employee& after) {
+    std::string oldName = nameOf(before);
+    std::string newName = nameOf(after);
+    bool sameHours = before.hours == after.hours || (std::isnan(before.hours) && std::isnan(after.hours));
+    if (before.num == after.num && oldName == newName && sameHours) return;
+
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    byName.erase({oldName, before.num});
+    byName.emplace(newName, after.num);
+    byHours.erase({before.hours, before.num});
+    if (!std::isnan(after.hours)) byHours.emplace(after.hours, after.num);
+}
+
+void SecondaryIndex::clear() {
+    std::unique_lock<std::shared_mutex> lk(mutex);
+    byName.clear();
+    byHours.clear();
+}
+
+size_t SecondaryIndex::size() const {
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    return byName.size();
+}
+
+void SecondaryIndex::scanNamePrefix(const std::string& prefix, size_t limit, std::vector<int>& ids) const {
+    ids.clear();
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    for (auto it = byName.lower_bound({prefix, std::numeric_limits<int>::min()}); it != byName.end(); ++it) {
+        if (it->first.compare(0, prefix.size(), prefix) != 0) break;
+        if (limit && ids.size() >= limit) break;
+        ids.push_back(it->second);
+    }
+}
+
+void SecondaryIndex::scanHours(double lo, double hi, size_t limit, std::vector<int>& ids) const {
+    ids.clear();
+    if (!(lo <= hi)) return;
+    std::shared_lock<std::shared_mutex> lk(mutex);
+    for (auto it = byHours.lower_bound({lo, std::numeric_limits<int>::min()}); it != byHours.end(); ++it) {
+        if (it->first > hi) break;
+        if (limit && ids.size() >= limit) break;
+        ids.push_back(it->second);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "../common/Employee.h"
+#include <cstddef>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Ordered indexes on Employee::name and Employee::hours. Entries are
+// (key, ID) pairs, so equal keys come back in ID order. Scans collect IDs
+// under a shared lock and return; the records themselves are read afterwards,
+// so callers check that a record still matches before using it.
+class SecondaryIndex {
+public:
+    // Replaces the contents with the given records, sorted once and loaded
+    // in linear time.
+    void rebuild(const std::vector<Employee>& live);
+    void insert(const Employee& e);
+    void erase(const Employee& e);
+    // Moves the entries of a record whose name or hours changed.
+    void update(const Employee& before, const Employee& after);
+    void clear();
+    size_t size() const;
+
+    // limit 0 means no limit.
+    void scanNamePrefix(const std::string& prefix, size_t limit, std::vector<int>& ids) const;
+    // Both bounds are inclusive.
+    void scanHours(double lo, double hi, size_t limit, std::vector<int>& ids) const;
+
+    static std::string nameOf(const Employee& e);
+
+public:
+    std::set<std::pair<std::string, int>> byName;
+    // NaN hours match no range and are left out.
+    std::set<std::pair<double, int>> byHours;
+    mutable std::shared_mutex mutex;
+};
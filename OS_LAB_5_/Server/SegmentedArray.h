@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Array that grows without moving its elements: storage is a list of
+// fixed-size segments reached through a directory of atomic pointers, so
+// operator[] stays valid and lock-free while another thread appends. Growing
+// is serialized internally; a full directory is copied into one twice as
+// large and the old one is retired until clear() or destruction.
+template <typename T, size_t SEGMENT_BITS = 12>
+class SegmentedArray {
+public:
+    static const size_t SEGMENT_SIZE = size_t(1) << SEGMENT_BITS;
+
+    SegmentedArray() : dir(nullptr), dirCapacity(0), allocated(0), length(0) {}
+    SegmentedArray(const SegmentedArray&) = delete;
+    SegmentedArray& operator=(const SegmentedArray&) = delete;
+    ~SegmentedArray() { clear(); }
+
+    SegmentedArray& operator=(const std::vector<T>& items) {
+        clear();
+        resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            (*this)[i] = items[i];
+        }
+        return *this;
+    }
+
+    T& operator[](size_t i) const {
+        std::atomic<T*>* d = dir.load(std::memory_order_acquire);
+        return d[i >> SEGMENT_BITS].load(std::memory_order_acquire)[i & (SEGMENT_SIZE - 1)];
+    }
+
+    size_t size() const { return length.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+    // New elements are value-initialized and become visible through size()
+    // only after they are addressable. Shrinking keeps the storage.
+    void resize(size_t n) {
+        std::lock_guard<std::mutex> lk(growMutex);
+        reserveLocked(n);
+        length.store(n, std::memory_order_release);
+    }
+
+    size_t push_back(const T& item) {
+        std::lock_guard<std::mutex> lk(growMutex);
+        size_t idx = length.load(std::memory_order_relaxed);
+        reserveLocked(idx + 1);
+        (*this)[idx] = item;
+        length.store(idx + 1, std::memory_order_release);
+        return idx;
+    }
+
+    std::vector<T> toVector() const {
+        std::vector<T> out(size());
+        for (size_t i = 0; i < out.size(); ++i) {
+            out[i] = (*this)[i];
+        }
+        return out;
+    }
+
+    // Not safe while other threads use the array.
+    void clear() {
+        if (!dirs.empty()) {
+            std::atomic<T*>* d = dirs.back().get();
+            for (size_t s = 0; s < allocated; ++s) {
+                delete[] d[s].load(std::memory_order_relaxed);
+            }
+        }
+        dirs.clear();
+        dir.store(nullptr, std::memory_order_release);
+        dirCapacity = 0;
+        allocated = 0;
+        length.store(0, std::memory_order_release);
+    }
+
+public:
+    std::atomic<std::atomic<T*>*> dir;
+    std::vector<std::unique_ptr<std::atomic<T*>[]>> dirs;
+    size_t dirCapacity;
+    size_t allocated;
+    std::atomic<size_t> length;
+    std::mutex growMutex;
+
+    void reserveLocked(size_t n) {
+        size_t segments = (n + SEGMENT_SIZE - 1) >> SEGMENT_BITS;
+        if (segments == 0) return;
+        if (segments > dirCapacity) {
+            size_t capacity = dirCapacity ? dirCapacity : 4;
+            while (capacity < segments) capacity *= 2;
+            std::unique_ptr<std::atomic<T*>[]> grown(new std::atomic<T*>[capacity]);
+            for (size_t i = 0; i < capacity; ++i) {
+                grown[i].store(i < dirCapacity ? dirs.back()[i].load(std::memory_order_relaxed) : nullptr,
+                               std::memory_order_relaxed);
+            }
+            dir.store(grown.get(), std::memory_order_release);
+            dirs.push_back(std::move(grown));
+            dirCapacity = capacity;
+        }
+        std::atomic<T*>* d = dirs.back().get();
+        for (; allocated < segments; ++allocated) {
+            d[allocated].store(new T[SEGMENT_SIZE](), std::memory_order_release);
+        }
+    }
+};
@@ -6,12 +6,16 @@
 #include <atomic>
 #include <cstring>
 #include <limits> 
-
-void SendResponse(HANDLE hPipe, const Message& resp) {
-    DWORD bytesTransferred;
-    WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-    FlushFileBuffers(hPipe); 
-}
+#include <chrono>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef __linux__
+#include "CoroutineServer.h"
+#include "EpollServer.h"
+#include "SocketListener.h"
+#endif
 
 ServerApp::ServerApp() {
     std::string fname;
@@ -24,137 +28,547 @@ ServerApp::ServerApp() {
     manager->initRecords();
 }
 
-void ServerApp::clientHandler(HANDLE hPipe) {
-    Message msg;
-    DWORD bytesTransferred = 0;
-    std::map<int, bool> heldLocks;
+ServerApp::ServerApp(RecordManager* manager) : manager(manager) {}
 
-    while (true) {
-        BOOL ok = ReadFile(hPipe, &msg, sizeof(msg), &bytesTransferred, nullptr);
-        
-        if (!ok || bytesTransferred == 0) {
-            DWORD err = GetLastError();
-            break;
-        }
-
-        Message resp;
-        std::memset(&resp, 0, sizeof(resp));
-
-        if (msg.type == READ_LOCK) {
-            if (manager->lockRecord(msg.id, false)) {
-                Employee e;
-                bool found = manager->readRecordById(msg.id, e);
-                
-                if (found) {
-                    resp.type = READ_LOCK;
-                    resp.id = msg.id;
-                    resp.emp = e;
-                    
-                    if (!WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr)) {
-                        manager->unlockRecord(msg.id, false);
-                        break;
-                    }
-                    heldLocks[msg.id] = false;
-                } else {
-                    resp.type = READ_LOCK;
-                    resp.id = -1;
-                    WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-                    manager->unlockRecord(msg.id, false);
-                }
-            } else {
-                resp.type = READ_LOCK;
-                resp.id = -1;
-                WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-            }
+// With onComplete set, a WRITE_UPDATE whose disk write runs asynchronously
+// returns REQUEST_PENDING and its response is delivered through the callback.
+// With runWrite set as well, a WRITE_UPDATE without an asynchronous engine and
+// a TXN_COMMIT that took its locks hand their disk writes to it the same way.
+RequestStatus ServerApp::processRequest(Session& session, const Message& msg, Message& resp, bool mayBlock,
+                                        const CompletionCallback& onComplete, const WriteRunner& runWrite) {
+    std::memset(&resp, 0, sizeof(resp));
+    resp.type = msg.type;
+    resp.reqId = msg.reqId;
+
+    if (msg.type == READ_LOCK) {
+        bool locked;
+        if (mayBlock) {
+            locked = manager->lockRecord(msg.id, false);
+        } else {
+            LockResult r = manager->tryLockRecord(msg.id, false);
+            if (r == LOCK_BUSY) return REQUEST_BLOCKED;
+            locked = r == LOCK_OK;
         }
-        else if (msg.type == WRITE_LOCK) {
-            if (lockedRecords[msg.id]) {
-         
-                resp.type = WRITE_LOCK;
-                resp.id = -1; 
-                WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-                continue; 
-            }
 
-            Employee e;
-            bool found = manager->readRecordByIdNoLock(msg.id, e);
-            
-            if (!found) {
-                resp.type = WRITE_LOCK;
-                resp.id = -1;
-                WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-                continue;
-            }
-            
-            if (manager->lockRecord(msg.id, true)) {
-                lockedRecords[msg.id] = true; 
-                resp.type = WRITE_LOCK;
-                resp.id = msg.id;
-                resp.emp = e;
-                
-                if (!WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr)) {
-                    manager->unlockRecord(msg.id, true);
-                    break;
-                }
-                heldLocks[msg.id] = true;
-            } else {
-                resp.type = WRITE_LOCK;
-                resp.id = -1;
-                WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-            }
+        Employee e;
+        if (locked && manager->readRecordById(msg.id, e)) {
+            resp.id = msg.id;
+            resp.emp = e;
+            session.heldLocks[msg.id] = false;
+        } else {
+            if (locked) manager->unlockRecord(msg.id, false);
+            resp.id = -1;
         }
-        else if (msg.type == WRITE_UPDATE) {
-            auto lockIt = heldLocks.find(msg.id);
-            if (lockIt == heldLocks.end() || !lockIt->second) {
-                resp.type = WRITE_UPDATE;
-                resp.id = -1;
-                WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-                continue;
-            }
-    
-            bool success = manager->writeRecord(msg.emp);
-            resp.type = WRITE_UPDATE;
-            resp.id = success ? msg.id : -1;
-            WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-        }
-        else if (msg.type == UNLOCK) {
-            auto it = heldLocks.find(msg.id);
-            if (it != heldLocks.end()) {
-                manager->unlockRecord(msg.id, it->second);
-                heldLocks.erase(it);
-                lockedRecords[msg.id] = false; 
+    }
+    else if (msg.type == READ_OPTIMISTIC || msg.type == READ_CACHED) {
+        // A lease on a record that turns out to be missing just lapses with
+        // its next change, if any.
+        if (msg.type == READ_CACHED && session.leases) leases.grant(msg.id, session.leases);
+        LockResult r = manager->readRecordOptimistic(msg.id, resp.emp);
+        if (r == LOCK_BUSY) {
+            // The record is being rewritten right now: read it under the
+            // shared lock instead and release that at once.
+            if (mayBlock) {
+                r = manager->lockRecord(msg.id, false) ? LOCK_OK : LOCK_NOT_FOUND;
             } else {
-                manager->unlockRecord(msg.id, true);
+                r = manager->tryLockRecord(msg.id, false);
+                if (r == LOCK_BUSY) return REQUEST_BLOCKED;
+            }
+            if (r == LOCK_OK) {
+                if (!manager->readRecordById(msg.id, resp.emp)) r = LOCK_NOT_FOUND;
                 manager->unlockRecord(msg.id, false);
-                lockedRecords[msg.id] = false; 
             }
-            
-            resp.type = UNLOCK;
+        }
+        resp.id = r == LOCK_OK ? msg.id : -1;
+    }
+    else if (msg.type == WRITE_LOCK) {
+        if (manager->writeLocked(msg.id)) {
+            resp.id = -1;
+            return REQUEST_DONE;
+        }
+
+        bool locked;
+        if (mayBlock) {
+            locked = manager->lockRecord(msg.id, true);
+        } else {
+            LockResult r = manager->tryLockRecord(msg.id, true);
+            if (r == LOCK_BUSY) return REQUEST_BLOCKED;
+            locked = r == LOCK_OK;
+        }
+
+        Employee e;
+        if (locked && manager->readRecordById(msg.id, e)) {
             resp.id = msg.id;
-            WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
+            resp.emp = e;
+            session.heldLocks[msg.id] = true;
+        } else {
+            if (locked) manager->unlockRecord(msg.id, true);
+            resp.id = -1;
+        }
+    }
+    else if (msg.type == WRITE_UPDATE) {
+        auto lockIt = session.heldLocks.find(msg.id);
+        if (lockIt == session.heldLocks.end() || !lockIt->second) {
+            resp.id = -1;
+            return REQUEST_DONE;
+        }
+
+        if (onComplete) {
+            Message done = resp;
+            int id = msg.id;
+            auto written = [this, done, id, onComplete](bool ok) mutable {
+                leases.revoke(id);
+                done.id = ok ? id : -1;
+                onComplete(done);
+            };
+            if (manager->writeRecordAsync(msg.emp, written)) return REQUEST_PENDING;
+            if (runWrite) {
+                Employee emp = msg.emp;
+                runWrite([this, emp, written]() mutable { written(manager->writeRecord(emp)); });
+                return REQUEST_PENDING;
+            }
+        }
+
+        bool success = manager->writeRecord(msg.emp);
+        // The image in memory changes even if the disk write fails.
+        leases.revoke(msg.id);
+        resp.id = success ? msg.id : -1;
+    }
+    else if (msg.type == CREATE_RECORD) {
+        resp.id = manager->createRecord(msg.emp) ? msg.emp.num : -1;
+    }
+    else if (msg.type == DELETE_RECORD) {
+        auto lockIt = session.heldLocks.find(msg.id);
+        if (lockIt == session.heldLocks.end() || !lockIt->second || !manager->deleteRecord(msg.id)) {
+            resp.id = -1;
+            return REQUEST_DONE;
         }
-        else if (msg.type == CLIENT_EXIT) {
-            resp.type = CLIENT_EXIT;
-            resp.id = 0;
-            WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
-            break;
+        session.heldLocks.erase(lockIt);
+        leases.revoke(msg.id);
+        resp.id = msg.id;
+    }
+    else if (msg.type == UNLOCK) {
+        // Locks have no owner in the lock table, so only the session's own
+        // may be released here.
+        auto it = session.heldLocks.find(msg.id);
+        if (it == session.heldLocks.end()) {
+            resp.id = -1;
+            return REQUEST_DONE;
         }
-        else {
-            resp.type = 0;
+        manager->unlockRecord(msg.id, it->second);
+        session.heldLocks.erase(it);
+        resp.id = msg.id;
+    }
+    else if (msg.type == SCAN) {
+        scan(session, msg, resp);
+    }
+    else if (msg.type == AGGREGATE) {
+        aggregate(session, msg, resp);
+    }
+    else if (msg.type == SNAPSHOT_OPEN) {
+        if (manager->shards) {
             resp.id = -1;
-            WriteFile(hPipe, &resp, sizeof(Message), &bytesTransferred, nullptr);
+            return REQUEST_DONE;
+        }
+        resp.id = session.nextSnapshot++;
+        session.snapshots[resp.id] = manager->openSnapshot();
+    }
+    else if (msg.type == SNAPSHOT_READ) {
+        auto it = session.snapshots.find(msg.emp.num);
+        bool found = it != session.snapshots.end() && manager->readSnapshot(it->second, msg.id, resp.emp);
+        resp.id = found ? msg.id : -1;
+    }
+    else if (msg.type == SNAPSHOT_CLOSE) {
+        auto it = session.snapshots.find(msg.id);
+        if (it == session.snapshots.end()) {
+            resp.id = -1;
+            return REQUEST_DONE;
+        }
+        manager->closeSnapshot(it->second);
+        session.snapshots.erase(it);
+        resp.id = msg.id;
+    }
+    else if (msg.type == TXN_ITEM) {
+        if (session.txn.size() <= static_cast<size_t>(MAX_TXN_RECORDS)) session.txn.push_back(msg.emp);
+        return REQUEST_SILENT;
+    }
+    else if (msg.type == TXN_COMMIT) {
+        return commit(session, msg, resp, mayBlock, onComplete, runWrite);
+    }
+    else if (msg.type == CLIENT_EXIT) {
+        resp.id = 0;
+        return REQUEST_CLOSE;
+    }
+    else {
+        resp.type = 0;
+        resp.id = -1;
+    }
+    return REQUEST_DONE;
+}
+
+// Records are read without locks, like READ_OPTIMISTIC, so a scan never
+// waits for a writer.
+void ServerApp::scan(Session& session, const Message& msg, Message& resp) {
+    resp.type = SCAN_END;
+    size_t limit = msg.emp.num > 0 ? static_cast<size_t>(msg.emp.num) : 0;
+    std::vector<Employee> found;
+    if (msg.id == SCAN_NAME_PREFIX) {
+        manager->scanByName(SecondaryIndex::nameOf(msg.emp), limit, found);
+    }
+    else if (msg.id == SCAN_HOURS_RANGE) {
+        manager->scanByHours(msg.emp.hours, upperBound(msg), limit, found);
+    }
+    else {
+        resp.id = -1;
+        return;
+    }
+
+    Message row = resp;
+    row.type = SCAN;
+    for (const Employee& e : found) {
+        row.id = e.num;
+        row.emp = e;
+        session.streamed.push_back(row);
+    }
+    resp.id = static_cast<int>(found.size());
+}
+
+void ServerApp::aggregate(Session& session, const Message& msg, Message& resp) {
+    resp.id = -1;
+    if (msg.id == AGG_SUM || msg.id == AGG_MIN || msg.id == AGG_MAX) {
+        HoursSummary s = manager->hoursSummary();
+        resp.id = static_cast<int>(s.count);
+        resp.emp.hours = msg.id == AGG_SUM ? s.sum : (msg.id == AGG_MIN ? s.min : s.max);
+    }
+    else if (msg.id == AGG_COUNT_IN_RANGE) {
+        resp.id = static_cast<int>(manager->hoursInRange(msg.emp.hours, upperBound(msg)));
+    }
+    else if (msg.id == AGG_HISTOGRAM && msg.emp.num > 0 && msg.emp.num <= MAX_HISTOGRAM_BUCKETS) {
+        double lo = msg.emp.hours;
+        double hi = upperBound(msg);
+        std::vector<size_t> buckets(static_cast<size_t>(msg.emp.num));
+        manager->hoursHistogram(lo, hi, buckets);
+
+        Message row = resp;
+        row.type = HISTOGRAM_BUCKET;
+        size_t total = 0;
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            row.id = static_cast<int>(i);
+            row.emp.num = static_cast<int>(buckets[i]);
+            row.emp.hours = lo + (hi - lo) * static_cast<double>(i) / static_cast<double>(buckets.size());
+            session.streamed.push_back(row);
+            total += buckets[i];
         }
+        resp.id = static_cast<int>(total);
+    }
+}
+
+// Records are locked in ascending ID order, so two commits never wait for
+// each other in a cycle. Without mayBlock a locked record makes the commit
+// release what it took and report REQUEST_BLOCKED; the collected records stay
+// for the retry.
+// The records stay locked until the write is done, wherever it runs.
+RequestStatus ServerApp::commit(Session& session, const Message& msg, Message& resp, bool mayBlock,
+                                const CompletionCallback& onComplete, const WriteRunner& runWrite) {
+    std::vector<Employee>& items = session.txn;
+    std::sort(items.begin(), items.end(), [](const Employee& a, const Employee& b) { return a.num < b.num; });
+    bool valid = !items.empty() && msg.id == static_cast<int>(items.size()) &&
+                 items.size() <= static_cast<size_t>(MAX_TXN_RECORDS);
+    for (size_t i = 0; valid && i < items.size(); ++i) {
+        if ((i > 0 && items[i].num == items[i - 1].num) || session.heldLocks.count(items[i].num)) valid = false;
+    }
+    resp.id = -1;
+    if (!valid) {
+        items.clear();
+        return REQUEST_DONE;
+    }
+
+    size_t taken = 0;
+    bool found = true;
+    for (; taken < items.size(); ++taken) {
+        int id = items[taken].num;
+        LockResult r = mayBlock ? (manager->lockRecord(id, true) ? LOCK_OK : LOCK_NOT_FOUND)
+                                : manager->tryLockRecord(id, true);
+        if (r == LOCK_OK) continue;
+        if (r == LOCK_BUSY) {
+            session.txnBusy = id;
+            for (size_t i = 0; i < taken; ++i) manager->unlockRecord(items[i].num, true);
+            return REQUEST_BLOCKED;
+        }
+        found = false;
+        break;
+    }
+
+    if (found && onComplete && runWrite) {
+        std::vector<Employee> batch = std::move(items);
+        items.clear();
+        Message done = resp;
+        int count = msg.id;
+        runWrite([this, batch, done, count, onComplete]() mutable {
+            if (manager->writeRecords(batch)) done.id = count;
+            for (const Employee& e : batch) leases.revoke(e.num);
+            for (const Employee& e : batch) manager->unlockRecord(e.num, true);
+            onComplete(done);
+        });
+        return REQUEST_PENDING;
+    }
+
+    if (found && manager->writeRecords(items)) resp.id = msg.id;
+    if (found) {
+        for (const Employee& e : items) leases.revoke(e.num);
+    }
+    for (size_t i = 0; i < taken; ++i) manager->unlockRecord(items[i].num, true);
+    items.clear();
+    return REQUEST_DONE;
+}
+
+bool ServerApp::deliver(Transport& conn, Session& session, const Message& resp) {
+    bool ok = true;
+    for (const Message& row : session.streamed) {
+        if (ok) ok = conn.sendMessage(row);
     }
+    session.streamed.clear();
+    return ok && conn.sendMessage(resp);
+}
 
-    for (auto& p : heldLocks) {
+bool ServerApp::deliver(SessionPipeline& state, Session& session, const Message& resp) {
+    std::lock_guard<std::mutex> lk(state.sendMutex);
+    return deliver(*state.conn, session, resp);
+}
+
+void ServerApp::endSession(Session& session) {
+    if (session.leases) leases.release(session.leases);
+    for (auto& s : session.snapshots) {
+        manager->closeSnapshot(s.second);
+    }
+    session.snapshots.clear();
+    session.txn.clear();
+    for (auto& p : session.heldLocks) {
         try {
             manager->unlockRecord(p.first, p.second);
         } catch (...) {}
     }
+    session.heldLocks.clear();
+}
+
+bool ServerApp::ordersBehindPending(const Session& session, const Message& msg) {
+    if (msg.type == CLIENT_EXIT) return false;
+    // Scans and aggregates take no locks, and their id is not a record.
+    if (msg.type == SCAN || msg.type == AGGREGATE) return false;
+    // Snapshot requests never wait for a record lock either.
+    if (msg.type == SNAPSHOT_OPEN || msg.type == SNAPSHOT_READ || msg.type == SNAPSHOT_CLOSE) return false;
+    // Transaction messages queue behind a blocked commit by orderKey().
+    if (msg.type == TXN_ITEM || msg.type == TXN_COMMIT) return true;
+    // Releasing a lock the session already holds never depends on a queued
+    // request; letting it through is what allows a blocked upgrade to finish.
+    if (msg.type == UNLOCK && session.heldLocks.count(msg.id)) return false;
+    return true;
+}
+
+// Requests with one key run in arrival order. The records of a transaction
+// are in emp, not id, so all its messages share a key no record ID can have.
+int ServerApp::orderKey(const Message& msg) {
+    if (msg.type == TXN_ITEM || msg.type == TXN_COMMIT) return FREE_RECORD_ID;
+    return msg.id;
+}
+
+LockDeadline ServerApp::lockDeadline() const {
+    if (lockTimeoutMs <= 0) return NO_LOCK_DEADLINE;
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(lockTimeoutMs);
+}
+
+// Queues wake for the record a request that returned REQUEST_BLOCKED is
+// waiting for: the one a commit found busy, else the request's own id.
+void ServerApp::waitForLock(const Session& session, const Message& msg, const void* owner, LockDeadline deadline,
+                            std::function<void()> wake) {
+    int id = msg.type == TXN_COMMIT ? session.txnBusy : msg.id;
+    bool exclusive = msg.type == WRITE_LOCK || msg.type == TXN_COMMIT;
+    manager->waitForLock(id, exclusive, owner, deadline, std::move(wake));
+}
+
+void ServerApp::lockTimedOut(Session& session, const Message& msg, Message& resp) {
+    std::memset(&resp, 0, sizeof(resp));
+    resp.type = LOCK_TIMEOUT;
+    resp.id = msg.id;
+    resp.reqId = msg.reqId;
+    if (msg.type == TXN_COMMIT) session.txn.clear();
+}
+
+void ServerApp::clientHandler(Transport& conn) {
+    Session session;
+    serveSession(conn, session);
+    conn.close();
+}
+
+void ServerApp::serveSession(Transport& conn, Session& session) {
+    auto state = std::make_shared<SessionPipeline>();
+    state->session = std::move(session);
+    state->conn = &conn;
+    SessionPipeline* target = state.get();
+    leases.attach(state->session.leases, [target](const Message& msg) {
+        std::lock_guard<std::mutex> lk(target->sendMutex);
+        target->conn->sendMessage(msg);
+    });
+
+    Message msg;
+    while (conn.recvMessage(msg)) {
+        if (pool) {
+            if (!submitRequest(state, msg)) break;
+            continue;
+        }
+        std::lock_guard<std::mutex> lk(state->mutex);
+        if (!handleRequest(state, msg)) break;
+    }
+
+    std::unique_lock<std::mutex> lk(state->mutex);
+    state->idle.wait(lk, [&]() { return state->tasks == 0; });
+    state->closed = true;
+    state->waiting.clear();
+    endSession(state->session);
+    lk.unlock();
+
+    {
+        std::lock_guard<std::mutex> resumeLk(state->resumeMutex);
+        state->resumeStopped = true;
+    }
+    state->resumable.notify_all();
+    if (state->resumer.joinable()) state->resumer.join();
+}
+
+// Called with state->mutex held. Returns false once the session is over.
+bool ServerApp::handleRequest(const std::shared_ptr<SessionPipeline>& state, const Message& msg) {
+    int key = orderKey(msg);
+    auto queued = state->waiting.find(key);
+    if (queued != state->waiting.end() && ordersBehindPending(state->session, msg)) {
+        queued->second.push_back({msg, lockDeadline(), false});
+        return true;
+    }
+
+    Message resp;
+    RequestStatus status = processRequest(state->session, msg, resp, false);
+    if (status == REQUEST_BLOCKED) {
+        std::deque<ParkedRequest>& queue = state->waiting[key];
+        queue.push_back({msg, lockDeadline(), false});
+        parkWaiting(state, key, queue.back());
+        return true;
+    }
+    if (status == REQUEST_SILENT) return true;
+    return deliver(*state, state->session, resp) && status != REQUEST_CLOSE;
+}
+
+// Runs on the connection thread. SCAN and AGGREGATE become tasks of their
+// own; every other request joins the inbox. Returns false once there is no
+// point reading more.
+bool ServerApp::submitRequest(const std::shared_ptr<SessionPipeline>& state, const Message& msg) {
+    std::lock_guard<std::mutex> lk(state->mutex);
+    if (state->stopped) return false;
+    if (msg.type == SCAN || msg.type == AGGREGATE) {
+        state->tasks++;
+        pool->submit([this, state, msg]() { runDetached(state, msg); });
+        return true;
+    }
+    state->inbox.push_back(msg);
+    if (!state->draining) {
+        state->draining = true;
+        state->tasks++;
+        pool->submit([this, state]() { drainInbox(state); });
+    }
+    return msg.type != CLIENT_EXIT;
+}
+
+void ServerApp::drainInbox(std::shared_ptr<SessionPipeline> state) {
+    std::lock_guard<std::mutex> lk(state->mutex);
+    while (!state->inbox.empty()) {
+        Message msg = state->inbox.front();
+        state->inbox.pop_front();
+        if (!state->stopped && !handleRequest(state, msg)) state->stopped = true;
+    }
+    state->draining = false;
+    if (--state->tasks == 0) state->idle.notify_all();
+}
+
+// SCAN and AGGREGATE take no locks and touch no session state but the rows
+// they stream, so they run without the session mutex, alongside the
+// session's other requests.
+void ServerApp::runDetached(std::shared_ptr<SessionPipeline> state, const Message& msg) {
+    Session scratch;
+    Message resp;
+    processRequest(scratch, msg, resp, false);
+
+    std::lock_guard<std::mutex> lk(state->mutex);
+    if (!deliver(*state, scratch, resp)) state->stopped = true;
+    if (--state->tasks == 0) state->idle.notify_all();
+}
+
+// Called with state->mutex held. The wake-up runs on the lock waits' notifier
+// thread, never inside this call.
+void ServerApp::parkWaiting(std::shared_ptr<SessionPipeline> state, int key, ParkedRequest& parked) {
+    parked.registered = true;
+    activeWaiters++;
+    waitForLock(state->session, parked.msg, state.get(), parked.deadline,
+                [this, state, key]() { wakeWaiting(state, key); });
+}
+
+// Runs on the notifier thread, which every session shares: resuming may wait
+// for state->mutex or a slow client's socket, so it happens elsewhere.
+void ServerApp::wakeWaiting(std::shared_ptr<SessionPipeline> state, int key) {
+    if (pool) {
+        pool->submit([this, state, key]() { resumeWaiting(state, key); });
+        return;
+    }
+    std::lock_guard<std::mutex> lk(state->resumeMutex);
+    if (state->resumeStopped) {
+        activeWaiters--;
+        return;
+    }
+    state->resumes.push_back(key);
+    if (!state->resumer.joinable()) state->resumer = std::thread(&ServerApp::resumeLoop, this, state);
+    state->resumable.notify_one();
+}
+
+// The session's resumer thread. It leaves once the session is over and every
+// key woken before that has been resumed.
+void ServerApp::resumeLoop(std::shared_ptr<SessionPipeline> state) {
+    std::unique_lock<std::mutex> lk(state->resumeMutex);
+    while (true) {
+        state->resumable.wait(lk, [&]() { return !state->resumes.empty() || state->resumeStopped; });
+        if (state->resumes.empty()) return;
+        int key = state->resumes.front();
+        state->resumes.pop_front();
+        lk.unlock();
+        resumeWaiting(state, key);
+        lk.lock();
+    }
+}
 
-    FlushFileBuffers(hPipe);
-    DisconnectNamedPipe(hPipe);
-    CloseHandle(hPipe);
+// Runs the requests queued under key in order until one is still blocked,
+// which is parked again unless its deadline has passed.
+void ServerApp::resumeWaiting(std::shared_ptr<SessionPipeline> state, int key) {
+    {
+        std::lock_guard<std::mutex> lk(state->mutex);
+        auto it = state->waiting.find(key);
+        if (!state->closed && it != state->waiting.end()) {
+            std::deque<ParkedRequest>& queue = it->second;
+            if (!queue.empty()) queue.front().registered = false;
+            while (!queue.empty()) {
+                ParkedRequest& head = queue.front();
+                Message resp;
+                RequestStatus status = processRequest(state->session, head.msg, resp, false);
+                if (status == REQUEST_BLOCKED) {
+                    if (std::chrono::steady_clock::now() < head.deadline) {
+                        if (!head.registered) parkWaiting(state, key, head);
+                        break;
+                    }
+                    lockTimedOut(state->session, head.msg, resp);
+                    status = REQUEST_DONE;
+                }
+                queue.pop_front();
+                if (status != REQUEST_SILENT) deliver(*state, state->session, resp);
+            }
+            if (queue.empty()) state->waiting.erase(it);
+        }
+    }
+    activeWaiters--;
 }
 
 void ServerApp::run() {
@@ -162,34 +576,41 @@ void ServerApp::run() {
     std::cout << "How many clients to run: ";
     std::cin >> nClients;
 
-    std::vector<std::thread> threads;
-    std::vector<HANDLE> pipeHandles;
+#ifdef __linux__
+    SocketListener listener(DEFAULT_ENDPOINT);
+    if (!listener.listen()) {
+        std::cerr << "error creating endpoint " << DEFAULT_ENDPOINT << "\n";
+        return;
+    }
+    std::cout << "Waiting for " << nClients << " clients on " << DEFAULT_ENDPOINT << " (start ./Client in separate terminals)\n";
 
-    for (int i = 0; i < nClients; ++i) {
-        HANDLE hPipe = CreateNamedPipeA(R"(\\.\pipe\EmployeePipe)",
-            PIPE_ACCESS_DUPLEX,
-            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
-            PIPE_UNLIMITED_INSTANCES,
-            4096, 4096,
-            0, NULL);
-
-        if (hPipe == INVALID_HANDLE_VALUE) {
-            std::cerr << "error creating named pipe: " << GetLastError() << "\n";
-            continue;
-        }
+    if (useCoroutines) {
+        CoroutineServer server(*this, listener.listenFd);
+        server.run(nClients);
+    } else {
+        EpollServer reactor(*this, listener.listenFd);
+        reactor.run(nClients);
+    }
+    listener.close();
+#else
+    std::unique_ptr<TransportListener> listener = createListener(DEFAULT_ENDPOINT);
+    if (!listener->listen()) {
+        std::cerr << "error creating endpoint " << DEFAULT_ENDPOINT << "\n";
+        return;
+    }
 
-        pipeHandles.push_back(hPipe);
+    std::vector<std::thread> threads;
 
-        threads.emplace_back([this, hPipe, i]() {
-            BOOL connected = ConnectNamedPipe(hPipe, NULL) ? TRUE : (GetLastError() == ERROR_PIPE_CONNECTED);
-            if (connected) {
-                clientHandler(hPipe);
-            } else {
-                CloseHandle(hPipe);
+    for (int i = 0; i < nClients; ++i) {
+        threads.emplace_back([this, &listener]() {
+            std::unique_ptr<Transport> conn = listener->accept();
+            if (conn) {
+                clientHandler(*conn);
             }
         });
     }
 
+#ifdef _WIN32
     std::string clientPath = "Client.exe";
     for (int i = 0; i < nClients; ++i) {
         STARTUPINFOA si{};
@@ -215,10 +636,19 @@ void ServerApp::run() {
         CloseHandle(pi.hThread);
         CloseHandle(pi.hProcess);
     }
+#else
+    std::cout << "Waiting for " << nClients << " clients on " << DEFAULT_ENDPOINT << " (start ./Client in separate terminals)\n";
+#endif
 
     for (auto& t : threads) {
         if (t.joinable()) t.join();
     }
+    listener->close();
+#endif
+
+    while (activeWaiters > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
 
     std::cout << "Server stopped working.\n";
 }
\ No newline at end of file
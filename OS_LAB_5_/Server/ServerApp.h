@@ -1,32 +1,131 @@
 #pragma once
 #include "RecordManager.h"
+#include "ReadLeases.h"
+#include "WorkStealingPool.h"
 #include "../common/Employee.h"
-#include <windows.h>
+#include "../common/Message.h"
+#include "../common/Transport.h"
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-struct Message {
-    int type;
-    int id;
-    Employee emp;
+enum RequestStatus {
+    REQUEST_DONE,
+    REQUEST_BLOCKED,
+    REQUEST_CLOSE,
+    REQUEST_PENDING,
+    // Done, and there is no response to send.
+    REQUEST_SILENT
 };
 
-enum MsgType {
-    READ_LOCK = 1,
-    WRITE_LOCK,
-    WRITE_UPDATE,
-    UNLOCK,
-    CLIENT_EXIT
+// Receives the response of a request that finished asynchronously (REQUEST_PENDING).
+using CompletionCallback = std::function<void(const Message& resp)>;
+// Runs a request's blocking disk write on some other thread.
+using WriteRunner = std::function<void(std::function<void()> write)>;
+
+struct Session {
+    std::map<int, bool> heldLocks;
+    // Rows a SCAN or histogram streams ahead of its final response; whoever sends the
+    // response sends these first.
+    std::vector<Message> streamed;
+    // Open snapshots: handle -> snapshot timestamp.
+    std::map<int, uint64_t> snapshots;
+    int nextSnapshot = 1;
+    // TXN_ITEMs waiting for their TXN_COMMIT, and the record a blocked commit
+    // found locked.
+    std::vector<Employee> txn;
+    int txnBusy = 0;
+    // Records the client caches; set up by the transport serving the session.
+    std::shared_ptr<LeaseHolder> leases;
+};
+
+// A request waiting for a record lock. It gets LOCK_TIMEOUT once the deadline
+// passes; registered is set while a wake-up for it is queued in LockWaits.
+struct ParkedRequest {
+    Message msg;
+    LockDeadline deadline;
+    bool registered;
+};
+
+// Per-connection state of the blocking transport path once requests are
+// pipelined: requests that wait for a record lock are queued per order key
+// and resumed once the lock waits' notifier wakes them, while the connection
+// keeps answering other ids. The notifier only hands the key over: to a pool
+// task, or else to the session's resumer thread, started by the first wake-up. With a worker pool, the connection thread only
+// reads requests: they wait in inbox for one pool task at a time to run them
+// in order, and tasks counts the session's pool tasks not yet finished.
+struct SessionPipeline {
+    Session session;
+    Transport* conn = nullptr;
+    std::mutex mutex;
+    std::map<int, std::deque<ParkedRequest>> waiting;
+    bool closed = false;
+    std::deque<Message> inbox;
+    bool draining = false;
+    bool stopped = false;
+    int tasks = 0;
+    std::condition_variable idle;
+    // Serializes writes to conn: responses are sent under mutex as well, but
+    // INVALIDATE pushes come from other sessions' threads.
+    std::mutex sendMutex;
+    // Keys woken for the resumer thread, in order.
+    std::mutex resumeMutex;
+    std::condition_variable resumable;
+    std::deque<int> resumes;
+    bool resumeStopped = false;
+    std::thread resumer;
 };
 
 class ServerApp {
 public:
     ServerApp();
-    ~ServerApp() { delete manager; }
+    ServerApp(RecordManager* manager);
+    ~ServerApp() {
+        pool.reset();
+        delete manager;
+    }
     void run();
 public:
     RecordManager* manager;
-    void clientHandler(HANDLE hPipe);
-    std::map<int, bool> lockedRecords;
+    void clientHandler(Transport& conn);
+    void serveSession(Transport& conn, Session& session);
+    bool handleRequest(const std::shared_ptr<SessionPipeline>& state, const Message& msg);
+    bool submitRequest(const std::shared_ptr<SessionPipeline>& state, const Message& msg);
+    void drainInbox(std::shared_ptr<SessionPipeline> state);
+    void runDetached(std::shared_ptr<SessionPipeline> state, const Message& msg);
+    void wakeWaiting(std::shared_ptr<SessionPipeline> state, int key);
+    void resumeLoop(std::shared_ptr<SessionPipeline> state);
+    void resumeWaiting(std::shared_ptr<SessionPipeline> state, int key);
+    void parkWaiting(std::shared_ptr<SessionPipeline> state, int key, ParkedRequest& parked);
+    RequestStatus processRequest(Session& session, const Message& msg, Message& resp, bool mayBlock,
+                                 const CompletionCallback& onComplete = nullptr, const WriteRunner& runWrite = nullptr);
+    void endSession(Session& session);
+    void scan(Session& session, const Message& msg, Message& resp);
+    void aggregate(Session& session, const Message& msg, Message& resp);
+    RequestStatus commit(Session& session, const Message& msg, Message& resp, bool mayBlock,
+                         const CompletionCallback& onComplete = nullptr, const WriteRunner& runWrite = nullptr);
+    static bool deliver(Transport& conn, Session& session, const Message& resp);
+    static bool deliver(SessionPipeline& state, Session& session, const Message& resp);
+    static bool ordersBehindPending(const Session& session, const Message& msg);
+    static int orderKey(const Message& msg);
+    LockDeadline lockDeadline() const;
+    void waitForLock(const Session& session, const Message& msg, const void* owner, LockDeadline deadline,
+                     std::function<void()> wake);
+    static void lockTimedOut(Session& session, const Message& msg, Message& resp);
+    // How long a request may wait for a record lock; 0 waits for ever.
+    std::atomic<int> lockTimeoutMs{0};
+    // Parked pipe-session requests with a wake-up still to come.
+    std::atomic<int> activeWaiters{0};
+    // When set, threaded sessions run their requests as tasks on these workers.
+    std::unique_ptr<WorkStealingPool> pool;
+    // Linux: serve clients with CoroutineServer instead of EpollServer.
+    bool useCoroutines = false;
+    ReadLeases leases;
   
-};
\ No newline at end of file
+};
@@ -0,0 +1,96 @@
+#include "SocketListener.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+SocketConnection::SocketConnection(int fd) : fd(fd), inboxCount(0), inboxPos(0) {}
+SocketConnection::~SocketConnection() { close(); }
+
+bool SocketConnection::sendMessage(const Message& msg) {
+    ssize_t n;
+    do {
+        n = ::send(fd, &msg, sizeof(msg), MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(sizeof(msg));
+}
+
+bool SocketConnection::recvMessage(Message& msg) {
+    if (inboxPos == inboxCount) {
+        ssize_t n;
+        do {
+            n = ::recv(fd, inbox, sizeof(inbox), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0 || n % sizeof(Message) != 0) {
+            return false;
+        }
+        inboxCount = static_cast<int>(n / sizeof(Message));
+        inboxPos = 0;
+    }
+    msg = inbox[inboxPos++];
+    return true;
+}
+
+void SocketConnection::close() {
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+SocketListener::SocketListener(const std::string& path) : path(path), listenFd(-1) {}
+SocketListener::~SocketListener() { close(); }
+
+bool SocketListener::listen() {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "socket path too long: " << path << "\n";
+        return false;
+    }
+
+    listenFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "error creating socket: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());
+
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listenFd, SOMAXCONN) < 0) {
+        std::cerr << "error binding socket " << path << ": " << std::strerror(errno) << "\n";
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<Transport> SocketListener::accept() {
+    int fd;
+    do {
+        fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::make_unique<SocketConnection>(fd);
+}
+
+void SocketListener::close() {
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        ::unlink(path.c_str());
+    }
+}
+
+std::unique_ptr<TransportListener> createListener(const std::string& endpoint) {
+    return std::make_unique<SocketListener>(endpoint);
+}
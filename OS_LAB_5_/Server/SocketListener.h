@@ -0,0 +1,32 @@
+#pragma once
+#include "../common/Transport.h"
+
+class SocketConnection : public Transport {
+public:
+    SocketConnection(int fd);
+    ~SocketConnection();
+
+    bool sendMessage(const Message& msg) override;
+    bool recvMessage(Message& msg) override;
+    void close() override;
+
+public:
+    int fd;
+    Message inbox[MAX_BATCH_MESSAGES];
+    int inboxCount;
+    int inboxPos;
+};
+
+class SocketListener : public TransportListener {
+public:
+    SocketListener(const std::string& path);
+    ~SocketListener();
+
+    bool listen() override;
+    std::unique_ptr<Transport> accept() override;
+    void close() override;
+
+public:
+    std::string path;
+    int listenFd;
+};
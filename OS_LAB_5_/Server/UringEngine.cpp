@@ -0,0 +1,223 @@
+#include "UringEngine.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint64_t FSYNC_TAG = 1;
+
+static int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+UringEngine::UringEngine()
+    : ringFd(-1), dataFd(-1), linkedSync(false), sqRing(nullptr), cqRing(nullptr), sqRingSize(0), cqRingSize(0),
+      sqes(nullptr), sqesSize(0), sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr), sqEntries(0),
+      cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr), cqEntries(0), inflightCqes(0), stopping(false) {}
+
+UringEngine::~UringEngine() { close(); }
+
+bool UringEngine::open(const std::string& path, bool withSync, unsigned entries) {
+    linkedSync = withSync;
+    dataFd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (dataFd < 0) {
+        std::cerr << "io_uring: cannot open " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    io_uring_params params{};
+    ringFd = uringSetup(entries, &params);
+    if (ringFd < 0) {
+        std::cerr << "io_uring_setup failed: " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) sqRing = nullptr;
+    if (sqRing && singleMmap) {
+        cqRing = sqRing;
+    } else if (sqRing) {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) cqRing = nullptr;
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMem = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    sqes = sqeMem == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqeMem);
+    if (!sqRing || !cqRing || !sqes) {
+        std::cerr << "io_uring: mapping rings failed: " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    cqEntries = params.cq_entries;
+
+    stopping = false;
+    reaper = std::thread(&UringEngine::reapLoop, this);
+    return true;
+}
+
+// The request is queued and handed to the kernel right away; done(false) is
+// called here if the engine is shutting down.
+bool UringEngine::submitWrite(uint64_t offset, const Employee& e, std::function<void(bool ok)> done) {
+    Request* req = new Request{e, std::move(done), linkedSync ? 2 : 1, true};
+    unsigned need = static_cast<unsigned>(req->cqesLeft);
+
+    std::unique_lock<std::mutex> lk(submitMutex);
+    spaceFree.wait(lk, [&]() { return stopping || inflightCqes + need <= std::min(cqEntries, sqEntries); });
+    if (stopping || ringFd < 0) {
+        lk.unlock();
+        req->done(false);
+        delete req;
+        return false;
+    }
+
+    unsigned tail = *sqTail;
+    unsigned idx = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = dataFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&req->image);
+    sqe->len = sizeof(Employee);
+    sqe->off = offset;
+    sqe->user_data = reinterpret_cast<uint64_t>(req);
+    sqArray[idx] = idx;
+    ++tail;
+
+    if (linkedSync) {
+        sqe->flags |= IOSQE_IO_LINK;
+        idx = tail & *sqMask;
+        sqe = &sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = dataFd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->user_data = reinterpret_cast<uint64_t>(req) | FSYNC_TAG;
+        sqArray[idx] = idx;
+        ++tail;
+    }
+
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+    inflightCqes += need;
+
+    int r;
+    do {
+        r = uringEnter(ringFd, need, 0, 0);
+    } while (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    if (r < 0) {
+        std::cerr << "io_uring_enter failed: " << std::strerror(errno) << "\n";
+    }
+    return true;
+}
+
+void UringEngine::reapLoop() {
+    std::vector<Request*> finished;
+    while (true) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            {
+                std::lock_guard<std::mutex> lk(submitMutex);
+                if (stopping && inflightCqes == 0) return;
+            }
+            uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+
+        // Taking the submit lock orders this thread after the submission of
+        // every request whose completion it is about to read.
+        std::unique_lock<std::mutex> lk(submitMutex);
+        unsigned consumed = 0;
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            if (cqe.user_data == 0) continue;
+
+            bool isSync = (cqe.user_data & FSYNC_TAG) != 0;
+            Request* req = reinterpret_cast<Request*>(cqe.user_data & ~FSYNC_TAG);
+            bool ok = isSync ? cqe.res == 0 : cqe.res == static_cast<int>(sizeof(Employee));
+            req->ok = req->ok && ok;
+            ++consumed;
+            if (--req->cqesLeft == 0) {
+                finished.push_back(req);
+            }
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        inflightCqes -= consumed;
+        lk.unlock();
+        spaceFree.notify_all();
+
+        for (Request* req : finished) {
+            if (!req->ok) {
+                std::cerr << "io_uring: write of record " << req->image.num << " failed\n";
+            }
+            req->done(req->ok);
+            delete req;
+        }
+        finished.clear();
+    }
+}
+
+// Waits for every submitted write to complete, then wakes the reaper with a
+// NOP so it can observe the shutdown.
+void UringEngine::close() {
+    if (reaper.joinable()) {
+        std::unique_lock<std::mutex> lk(submitMutex);
+        stopping = true;
+        spaceFree.notify_all();
+        spaceFree.wait(lk, [this]() { return inflightCqes == 0; });
+
+        unsigned tail = *sqTail;
+        unsigned idx = tail & *sqMask;
+        std::memset(&sqes[idx], 0, sizeof(io_uring_sqe));
+        sqes[idx].opcode = IORING_OP_NOP;
+        sqArray[idx] = idx;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        uringEnter(ringFd, 1, 0, 0);
+        lk.unlock();
+        reaper.join();
+    }
+
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing) munmap(sqRing, sqRingSize);
+    sqes = nullptr;
+    cqRing = nullptr;
+    sqRing = nullptr;
+    if (ringFd >= 0) {
+        ::close(ringFd);
+        ringFd = -1;
+    }
+    if (dataFd >= 0) {
+        ::close(dataFd);
+        dataFd = -1;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "../common/Employee.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <linux/io_uring.h>
+
+// Positioned record writes through io_uring, driven by raw syscalls. Each
+// write may be linked to an fdatasync of the data file; the completion
+// callback runs on the single reaper thread once the last CQE of the request
+// arrives.
+class UringEngine {
+public:
+    struct Request {
+        Employee image;
+        std::function<void(bool ok)> done;
+        int cqesLeft;
+        bool ok;
+    };
+
+    UringEngine();
+    ~UringEngine();
+
+    bool open(const std::string& path, bool linkedSync, unsigned entries = 256);
+    bool submitWrite(uint64_t offset, const Employee& e, std::function<void(bool ok)> done);
+    void close();
+
+public:
+    int ringFd;
+    int dataFd;
+    bool linkedSync;
+
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+    unsigned cqEntries;
+
+    std::mutex submitMutex;
+    std::condition_variable spaceFree;
+    unsigned inflightCqes;
+    bool stopping;
+    std::thread reaper;
+
+    void reapLoop();
+};
@@ -0,0 +1,148 @@
+#include "VersionStore.h"
+#include <algorithm>
+
+VersionStore::VersionStore() : clock(0), active(0), horizon(0), stripes(new Stripe[STRIPES]) {}
+
+// active is raised before the clock is read and writers advance the clock
+// before reading active, so a write either sees this snapshot and keeps the
+// image it replaces, or gets a timestamp this snapshot already covers.
+uint64_t VersionStore::openSnapshot() {
+    std::lock_guard<std::mutex> lk(snapshotsMutex);
+    active.fetch_add(1);
+    uint64_t ts = clock.load();
+    snapshots.insert(ts);
+    return ts;
+}
+
+void VersionStore::closeSnapshot(uint64_t ts) {
+    uint64_t limit;
+    {
+        std::lock_guard<std::mutex> lk(snapshotsMutex);
+        auto it = snapshots.find(ts);
+        if (it == snapshots.end()) return;
+        snapshots.erase(it);
+        active.fetch_sub(1);
+        // Snapshots opened from now on start at the clock or later.
+        limit = snapshots.empty() ? clock.load() : *snapshots.begin();
+        horizon = limit;
+    }
+    collect(limit);
+}
+
+void VersionStore::dropBefore(Stripe& s, int id, uint64_t limit) {
+    auto h = s.history.find(id);
+    if (h != s.history.end()) {
+        auto& list = h->second;
+        list.erase(std::remove_if(list.begin(), list.end(), [limit](const Version& v) { return v.to <= limit; }),
+                   list.end());
+        if (list.empty()) s.history.erase(h);
+    }
+    auto c = s.currentFrom.find(id);
+    if (c != s.currentFrom.end() && c->second <= limit) s.currentFrom.erase(c);
+}
+
+void VersionStore::collect(uint64_t limit) {
+    for (size_t i = 0; i < STRIPES; ++i) {
+        Stripe& s = stripes[i];
+        std::lock_guard<std::mutex> lk(s.mutex);
+        for (auto h = s.history.begin(); h != s.history.end();) {
+            auto& list = h->second;
+            list.erase(std::remove_if(list.begin(), list.end(), [limit](const Version& v) { return v.to <= limit; }),
+                       list.end());
+            h = list.empty() ? s.history.erase(h) : std::next(h);
+        }
+        for (auto c = s.currentFrom.begin(); c != s.currentFrom.end();) {
+            c = c->second <= limit ? s.currentFrom.erase(c) : std::next(c);
+        }
+    }
+}
+
+// Called with the stripes of both IDs latched.
+void VersionStore::record(const Employee& before, const Employee& after, uint64_t ts, bool keep) {
+    int oldId = before.num;
+    int newId = after.num;
+    if (!keep) {
+        // Any snapshot opened from here on has a timestamp of at least ts.
+        if (oldId != FREE_RECORD_ID) dropBefore(stripeFor(oldId), oldId, ts);
+        if (newId != FREE_RECORD_ID) dropBefore(stripeFor(newId), newId, ts);
+        return;
+    }
+
+    if (oldId != FREE_RECORD_ID) {
+        Stripe& a = stripeFor(oldId);
+        auto c = a.currentFrom.find(oldId);
+        uint64_t from = c != a.currentFrom.end() ? c->second : 0;
+        dropBefore(a, oldId, horizon.load());
+        a.history[oldId].push_back({from, ts, before});
+        if (newId != oldId) a.currentFrom.erase(oldId);
+    }
+    if (newId != FREE_RECORD_ID) {
+        stripeFor(newId).currentFrom[newId] = ts;
+    }
+}
+
+void VersionStore::write(const Employee& before, const Employee& after, const std::function<void()>& store) {
+    Stripe& a = stripeFor(before.num != FREE_RECORD_ID ? before.num : after.num);
+    Stripe& b = stripeFor(after.num != FREE_RECORD_ID ? after.num : before.num);
+    std::unique_lock<std::mutex> first(a.mutex, std::defer_lock);
+    std::unique_lock<std::mutex> second(b.mutex, std::defer_lock);
+    if (&a == &b) first.lock();
+    else std::lock(first, second);
+
+    uint64_t ts = clock.fetch_add(1) + 1;
+    record(before, after, ts, active.load() != 0);
+    store();
+}
+
+// Stripes are latched in address order, so two batches never wait for each
+// other in a cycle.
+void VersionStore::writeBatch(const std::vector<Employee>& before, const std::vector<Employee>& after,
+                              const std::function<void()>& store) {
+    std::vector<Stripe*> touched;
+    for (size_t i = 0; i < before.size(); ++i) {
+        if (before[i].num != FREE_RECORD_ID) touched.push_back(&stripeFor(before[i].num));
+        if (after[i].num != FREE_RECORD_ID) touched.push_back(&stripeFor(after[i].num));
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (Stripe* s : touched) s->mutex.lock();
+
+    uint64_t ts = clock.fetch_add(1) + 1;
+    bool keep = active.load() != 0;
+    for (size_t i = 0; i < before.size(); ++i) {
+        record(before[i], after[i], ts, keep);
+    }
+    store();
+    for (Stripe* s : touched) s->mutex.unlock();
+}
+
+bool VersionStore::read(uint64_t ts, int id, const std::function<bool(Employee&)>& current, Employee& out) {
+    Stripe& s = stripeFor(id);
+    std::lock_guard<std::mutex> lk(s.mutex);
+    Employee now;
+    if (current(now)) {
+        auto c = s.currentFrom.find(id);
+        if (c == s.currentFrom.end() || c->second <= ts) {
+            out = now;
+            return true;
+        }
+    }
+    auto h = s.history.find(id);
+    if (h == s.history.end()) return false;
+    for (auto v = h->second.rbegin(); v != h->second.rend(); ++v) {
+        if (v->from <= ts && ts < v->to) {
+            out = v->image;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t VersionStore::keptVersions() {
+    size_t n = 0;
+    for (size_t i = 0; i < STRIPES; ++i) {
+        std::lock_guard<std::mutex> lk(stripes[i].mutex);
+        for (auto& h : stripes[i].history) n += h.second.size();
+    }
+    return n;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "../common/Employee.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// Multi-version bookkeeping for snapshot reads. Every record image change
+// takes a commit timestamp from one clock; a snapshot is just the clock value
+// when it was opened and sees, for each ID, the image that was current then.
+//
+// The records themselves keep only the newest image. While snapshots are open,
+// a write moves the image it replaces into a per-ID history tagged with the
+// timestamps it was current for, and notes when the new image became current.
+// With no snapshot open nothing is kept. Closing a snapshot drops every
+// version that no remaining snapshot can see.
+//
+// A write and a snapshot read of one ID are serialized by a short latch on a
+// stripe of IDs; record locks are never involved.
+class VersionStore {
+public:
+    VersionStore();
+
+    uint64_t openSnapshot();
+    void closeSnapshot(uint64_t ts);
+    size_t openSnapshots() const { return static_cast<size_t>(active.load()); }
+
+    // store() replaces a slot image `before` with `after`; either may be a
+    // free slot. Writers of one slot must already be serialized.
+    void write(const Employee& before, const Employee& after, const std::function<void()>& store);
+    // Same for several slots at once: they all get one timestamp, so a
+    // snapshot sees either every change or none.
+    void writeBatch(const std::vector<Employee>& before, const std::vector<Employee>& after,
+                    const std::function<void()>& store);
+    // current() reads the image the ID has now and returns false if it has
+    // none; it runs under the latch.
+    bool read(uint64_t ts, int id, const std::function<bool(Employee&)>& current, Employee& out);
+    size_t keptVersions();
+
+public:
+    struct Version {
+        uint64_t from;
+        uint64_t to;
+        Employee image;
+    };
+
+    static const size_t STRIPES = 64;
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        // IDs whose current image is newer than some open snapshot.
+        std::unordered_map<int, uint64_t> currentFrom;
+        std::unordered_map<int, std::vector<Version>> history;
+    };
+
+    std::atomic<uint64_t> clock;
+    std::atomic<int> active;
+    // Versions that ended at or before this are visible to no snapshot.
+    std::atomic<uint64_t> horizon;
+    std::mutex snapshotsMutex;
+    std::multiset<uint64_t> snapshots;
+    std::unique_ptr<Stripe[]> stripes;
+
+    Stripe& stripeFor(int id) { return stripes[(static_cast<uint32_t>(id) * 2654435761u >> 16) % STRIPES]; }
+    void dropBefore(Stripe& s, int id, uint64_t limit);
+    void record(const Employee& before, const Employee& after, uint64_t ts, bool keep);
+    void collect(uint64_t limit);
+};
@@ -0,0 +1,82 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+// The worker the calling thread runs as, if it belongs to a pool.
+static thread_local WorkStealingPool* currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+WorkStealingPool::WorkStealingPool(size_t n)
+    : count(n ? n : std::max(1u, std::thread::hardware_concurrency())), nextWorker(0), pending(0), sleeping(0),
+      stopping(false) {
+    workers.reset(new Worker[count]);
+    for (size_t i = 0; i < count; ++i) {
+        workers[i].thread = std::thread(&WorkStealingPool::workerMain, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lk(sleepMutex);
+        stopping = true;
+    }
+    sleepCv.notify_all();
+    for (size_t i = 0; i < count; ++i) {
+        workers[i].thread.join();
+    }
+}
+
+// pending goes up before sleeping is read, and a worker raises sleeping
+// before it checks pending, so a task is never left with every worker asleep.
+void WorkStealingPool::submit(std::function<void()> task) {
+    size_t target = currentPool == this ? currentWorker : nextWorker.fetch_add(1) % count;
+    {
+        std::lock_guard<std::mutex> lk(workers[target].mutex);
+        workers[target].tasks.push_back(std::move(task));
+    }
+    pending.fetch_add(1);
+    if (sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lk(sleepMutex); }
+        sleepCv.notify_one();
+    }
+}
+
+bool WorkStealingPool::take(size_t self, std::function<void()>& task) {
+    {
+        Worker& own = workers[self];
+        std::lock_guard<std::mutex> lk(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < count; ++i) {
+        Worker& victim = workers[(self + i) % count];
+        std::lock_guard<std::mutex> lk(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerMain(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+    std::function<void()> task;
+    while (true) {
+        if (take(self, task)) {
+            pending.fetch_sub(1);
+            task();
+            task = nullptr;
+            continue;
+        }
+        sleeping.fetch_add(1);
+        std::unique_lock<std::mutex> lk(sleepMutex);
+        sleepCv.wait(lk, [this]() { return pending.load() > 0 || stopping; });
+        sleeping.fetch_sub(1);
+        if (stopping && pending.load() == 0) return;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Fixed set of worker threads, one per hardware thread by default. Every
+// worker has its own deque: tasks submitted from a worker go to the back of
+// its deque and it takes them back LIFO, while a worker that runs dry steals
+// from the front of the others' deques. Tasks submitted from other threads
+// are dealt round-robin. Idle workers sleep until a task is submitted.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t workers = 0);
+    // Runs every task already submitted, then joins the workers.
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(std::function<void()> task);
+    size_t size() const { return count; }
+
+public:
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::unique_ptr<Worker[]> workers;
+    size_t count;
+    std::atomic<size_t> nextWorker;
+    // Tasks in the deques, and workers asleep or about to sleep.
+    std::atomic<int> pending;
+    std::atomic<int> sleeping;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    bool stopping;
+
+    bool take(size_t self, std::function<void()>& task);
+    void workerMain(size_t self);
+};
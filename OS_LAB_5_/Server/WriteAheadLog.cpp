@@ -0,0 +1,318 @@
+#include "WriteAheadLog.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static const WalFileHandle NO_FILE = INVALID_HANDLE_VALUE;
+
+static WalFileHandle openFile(const std::string& path, bool appendOnly, bool truncate) {
+    DWORD access = appendOnly ? FILE_APPEND_DATA : GENERIC_READ | GENERIC_WRITE;
+    DWORD disposition = truncate ? CREATE_ALWAYS : OPEN_EXISTING;
+    return CreateFileA(path.c_str(), access, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void closeFile(WalFileHandle h) {
+    CloseHandle(h);
+}
+
+static bool writeAll(WalFileHandle h, const void* buf, size_t len) {
+    DWORD written = 0;
+    return WriteFile(h, buf, static_cast<DWORD>(len), &written, NULL) && written == len;
+}
+
+static bool writeAt(WalFileHandle h, uint64_t offset, const void* buf, size_t len) {
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written = 0;
+    return WriteFile(h, buf, static_cast<DWORD>(len), &written, &ov) && written == len;
+}
+
+static bool syncFile(WalFileHandle h) {
+    return FlushFileBuffers(h) != FALSE;
+}
+
+static void syncDirectoryOf(const std::string&) {}
+#else
+static const WalFileHandle NO_FILE = -1;
+
+static WalFileHandle openFile(const std::string& path, bool appendOnly, bool truncate) {
+    int flags = O_CLOEXEC | (appendOnly ? O_WRONLY | O_APPEND : O_RDWR);
+    if (truncate) flags |= O_CREAT | O_TRUNC;
+    return ::open(path.c_str(), flags, 0644);
+}
+
+static void closeFile(WalFileHandle fd) {
+    ::close(fd);
+}
+
+static bool writeAll(WalFileHandle fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool writeAt(WalFileHandle fd, uint64_t offset, const void* buf, size_t len) {
+    return ::pwrite(fd, buf, len, static_cast<off_t>(offset)) == static_cast<ssize_t>(len);
+}
+
+static bool syncFile(WalFileHandle fd) {
+    return ::fdatasync(fd) == 0;
+}
+
+// Makes a rename or create of a log segment survive a crash.
+static void syncDirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+#endif
+
+static uint32_t walChecksum(const WalRecord& rec) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&rec) + offsetof(WalRecord, lsn);
+    size_t len = sizeof(WalRecord) - offsetof(WalRecord, lsn);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& dataPath)
+    : dataPath(dataPath), walPath(dataPath + ".wal"), oldWalPath(dataPath + ".wal.old"),
+      walFile(NO_FILE), dataFile(NO_FILE), oldSegmentPending(false),
+      nextLsn(0), durableLsn(0), flushing(false), failed(false), stopping(false) {}
+
+WriteAheadLog::~WriteAheadLog() { close(); }
+
+void WriteAheadLog::discard(const std::string& dataPath) {
+    std::remove((dataPath + ".wal").c_str());
+    std::remove((dataPath + ".wal.old").c_str());
+}
+
+bool WriteAheadLog::open(int checkpointMs) {
+    dataFile = openFile(dataPath, false, false);
+    if (dataFile == NO_FILE) {
+        std::cerr << "WAL: cannot open data file " << dataPath << "\n";
+        return false;
+    }
+    if (!replay()) {
+        return false;
+    }
+
+    walFile = openFile(walPath, true, true);
+    if (walFile == NO_FILE) {
+        std::cerr << "WAL: cannot create " << walPath << "\n";
+        return false;
+    }
+    syncDirectoryOf(walPath);
+
+    if (checkpointMs > 0) {
+        checkpointThread = std::thread(&WriteAheadLog::checkpointLoop, this, checkpointMs);
+    }
+    return true;
+}
+
+// Applies the old segment, then the current one. A torn or corrupt tail, or a
+// batch cut short, ends a segment: those updates were never acknowledged.
+bool WriteAheadLog::replay() {
+    size_t applied = replaySegment(oldWalPath) + replaySegment(walPath);
+    if (applied == 0) {
+        discard(dataPath);
+        return true;
+    }
+    if (!syncFile(dataFile)) {
+        std::cerr << "WAL: failed to sync " << dataPath << " after replay\n";
+        return false;
+    }
+    discard(dataPath);
+    std::cout << "WAL: replayed " << applied << " updates into " << dataPath << "\n";
+    return true;
+}
+
+size_t WriteAheadLog::replaySegment(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return 0;
+
+    size_t applied = 0;
+    uint64_t lastLsn = 0;
+    std::vector<WalRecord> batch;
+    WalRecord rec;
+    while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+        if (rec.magic != WAL_MAGIC || rec.checksum != walChecksum(rec) || rec.lsn <= lastLsn) break;
+        if (!batch.empty() && rec.following + 1 != batch.back().following) break;
+        lastLsn = rec.lsn;
+        batch.push_back(rec);
+        if (rec.following != 0) continue;
+
+        for (const WalRecord& r : batch) {
+            if (!writeAt(dataFile, r.index * sizeof(Employee), &r.emp, sizeof(Employee))) {
+                std::cerr << "WAL: failed to apply update " << r.lsn << "\n";
+                return applied;
+            }
+            ++applied;
+        }
+        batch.clear();
+    }
+    return applied;
+}
+
+bool WriteAheadLog::append(size_t index, const Employee& e) {
+    return appendBatch(&index, &e, 1);
+}
+
+// The records are queued together, so one leader writes them all with one
+// sync.
+bool WriteAheadLog::appendBatch(const size_t* indices, const Employee* images, size_t count) {
+    std::unique_lock<std::mutex> lk(mutex);
+    if (failed || walFile == NO_FILE) return false;
+    if (count == 0) return true;
+
+    for (size_t i = 0; i < count; ++i) {
+        WalRecord rec{};
+        rec.magic = WAL_MAGIC;
+        rec.lsn = ++nextLsn;
+        rec.index = indices[i];
+        rec.following = count - 1 - i;
+        rec.emp = images[i];
+        rec.checksum = walChecksum(rec);
+        pending.push_back(rec);
+    }
+
+    const uint64_t lsn = nextLsn;
+    while (durableLsn < lsn && !failed) {
+        if (flushing) {
+            flushed.wait(lk);
+            continue;
+        }
+
+        // Become the leader for everything queued so far.
+        flushing = true;
+        std::vector<WalRecord> batch;
+        batch.swap(pending);
+        WalFileHandle fd = walFile;
+        lk.unlock();
+        bool ok = writeAll(fd, batch.data(), batch.size() * sizeof(WalRecord)) && syncFile(fd);
+        syncCount.fetch_add(1);
+        lk.lock();
+
+        flushing = false;
+        if (ok) {
+            durableLsn = batch.back().lsn;
+            // Only now may a checkpoint put them into the data file.
+            for (const WalRecord& rec : batch) {
+                dirtyImages[rec.index] = rec.emp;
+            }
+        } else {
+            std::cerr << "WAL: write to " << walPath << " failed\n";
+            failed = true;
+        }
+        flushed.notify_all();
+    }
+    return durableLsn >= lsn;
+}
+
+// Called with the mutex held and no flush in progress.
+bool WriteAheadLog::rotate() {
+    closeFile(walFile);
+    walFile = NO_FILE;
+    if (std::rename(walPath.c_str(), oldWalPath.c_str()) != 0) {
+        std::cerr << "WAL: cannot rotate " << walPath << "\n";
+        failed = true;
+        return false;
+    }
+    walFile = openFile(walPath, true, true);
+    syncDirectoryOf(walPath);
+    if (walFile == NO_FILE) {
+        failed = true;
+        return false;
+    }
+    oldSegmentPending = true;
+    return true;
+}
+
+bool WriteAheadLog::checkpoint() {
+    std::lock_guard<std::mutex> cp(checkpointMutex);
+    std::unordered_map<size_t, Employee> images;
+    {
+        // dirtyImages only holds records already in the log being rotated;
+        // those still pending go to the new segment and the next checkpoint.
+        std::unique_lock<std::mutex> lk(mutex);
+        flushed.wait(lk, [this]() { return !flushing; });
+        if (dirtyImages.empty() || dataFile == NO_FILE) return true;
+        images.swap(dirtyImages);
+        // A segment left by a failed checkpoint is only covered by this one.
+        if (!oldSegmentPending && !rotate()) return false;
+    }
+
+    bool ok = true;
+    for (const auto& p : images) {
+        ok = ok && writeAt(dataFile, p.first * sizeof(Employee), &p.second, sizeof(Employee));
+    }
+    ok = ok && syncFile(dataFile);
+
+    std::lock_guard<std::mutex> lk(mutex);
+    if (!ok) {
+        std::cerr << "WAL: checkpoint of " << dataPath << " failed\n";
+        for (const auto& p : images) {
+            dirtyImages.emplace(p.first, p.second);
+        }
+        return false;
+    }
+    std::remove(oldWalPath.c_str());
+    oldSegmentPending = false;
+    return true;
+}
+
+void WriteAheadLog::checkpointLoop(int periodMs) {
+    std::unique_lock<std::mutex> lk(mutex);
+    while (!checkpointCv.wait_for(lk, std::chrono::milliseconds(periodMs), [this]() { return stopping; })) {
+        lk.unlock();
+        checkpoint();
+        lk.lock();
+    }
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stopping = true;
+    }
+    checkpointCv.notify_all();
+    if (checkpointThread.joinable()) {
+        checkpointThread.join();
+    }
+
+    bool clean = dataFile != NO_FILE && checkpoint();
+    std::lock_guard<std::mutex> lk(mutex);
+    if (walFile != NO_FILE) {
+        closeFile(walFile);
+        walFile = NO_FILE;
+    }
+    if (clean && !failed) {
+        discard(dataPath);
+    }
+    if (dataFile != NO_FILE) {
+        closeFile(dataFile);
+        dataFile = NO_FILE;
+    }
+}
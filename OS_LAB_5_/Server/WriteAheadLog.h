@@ -0,0 +1,79 @@
+#pragma once
+#include "../common/Employee.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE WalFileHandle;
+#else
+typedef int WalFileHandle;
+#endif
+
+const uint32_t WAL_MAGIC = 0x4c415745;
+
+// One logged update: the full image of the record at `index` in the data file.
+// `following` is how many records of the same batch come after this one.
+struct WalRecord {
+    uint32_t magic;
+    uint32_t checksum;
+    uint64_t lsn;
+    uint64_t index;
+    uint64_t following;
+    Employee emp;
+};
+
+// Append-only log in front of the employee file (<data>.wal). Concurrent
+// append() calls are group-committed: one thread writes everything queued so
+// far with a single fdatasync while the others wait for their LSN. A
+// checkpoint rotates the log to <data>.wal.old, writes the latest image of
+// each dirty record into the data file, syncs it and drops the old segment.
+// open() replays whatever a crash left behind. A batch from appendBatch() is
+// replayed whole or not at all.
+class WriteAheadLog {
+public:
+    WriteAheadLog(const std::string& dataPath);
+    ~WriteAheadLog();
+
+    bool open(int checkpointMs);
+    bool append(size_t index, const Employee& e);
+    bool appendBatch(const size_t* indices, const Employee* images, size_t count);
+    bool checkpoint();
+    void close();
+
+    static void discard(const std::string& dataPath);
+
+public:
+    std::string dataPath;
+    std::string walPath;
+    std::string oldWalPath;
+    WalFileHandle walFile;
+    WalFileHandle dataFile;
+    bool oldSegmentPending;
+
+    std::mutex mutex;
+    std::condition_variable flushed;
+    std::vector<WalRecord> pending;
+    // Latest durable image of each record changed since the last checkpoint.
+    std::unordered_map<size_t, Employee> dirtyImages;
+    uint64_t nextLsn;
+    uint64_t durableLsn;
+    bool flushing;
+    bool failed;
+    std::atomic<uint64_t> syncCount{0};
+
+    std::mutex checkpointMutex;
+    std::thread checkpointThread;
+    std::condition_variable checkpointCv;
+    bool stopping;
+
+    bool replay();
+    size_t replaySegment(const std::string& path);
+    bool rotate();
+    void checkpointLoop(int periodMs);
+};
@@ -1,7 +1,12 @@
 #pragma once
+#include <cstddef>
+#include <climits>
 
 const size_t NAME_SIZE = 32;
 
+// ID stored in a slot of the data file that was deleted and awaits reuse.
+const int FREE_RECORD_ID = INT_MIN;
+
 struct Employee {
     int num;           //ID
     char name[NAME_SIZE]; 
@@ -0,0 +1,98 @@
+#pragma once
+#include "Employee.h"
+
+#include <cstdint>
+#include <cstring>
+
+// reqId is chosen by the client and echoed in the response, so a connection
+// can keep several requests in flight and match answers that arrive out of
+// order.
+struct Message {
+    int type;
+    int id;
+    uint32_t reqId;
+    Employee emp;
+};
+
+enum MsgType {
+    READ_LOCK = 1,
+    WRITE_LOCK,
+    WRITE_UPDATE,
+    UNLOCK,
+    CLIENT_EXIT,
+    SHM_ATTACH,
+    // Lock-free read: no lock is left held, so no UNLOCK follows.
+    READ_OPTIMISTIC,
+    // emp is the new record; fails if its ID is taken.
+    CREATE_RECORD,
+    // Needs the session's write lock on id, which the delete releases.
+    DELETE_RECORD,
+    // id is a ScanKey and emp.num the most rows wanted (0 for all). Every
+    // matching record comes back as a SCAN message with the request's reqId,
+    // then one SCAN_END whose id is the row count, or -1 for a bad request.
+    SCAN,
+    SCAN_END,
+    // id is an AggregateOp over the hours of every record. The answer is one
+    // AGGREGATE whose id is how many records were counted (-1 for a bad
+    // request) and emp.hours the sum, minimum or maximum. AGG_HISTOGRAM first
+    // streams a HISTOGRAM_BUCKET per bucket: id the bucket, emp.num its count,
+    // emp.hours its lower edge.
+    AGGREGATE,
+    HISTOGRAM_BUCKET,
+    // Opens a point-in-time view of all records; the answer's id is a handle
+    // (-1 on failure). Snapshots end with SNAPSHOT_CLOSE or the session.
+    SNAPSHOT_OPEN,
+    // Record id as it was when snapshot emp.num was opened. Takes no lock.
+    SNAPSHOT_READ,
+    // id is the handle.
+    SNAPSHOT_CLOSE,
+    // One record of a transaction, emp its new image. Gets no answer: the
+    // records are collected until TXN_COMMIT.
+    TXN_ITEM,
+    // Write-locks the collected records in ID order, writes them all as one
+    // batch and unlocks them. id is how many TXN_ITEMs were sent; the answer's
+    // id is that count, or -1 if it does not match, an ID repeats or is
+    // missing, or the session holds a lock on one of the records.
+    TXN_COMMIT,
+    // Sent instead of the answer to a request that could not get its record
+    // lock within the server's lock timeout; reqId is the request's, id its id.
+    // Nothing was done and no lock is held.
+    LOCK_TIMEOUT,
+    // READ_OPTIMISTIC that also leases the record to the connection: the
+    // answer stays valid until the server sends INVALIDATE for id.
+    READ_CACHED,
+    // Pushed by the server, reqId 0: record id changed or was deleted and its
+    // lease is over.
+    INVALIDATE
+};
+
+enum ScanKey {
+    // emp.name is the prefix.
+    SCAN_NAME_PREFIX = 1,
+    // emp.hours is the lower bound; the upper one travels in emp.name, see
+    // setUpperBound. Both are inclusive.
+    SCAN_HOURS_RANGE
+};
+
+enum AggregateOp {
+    AGG_SUM = 1,
+    AGG_MIN,
+    AGG_MAX,
+    // Records with hours in a range given as for SCAN_HOURS_RANGE.
+    AGG_COUNT_IN_RANGE,
+    // emp.num equal-width buckets over that range, at most MAX_HISTOGRAM_BUCKETS.
+    AGG_HISTOGRAM
+};
+
+const int MAX_HISTOGRAM_BUCKETS = 1024;
+const int MAX_TXN_RECORDS = 1024;
+
+inline void setUpperBound(Message& msg, double hi) {
+    std::memcpy(msg.emp.name, &hi, sizeof(hi));
+}
+
+inline double upperBound(const Message& msg) {
+    double hi;
+    std::memcpy(&hi, msg.emp.name, sizeof(hi));
+    return hi;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+// MSVC secure CRT replacements for the string helpers used across the project.
+#ifndef _WIN32
+inline int strncpy_s(char* dest, size_t destSize, const char* src, size_t count) {
+    if (!dest || destSize == 0) return 22;
+    size_t n = 0;
+    while (n < count && n + 1 < destSize && src[n] != '\0') {
+        dest[n] = src[n];
+        ++n;
+    }
+    dest[n] = '\0';
+    return 0;
+}
+
+template <size_t N>
+inline int strncpy_s(char (&dest)[N], const char* src, size_t count) {
+    return strncpy_s(dest, N, src, count);
+}
+
+template <size_t N>
+inline int strcpy_s(char (&dest)[N], const char* src) {
+    return strncpy_s(dest, N, src, N - 1);
+}
+#else
+#include <windows.h>
+
+// Blocking read or write on a handle opened with FILE_FLAG_OVERLAPPED. Pipes are
+// opened that way so one thread can write while another is parked in ReadFile;
+// on a synchronous handle the two calls would serialize.
+inline bool overlappedTransfer(HANDLE h, bool write, void* buf, DWORD len, DWORD& done) {
+    OVERLAPPED ov{};
+    ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!ov.hEvent) return false;
+
+    BOOL ok = write ? WriteFile(h, buf, len, NULL, &ov) : ReadFile(h, buf, len, NULL, &ov);
+    if (ok || GetLastError() == ERROR_IO_PENDING) {
+        ok = GetOverlappedResult(h, &ov, &done, TRUE);
+    }
+    CloseHandle(ov.hEvent);
+    return ok != FALSE;
+}
+#endif
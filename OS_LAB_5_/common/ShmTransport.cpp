@@ -0,0 +1,219 @@
+#include "ShmTransport.h"
+#include <iostream>
+#include <new>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const int SPIN_BEFORE_SLEEP = 4000;
+static const int YIELD_MASK = 255;
+static const long FUTEX_TIMEOUT_NS = 100 * 1000 * 1000;
+static const int LIVENESS_CHECK_MASK = (1 << 20) - 1;
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Spinning only pays off when the peer can run on another core.
+static int spinLimit() {
+    static const int limit = std::thread::hardware_concurrency() > 1 ? SPIN_BEFORE_SLEEP : 0;
+    return limit;
+}
+
+static inline void pollPause(int spins) {
+    cpuRelax();
+    if ((spins & YIELD_MASK) == 0) {
+        sched_yield();
+    }
+}
+
+static void futexWait(std::atomic<uint32_t>* addr, uint32_t expected) {
+    timespec ts{0, FUTEX_TIMEOUT_NS};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>* addr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+ShmTransport::ShmTransport() : region(nullptr), tx(nullptr), rx(nullptr), mode(SHM_WAIT_FUTEX), peerFd(-1) {}
+ShmTransport::~ShmTransport() { close(); }
+
+bool ShmTransport::map(int fd, bool init) {
+    void* p = mmap(nullptr, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "mmap of " << name << " failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    if (init) {
+        region = new (p) ShmRegion();
+        region->closed = 0;
+        for (ShmRing* r : { &region->toServer, &region->toClient }) {
+            r->head = 0;
+            r->tail = 0;
+            r->producerWaiting = 0;
+            r->consumerWaiting = 0;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        region->magic = SHM_MAGIC;
+    } else {
+        region = static_cast<ShmRegion*>(p);
+        if (region->magic != SHM_MAGIC) {
+            munmap(p, sizeof(ShmRegion));
+            region = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShmTransport::create(const std::string& shmName, ShmWaitMode waitMode) {
+    name = shmName;
+    mode = waitMode;
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "shm_open " << name << " failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    if (ftruncate(fd, sizeof(ShmRegion)) < 0) {
+        ::close(fd);
+        unlink();
+        return false;
+    }
+    if (!map(fd, true)) {
+        unlink();
+        return false;
+    }
+    tx = &region->toServer;
+    rx = &region->toClient;
+    return true;
+}
+
+bool ShmTransport::open(const std::string& shmName, ShmWaitMode waitMode) {
+    name = shmName;
+    mode = waitMode;
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (!map(fd, false)) {
+        return false;
+    }
+    tx = &region->toClient;
+    rx = &region->toServer;
+    return true;
+}
+
+void ShmTransport::unlink() {
+    if (!name.empty()) {
+        shm_unlink(name.c_str());
+    }
+}
+
+bool ShmTransport::peerAlive() {
+    if (region->closed.load()) return false;
+    if (peerFd < 0) return true;
+
+    pollfd p{};
+    p.fd = peerFd;
+    p.events = POLLRDHUP;
+    return ::poll(&p, 1, 0) == 0;
+}
+
+bool ShmTransport::sendMessage(const Message& msg) {
+    if (!region) return false;
+
+    uint32_t t = tx->tail.load(std::memory_order_relaxed);
+    int spins = 0;
+    while (true) {
+        uint32_t h = tx->head.load(std::memory_order_acquire);
+        if (t - h < SHM_RING_SLOTS) break;
+
+        ++spins;
+        if (mode == SHM_WAIT_BUSY_POLL || spins < spinLimit()) {
+            pollPause(spins);
+            if ((spins & LIVENESS_CHECK_MASK) == 0 && !peerAlive()) return false;
+            continue;
+        }
+        tx->producerWaiting.store(1);
+        if (tx->head.load() == h) {
+            futexWait(&tx->head, h);
+        }
+        tx->producerWaiting.store(0);
+        if (!peerAlive()) return false;
+        spins = 0;
+    }
+
+    tx->slots[t % SHM_RING_SLOTS] = msg;
+    tx->tail.store(t + 1);
+    if (tx->consumerWaiting.load()) {
+        futexWake(&tx->tail);
+    }
+    return true;
+}
+
+bool ShmTransport::recvMessage(Message& msg) {
+    if (!region) return false;
+
+    uint32_t h = rx->head.load(std::memory_order_relaxed);
+    int spins = 0;
+    while (rx->tail.load(std::memory_order_acquire) == h) {
+        ++spins;
+        if (mode == SHM_WAIT_BUSY_POLL || spins < spinLimit()) {
+            pollPause(spins);
+            if ((spins & LIVENESS_CHECK_MASK) == 0 && !peerAlive()) return false;
+            continue;
+        }
+        rx->consumerWaiting.store(1);
+        if (rx->tail.load() == h) {
+            futexWait(&rx->tail, h);
+        }
+        rx->consumerWaiting.store(0);
+        if (rx->tail.load(std::memory_order_acquire) == h && !peerAlive()) return false;
+        spins = 0;
+    }
+
+    msg = rx->slots[h % SHM_RING_SLOTS];
+    rx->head.store(h + 1);
+    if (rx->producerWaiting.load()) {
+        futexWake(&rx->head);
+    }
+    return true;
+}
+
+// Marks the channel closed and wakes both sides without unmapping, so a thread
+// still inside send/recv returns false instead of touching freed memory.
+void ShmTransport::shutdown() {
+    if (region) {
+        region->closed.store(1);
+        futexWake(&region->toServer.tail);
+        futexWake(&region->toClient.tail);
+        futexWake(&region->toServer.head);
+        futexWake(&region->toClient.head);
+    }
+}
+
+void ShmTransport::close() {
+    if (region) {
+        shutdown();
+        munmap(region, sizeof(ShmRegion));
+        region = nullptr;
+        tx = nullptr;
+        rx = nullptr;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "Message.h"
+#include "Transport.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+const uint32_t SHM_RING_SLOTS = 64;
+const uint32_t SHM_MAGIC = 0x454d5348;
+
+enum ShmWaitMode {
+    SHM_WAIT_FUTEX = 0,
+    SHM_WAIT_BUSY_POLL
+};
+
+// Single-producer/single-consumer ring of Message slots. head and tail live on
+// separate cache lines and double as futex words for the sleeping side.
+struct ShmRing {
+    alignas(64) std::atomic<uint32_t> head;
+    std::atomic<uint32_t> producerWaiting;
+    alignas(64) std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> consumerWaiting;
+    alignas(64) Message slots[SHM_RING_SLOTS];
+};
+
+struct ShmRegion {
+    uint32_t magic;
+    std::atomic<uint32_t> closed;
+    ShmRing toServer;
+    ShmRing toClient;
+};
+
+// Same-host transport over a shared memory segment, one ring per direction.
+// The client creates and later unlinks the segment; the Unix socket used for
+// the handshake stays open as a liveness channel (peerFd).
+class ShmTransport : public Transport {
+public:
+    ShmTransport();
+    ~ShmTransport();
+
+    bool create(const std::string& shmName, ShmWaitMode waitMode);
+    bool open(const std::string& shmName, ShmWaitMode waitMode);
+    void unlink();
+
+    bool sendMessage(const Message& msg) override;
+    bool recvMessage(Message& msg) override;
+    void close() override;
+    void shutdown();
+    // True if recvMessage would return at once.
+    bool readable() const { return region && rx->tail.load(std::memory_order_acquire) != rx->head.load(std::memory_order_relaxed); }
+
+public:
+    std::string name;
+    ShmRegion* region;
+    ShmRing* tx;
+    ShmRing* rx;
+    ShmWaitMode mode;
+    int peerFd;
+
+    bool map(int fd, bool init);
+    bool peerAlive();
+};
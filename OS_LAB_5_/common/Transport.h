@@ -0,0 +1,34 @@
+#pragma once
+#include "Message.h"
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+const char* const DEFAULT_ENDPOINT = R"(\\.\pipe\EmployeePipe)";
+#else
+const char* const DEFAULT_ENDPOINT = "/tmp/EmployeePipe.sock";
+#endif
+
+// One transport write may carry up to MAX_BATCH_MESSAGES back-to-back Messages;
+// receivers split such packets and hand them out one at a time.
+const int MAX_BATCH_MESSAGES = 32;
+
+// One connected, message-framed channel: a named pipe instance on Windows,
+// a SOCK_SEQPACKET Unix domain socket elsewhere.
+class Transport {
+public:
+    virtual ~Transport() = default;
+    virtual bool sendMessage(const Message& msg) = 0;
+    virtual bool recvMessage(Message& msg) = 0;
+    virtual void close() = 0;
+};
+
+class TransportListener {
+public:
+    virtual ~TransportListener() = default;
+    virtual bool listen() = 0;
+    virtual std::unique_ptr<Transport> accept() = 0;
+    virtual void close() = 0;
+};
+
+std::unique_ptr<TransportListener> createListener(const std::string& endpoint);
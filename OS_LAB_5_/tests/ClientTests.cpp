@@ -1,11 +1,20 @@
 #include <gtest/gtest.h>
 #include <thread>
 #include <chrono>
-#include <windows.h>
 #include <atomic>
 #include "Client/PipeClient.h"
 #include "Client/ClientApp.h"
+#include "common/Platform.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "Server/SocketListener.h"
+#endif
+#ifdef __linux__
+#include "common/ShmTransport.h"
+#endif
 
+#ifdef _WIN32
 TEST(PipeClientTest, ConnectionTest) {
     HANDLE hPipe = CreateNamedPipeA(
         R"(\\.\pipe\TestEmployeePipe)",
@@ -234,6 +243,284 @@ TEST(PipeClientTest, ErrorHandlingTest) {
     msg.type = READ_LOCK;
     msg.id = 1;
 }
+#else
+TEST(PipeClientTest, ConnectionTest) {
+    const std::string path = "/tmp/TestEmployeePipe.sock";
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    std::atomic<bool> connectionMade{false};
+    std::thread serverThread([&]() {
+        std::unique_ptr<Transport> conn = listener.accept();
+        connectionMade = conn != nullptr;
+    });
+
+    PipeClient client(path);
+    EXPECT_TRUE(client.connect());
+
+    serverThread.join();
+    EXPECT_TRUE(connectionMade);
+    listener.close();
+}
+
+TEST(PipeClientTest, SendReceiveMessageTest) {
+    const std::string path = "/tmp/TestEmployeePipe2.sock";
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    std::thread serverThread([&]() {
+        std::unique_ptr<Transport> conn = listener.accept();
+        ASSERT_NE(conn, nullptr);
+
+        Message receivedMsg;
+        EXPECT_TRUE(conn->recvMessage(receivedMsg));
+        EXPECT_EQ(receivedMsg.type, READ_LOCK);
+        EXPECT_EQ(receivedMsg.id, 123);
+
+        Message responseMsg{};
+        responseMsg.type = READ_LOCK;
+        responseMsg.id = 123;
+        responseMsg.emp.num = 123;
+        strcpy_s(responseMsg.emp.name, "Test Employee");
+        responseMsg.emp.hours = 40.5;
+        EXPECT_TRUE(conn->sendMessage(responseMsg));
+    });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+
+    Message sendMsg{};
+    sendMsg.type = READ_LOCK;
+    sendMsg.id = 123;
+    EXPECT_TRUE(client.sendMessage(sendMsg));
+
+    Message receivedMsg;
+    EXPECT_TRUE(client.recvMessage(receivedMsg));
+    EXPECT_EQ(receivedMsg.type, READ_LOCK);
+    EXPECT_EQ(receivedMsg.id, 123);
+    EXPECT_STREQ(receivedMsg.emp.name, "Test Employee");
+    EXPECT_EQ(receivedMsg.emp.hours, 40.5);
+
+    serverThread.join();
+    listener.close();
+}
+
+TEST(PipeClientTest, PeerCloseTest) {
+    const std::string path = "/tmp/TestEmployeePipe3.sock";
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    std::thread serverThread([&]() {
+        std::unique_ptr<Transport> conn = listener.accept();
+        conn->close();
+    });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    serverThread.join();
+
+    Message msg;
+    EXPECT_FALSE(client.recvMessage(msg));
+    listener.close();
+}
+
+TEST(PipeClientTest, OutOfOrderResponses) {
+    const std::string path = "/tmp/TestEmployeePipe4.sock";
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    std::thread serverThread([&]() {
+        std::unique_ptr<Transport> conn = listener.accept();
+        Message first, second;
+        ASSERT_TRUE(conn->recvMessage(first));
+        ASSERT_TRUE(conn->recvMessage(second));
+        EXPECT_NE(first.reqId, second.reqId);
+        conn->sendMessage(second);
+        conn->sendMessage(first);
+    });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    uint32_t a = client.submit({READ_LOCK, 10});
+    uint32_t b = client.submit({READ_LOCK, 20});
+    ASSERT_NE(a, 0u);
+    ASSERT_NE(b, 0u);
+
+    Message resp;
+    ASSERT_TRUE(client.waitResponse(a, resp));
+    EXPECT_EQ(resp.id, 10);
+    EXPECT_EQ(client.early.size(), 1u);
+    ASSERT_TRUE(client.waitResponse(b, resp));
+    EXPECT_EQ(resp.id, 20);
+    EXPECT_TRUE(client.early.empty());
+
+    serverThread.join();
+    listener.close();
+}
+
+TEST(PipeClientTest, BatchArrivesAsSeparateMessages) {
+    const std::string path = "/tmp/TestEmployeePipe5.sock";
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    std::unique_ptr<Transport> conn = listener.accept();
+    ASSERT_NE(conn, nullptr);
+
+    Message batch[3] = { {READ_LOCK, 1}, {READ_LOCK, 2}, {UNLOCK, 1} };
+    ASSERT_TRUE(client.sendBatch(batch, 3));
+
+    Message msg;
+    for (const Message& expected : batch) {
+        ASSERT_TRUE(conn->recvMessage(msg));
+        EXPECT_EQ(msg.type, expected.type);
+        EXPECT_EQ(msg.id, expected.id);
+    }
+    listener.close();
+}
+
+TEST(PipeClientTest, AsyncFuturesAndCallbacks) {
+    const std::string path = "/tmp/TestEmployeePipe6.sock";
+    const int requests = 200;
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    std::thread serverThread([&]() {
+        std::unique_ptr<Transport> conn = listener.accept();
+        Message msg;
+        for (int i = 0; i <= requests && conn->recvMessage(msg); ++i) {
+            conn->sendMessage(msg);
+        }
+    });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    ASSERT_TRUE(client.startAsync());
+
+    std::vector<std::future<Message>> futures;
+    for (int i = 0; i < requests; ++i) {
+        futures.push_back(client.submitAsync(Message{READ_LOCK, i}));
+    }
+    std::promise<int> lastId;
+    ASSERT_TRUE(client.submitAsync({READ_LOCK, -7}, [&](bool ok, const Message& resp) {
+        lastId.set_value(ok ? resp.id : 0);
+    }));
+
+    for (int i = 0; i < requests; ++i) {
+        EXPECT_EQ(futures[i].get().id, i);
+    }
+    EXPECT_EQ(lastId.get_future().get(), -7);
+
+    serverThread.join();
+    client.close();
+    listener.close();
+}
+
+TEST(PipeClientTest, AsyncFailsPendingOnDisconnect) {
+    const std::string path = "/tmp/TestEmployeePipe7.sock";
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+
+    std::thread serverThread([&]() {
+        std::unique_ptr<Transport> conn = listener.accept();
+        Message msg;
+        conn->recvMessage(msg);
+        conn->close();
+    });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    ASSERT_TRUE(client.startAsync());
+
+    std::promise<bool> outcome;
+    ASSERT_TRUE(client.submitAsync({READ_LOCK, 1}, [&](bool ok, const Message&) {
+        outcome.set_value(ok);
+    }));
+    EXPECT_FALSE(outcome.get_future().get());
+
+    std::future<Message> late = client.submitAsync(Message{READ_LOCK, 2});
+    EXPECT_THROW(late.get(), std::future_error);
+
+    serverThread.join();
+    client.close();
+    listener.close();
+}
+#endif
+
+#ifdef __linux__
+static void exchangeOverShm(ShmWaitMode mode) {
+    const std::string name = "/TestEmployeeShm." + std::to_string(mode);
+    ShmTransport clientSide;
+    ASSERT_TRUE(clientSide.create(name, mode));
+    ShmTransport serverSide;
+    ASSERT_TRUE(serverSide.open(name, mode));
+    clientSide.unlink();
+
+    const int count = 1000;
+    std::thread server([&]() {
+        Message msg;
+        for (int i = 0; i < count; ++i) {
+            ASSERT_TRUE(serverSide.recvMessage(msg));
+            msg.type = READ_LOCK;
+            msg.emp.num = msg.id;
+            ASSERT_TRUE(serverSide.sendMessage(msg));
+        }
+    });
+
+    for (int i = 0; i < count; ++i) {
+        Message req{};
+        req.type = READ_LOCK;
+        req.id = i;
+        ASSERT_TRUE(clientSide.sendMessage(req));
+        Message resp;
+        ASSERT_TRUE(clientSide.recvMessage(resp));
+        EXPECT_EQ(resp.emp.num, i);
+    }
+    server.join();
+
+    clientSide.close();
+    Message msg;
+    EXPECT_FALSE(serverSide.recvMessage(msg));
+}
+
+TEST(ShmTransportTest, RoundTripFutex) {
+    exchangeOverShm(SHM_WAIT_FUTEX);
+}
+
+TEST(ShmTransportTest, RoundTripBusyPoll) {
+    exchangeOverShm(SHM_WAIT_BUSY_POLL);
+}
+
+TEST(ShmTransportTest, RingWrapsWithoutLoss) {
+    const std::string name = "/TestEmployeeShm.wrap";
+    ShmTransport clientSide;
+    ASSERT_TRUE(clientSide.create(name, SHM_WAIT_FUTEX));
+    ShmTransport serverSide;
+    ASSERT_TRUE(serverSide.open(name, SHM_WAIT_FUTEX));
+    clientSide.unlink();
+
+    const int count = SHM_RING_SLOTS * 10;
+    std::thread producer([&]() {
+        for (int i = 0; i < count; ++i) {
+            Message msg{};
+            msg.id = i;
+            ASSERT_TRUE(clientSide.sendMessage(msg));
+        }
+    });
+    for (int i = 0; i < count; ++i) {
+        Message msg;
+        ASSERT_TRUE(serverSide.recvMessage(msg));
+        EXPECT_EQ(msg.id, i);
+    }
+    producer.join();
+}
+
+TEST(ShmTransportTest, OpenMissingSegmentFails) {
+    ShmTransport t;
+    EXPECT_FALSE(t.open("/TestEmployeeShm.missing", SHM_WAIT_FUTEX));
+}
+#endif
 
 TEST(PipeClientTest, SimpleCreationTest) {
     {
@@ -247,7 +534,8 @@ TEST(PipeClientTest, SimpleCreationTest) {
 }
 
 TEST(PipeClientTest, MessageStructSize) {
-    EXPECT_EQ(sizeof(Message), sizeof(int) * 2 + sizeof(Employee));
+    EXPECT_EQ(offsetof(Message, reqId), sizeof(int) * 2);
+    EXPECT_EQ(sizeof(Message), offsetof(Message, emp) + sizeof(Employee));
     SUCCEED();
 }
 
@@ -255,6 +543,7 @@ TEST(PipeClientTest, ZeroInitialization) {
     Message msg = {};
     EXPECT_EQ(msg.type, 0);
     EXPECT_EQ(msg.id, 0);
+    EXPECT_EQ(msg.reqId, 0u);
     EXPECT_EQ(msg.emp.num, 0);
     EXPECT_EQ(msg.emp.name[0], 0);
     EXPECT_EQ(msg.emp.hours, 0.0);
@@ -293,7 +582,11 @@ TEST(PipeClientTest, PipeClientConstructor) {
     PipeClient client(pipeName);
     
     EXPECT_EQ(client.pipeName, pipeName);
+#ifdef _WIN32
     EXPECT_EQ(client.hPipe, INVALID_HANDLE_VALUE);
+#else
+    EXPECT_EQ(client.fd, -1);
+#endif
 }
 
 TEST(PipeClientTest, PipeClientDestructor) {
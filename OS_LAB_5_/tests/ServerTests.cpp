@@ -3,10 +3,27 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <future>
+#include <climits>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#ifdef __linux__
+#include "Server/CoroutineServer.h"
+#include "Server/EpollServer.h"
+#include "Server/SocketListener.h"
+#include "Client/PipeClient.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#endif
 #include "Server/RecordManager.h"
+#include "Server/RecordShards.h"
 #include "Server/ServerApp.h"
 #include "common/Employee.h"
+#include "common/Platform.h"
 
 TEST(RecordManagerTest, BasicOperations) {
     const std::string testFile = "test_employees.bin";
@@ -21,8 +38,8 @@ TEST(RecordManagerTest, BasicOperations) {
     testEmp.hours = 40.5;
     
     manager.records = {testEmp};
-    manager.idToIndex[1] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(1, 0);
+    manager.recordLocks.resize(1);
     
     Employee readEmp;
     bool found = manager.readRecordById(1, readEmp);
@@ -54,9 +71,9 @@ TEST(RecordManagerTest, IndexManagementTest) {
     
     manager.records = employees;
     for (size_t i = 0; i < employees.size(); i++) {
-        manager.idToIndex[employees[i].num] = i;
-        manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+        manager.idToIndex.insert(employees[i].num, i);
     }
+    manager.recordLocks.resize(employees.size());
     
     size_t idx;
     
@@ -81,8 +98,8 @@ TEST(RecordManagerTest, LockingMechanismTest) {
     
     Employee emp{1, "Test", 0.0};
     manager.records = {emp};
-    manager.idToIndex[1] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(1, 0);
+    manager.recordLocks.resize(1);
     
     bool lockResult = manager.lockRecord(1, false);
     EXPECT_TRUE(lockResult);
@@ -122,8 +139,8 @@ TEST(RecordManagerTest, SimpleConcurrentAccess) {
     
     Employee emp{1, "Concurrent", 0.0};
     manager.records = {emp};
-    manager.idToIndex[1] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(1, 0);
+    manager.recordLocks.resize(1);
     
     std::atomic<int> successCount{0};
     
@@ -193,8 +210,8 @@ TEST(RecordManagerTest, SingleRecord) {
     
     Employee emp{1, "Single", 8.0};
     manager.records = {emp};
-    manager.idToIndex[1] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(1, 0);
+    manager.recordLocks.resize(1);
     
     size_t idx;
     bool found = manager.getIndexForId(1, idx);
@@ -213,9 +230,9 @@ TEST(RecordManagerTest, MultipleRecords) {
     
     manager.records = employees;
     for (size_t i = 0; i < employees.size(); i++) {
-        manager.idToIndex[employees[i].num] = i;
-        manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+        manager.idToIndex.insert(employees[i].num, i);
     }
+    manager.recordLocks.resize(employees.size());
     
     EXPECT_EQ(manager.records.size(), 3);
     EXPECT_EQ(manager.idToIndex.size(), 3);
@@ -227,8 +244,8 @@ TEST(RecordManagerTest, FindNonExistentRecord) {
     
     Employee emp{1, "Test", 5.0};
     manager.records = {emp};
-    manager.idToIndex[1] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(1, 0);
+    manager.recordLocks.resize(1);
     
     size_t idx;
     bool found = manager.getIndexForId(999, idx);
@@ -246,13 +263,17 @@ TEST(RecordManagerTest, IndexConsistency) {
     
     manager.records = employees;
     for (size_t i = 0; i < employees.size(); i++) {
-        manager.idToIndex[employees[i].num] = i;
-        manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+        manager.idToIndex.insert(employees[i].num, i);
     }
+    manager.recordLocks.resize(employees.size());
     
-    EXPECT_EQ(manager.idToIndex[100], 0);
-    EXPECT_EQ(manager.idToIndex[200], 1);
-    EXPECT_EQ(manager.idToIndex[300], 2);
+    size_t idx;
+    ASSERT_TRUE(manager.idToIndex.find(100, idx));
+    EXPECT_EQ(idx, 0);
+    ASSERT_TRUE(manager.idToIndex.find(200, idx));
+    EXPECT_EQ(idx, 1);
+    ASSERT_TRUE(manager.idToIndex.find(300, idx));
+    EXPECT_EQ(idx, 2);
 }
 
 TEST(RecordManagerTest, UpdateRecord) {
@@ -260,8 +281,8 @@ TEST(RecordManagerTest, UpdateRecord) {
     
     Employee emp{1, "Old", 10.0};
     manager.records = {emp};
-    manager.idToIndex[1] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(1, 0);
+    manager.recordLocks.resize(1);
     
     Employee updated{1, "New", 20.0};
     manager.records[0] = updated;
@@ -275,8 +296,8 @@ TEST(RecordManagerTest, ReadRecordById) {
     
     Employee emp{42, "Answer", 42.0};
     manager.records = {emp};
-    manager.idToIndex[42] = 0;
-    manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+    manager.idToIndex.insert(42, 0);
+    manager.recordLocks.resize(1);
     
     Employee result;
     bool found = manager.readRecordById(42, result);
@@ -293,13 +314,11 @@ TEST(RecordManagerTest, CreateLocks) {
     std::vector<Employee> employees(5);
     manager.records = employees;
     
-    for (size_t i = 0; i < employees.size(); i++) {
-        manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
-    }
+    manager.recordLocks.resize(employees.size());
     
     EXPECT_EQ(manager.recordLocks.size(), 5);
-    for (const auto& lock : manager.recordLocks) {
-        EXPECT_NE(lock, nullptr);
+    for (size_t i = 0; i < employees.size(); i++) {
+        EXPECT_TRUE(manager.recordLocks.tryLock(i, true));
     }
 }
 
@@ -322,8 +341,8 @@ TEST(RecordManagerTest, IndexAfterUpdate) {
     };
     
     manager.records = employees;
-    manager.idToIndex[1] = 0;
-    manager.idToIndex[2] = 1;
+    manager.idToIndex.insert(1, 0);
+    manager.idToIndex.insert(2, 1);
     
     Employee updated{1, "A Updated", 10.0};
     manager.records[0] = updated;
@@ -343,7 +362,7 @@ TEST(RecordManagerTest, EmployeeInRecordManager) {
     emp.hours = 8.5;
     
     manager.records = {emp};
-    manager.idToIndex[123] = 0;
+    manager.idToIndex.insert(123, 0);
     
     EXPECT_EQ(manager.records[0].num, 123);
     EXPECT_STREQ(manager.records[0].name, "Test Employee");
@@ -357,7 +376,7 @@ TEST(RecordManagerTest, RecordIdentity) {
     Employee emp2{1, "Same", 10.0};
     
     manager.records = {emp1};
-    manager.idToIndex[1] = 0;
+    manager.idToIndex.insert(1, 0);
     
     EXPECT_EQ(manager.records[0].num, emp2.num);
     EXPECT_STREQ(manager.records[0].name, emp2.name);
@@ -371,11 +390,2713 @@ TEST(RecordManagerTest, ContainerSizes) {
     manager.records = employees;
     
     for (size_t i = 0; i < employees.size(); i++) {
-        manager.idToIndex[i] = i;
-        manager.recordLocks.push_back(std::make_unique<std::shared_mutex>());
+        manager.idToIndex.insert(i, i);
     }
+    manager.recordLocks.resize(employees.size());
     
     EXPECT_EQ(manager.records.size(), 10);
     EXPECT_EQ(manager.idToIndex.size(), 10);
     EXPECT_EQ(manager.recordLocks.size(), 10);
-}
\ No newline at end of file
+}
+
+static void checkLockSemantics(LockTable& locks) {
+    locks.resize(4);
+    EXPECT_TRUE(locks.tryLock(0, false));
+    EXPECT_TRUE(locks.tryLock(0, false));
+    EXPECT_FALSE(locks.tryLock(0, true));
+    EXPECT_TRUE(locks.tryLock(1, true));
+    EXPECT_FALSE(locks.tryLock(1, false));
+    EXPECT_TRUE(locks.tryLock(2, true));
+
+    // Stray unlocks in the wrong mode are ignored.
+    locks.unlock(1, false);
+    locks.unlock(3, true);
+    EXPECT_FALSE(locks.tryLock(1, false));
+
+    std::atomic<bool> acquired{false};
+    std::thread writer([&]() {
+        locks.lock(0, true);
+        acquired = true;
+        locks.unlock(0, true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(acquired);
+    locks.unlock(0, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(acquired);
+    locks.unlock(0, false);
+    writer.join();
+    EXPECT_TRUE(acquired);
+
+    locks.unlock(1, true);
+    locks.unlock(2, true);
+    for (size_t i = 0; i < 4; ++i) {
+        EXPECT_TRUE(locks.tryLock(i, true));
+    }
+}
+
+TEST(LockTableTest, PerRecordWords) {
+    LockTable locks;
+    checkLockSemantics(locks);
+    EXPECT_FALSE(locks.striped());
+}
+
+TEST(LockTableTest, StripedKeepsRecordsIndependent) {
+    LockTable locks;
+    locks.useStripes(1);
+    checkLockSemantics(locks);
+    EXPECT_TRUE(locks.striped());
+}
+
+TEST(LockTableTest, ManyThreadsKeepWritersExclusive) {
+    for (size_t stripes : {size_t(0), size_t(2)}) {
+        LockTable locks;
+        if (stripes) locks.useStripes(stripes);
+        locks.resize(8);
+        std::vector<int> counters(8, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < 2000; ++i) {
+                    size_t idx = (i + t) % 8;
+                    locks.lock(idx, true);
+                    ++counters[idx];
+                    locks.unlock(idx, true);
+                    locks.lock(idx, false);
+                    locks.unlock(idx, false);
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        int total = 0;
+        for (int c : counters) total += c;
+        EXPECT_EQ(total, 4 * 2000);
+    }
+}
+
+TEST(LockWaitsTest, WakesOnReleaseDeadlineOrAtOnce) {
+    LockWaits waits;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> woken;
+    auto wakeWith = [&](int tag) {
+        return [&, tag]() {
+            std::lock_guard<std::mutex> lk(mutex);
+            woken.push_back(tag);
+            cv.notify_all();
+        };
+    };
+    auto waitFor = [&](size_t n) {
+        std::unique_lock<std::mutex> lk(mutex);
+        return cv.wait_for(lk, std::chrono::seconds(5), [&]() { return woken.size() >= n; });
+    };
+    int owner = 0;
+    int other = 0;
+
+    waits.wait(7, &owner, NO_LOCK_DEADLINE, wakeWith(1), []() { return false; });
+    waits.wait(7, &owner, NO_LOCK_DEADLINE, wakeWith(2), []() { return false; });
+    waits.wait(8, &owner, NO_LOCK_DEADLINE, wakeWith(3), []() { return false; });
+    EXPECT_EQ(waits.waiting(), 3u);
+    waits.released(7);
+    ASSERT_TRUE(waitFor(2));
+    EXPECT_EQ(woken, std::vector<int>({1, 2}));
+    EXPECT_EQ(waits.waiting(), 1u);
+
+    // Free already: woken without a release.
+    waits.wait(9, &owner, NO_LOCK_DEADLINE, wakeWith(4), []() { return true; });
+    ASSERT_TRUE(waitFor(3));
+    EXPECT_EQ(woken.back(), 4);
+
+    auto start = std::chrono::steady_clock::now();
+    waits.wait(10, &owner, start + std::chrono::milliseconds(30), wakeWith(5), []() { return false; });
+    ASSERT_TRUE(waitFor(4));
+    EXPECT_EQ(woken.back(), 5);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(30));
+    // The expired waiter is not woken a second time.
+    waits.released(10);
+
+    waits.wait(11, &other, NO_LOCK_DEADLINE, wakeWith(6), []() { return false; });
+    waits.cancel(&other);
+    waits.released(11);
+    waits.released(8);
+    ASSERT_TRUE(waitFor(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(woken, std::vector<int>({1, 2, 4, 5, 3}));
+    EXPECT_EQ(waits.waiting(), 0u);
+}
+
+TEST(WorkStealingPoolTest, RunsEveryTaskAndStealsFromBusyWorkers) {
+    std::atomic<int> ran{0};
+    {
+        WorkStealingPool pool(4);
+        EXPECT_EQ(pool.size(), 4u);
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&]() {
+                for (int j = 0; j < 10; ++j) pool.submit([&]() { ran++; });
+                ran++;
+            });
+        }
+    }
+    EXPECT_EQ(ran, 1100);
+
+    // A task queued by a worker that then stays busy is run by another one.
+    WorkStealingPool pool(2);
+    std::promise<std::thread::id> stolenBy;
+    std::promise<bool> done;
+    pool.submit([&]() {
+        std::future<std::thread::id> f = stolenBy.get_future();
+        pool.submit([&]() { stolenBy.set_value(std::this_thread::get_id()); });
+        bool ready = f.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+        done.set_value(ready && f.get() != std::this_thread::get_id());
+    });
+    EXPECT_TRUE(done.get_future().get());
+}
+
+static RecordManager* makeManager(const std::string& file, const std::vector<Employee>& employees) {
+    RecordManager* manager = new RecordManager(file);
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    for (const auto& e : employees) {
+        out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+    }
+    manager->records = employees;
+    for (size_t i = 0; i < employees.size(); i++) {
+        manager->idToIndex.insert(employees[i].num, i);
+    }
+    manager->recordLocks.resize(employees.size());
+    return manager;
+}
+
+TEST(ServerAppTest, ProcessRequestLifecycle) {
+    const std::string testFile = "test_process.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+    Session session;
+    Message resp;
+
+    EXPECT_EQ(server.processRequest(session, {WRITE_LOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_STREQ(resp.emp.name, "One");
+
+    Employee updated{1, "Updated", 5.0};
+    EXPECT_EQ(server.processRequest(session, {WRITE_UPDATE, 1, 0, updated}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+
+    Session other;
+    EXPECT_EQ(server.processRequest(other, {READ_LOCK, 1}, resp, false), REQUEST_BLOCKED);
+    EXPECT_EQ(server.processRequest(other, {WRITE_LOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    // Another session's lock cannot be released.
+    EXPECT_EQ(server.processRequest(other, {UNLOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_EQ(server.processRequest(other, {READ_LOCK, 1}, resp, false), REQUEST_BLOCKED);
+
+    EXPECT_EQ(server.processRequest(session, {UNLOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_EQ(server.processRequest(other, {READ_LOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_STREQ(resp.emp.name, "Updated");
+
+    EXPECT_EQ(server.processRequest(other, {READ_LOCK, 999}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_EQ(server.processRequest(other, {CLIENT_EXIT, 0}, resp, false), REQUEST_CLOSE);
+
+    server.endSession(other);
+    EXPECT_TRUE(other.heldLocks.empty());
+    EXPECT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    server.manager->unlockRecord(1, true);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, OptimisticReadHoldsNoLock) {
+    const std::string testFile = "test_optimistic.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+    Session writer;
+    Session reader;
+    Message resp;
+
+    ASSERT_EQ(server.processRequest(writer, {WRITE_LOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(server.processRequest(reader, {READ_OPTIMISTIC, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_STREQ(resp.emp.name, "One");
+
+    Employee updated{1, "Updated", 5.0};
+    ASSERT_EQ(server.processRequest(writer, {WRITE_UPDATE, 1, 0, updated}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(server.processRequest(reader, {READ_OPTIMISTIC, 1}, resp, false), REQUEST_DONE);
+    EXPECT_STREQ(resp.emp.name, "Updated");
+    EXPECT_TRUE(reader.heldLocks.empty());
+    EXPECT_EQ(server.processRequest(reader, {READ_OPTIMISTIC, 999}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+
+    // A write caught in progress sends the read to the shared lock, which
+    // the writer still holds.
+    server.manager->recordLocks.versions[0].fetch_add(1);
+    EXPECT_EQ(server.processRequest(reader, {READ_OPTIMISTIC, 1}, resp, false), REQUEST_BLOCKED);
+    server.manager->recordLocks.versions[0].fetch_add(1);
+    EXPECT_EQ(server.processRequest(writer, {UNLOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    server.manager->unlockRecord(1, true);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, OptimisticReadsAreNeverTorn) {
+    const std::string testFile = "test_seqlock.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "aaaa", 0.0}});
+    std::atomic<bool> stop{false};
+
+    std::thread writer([&]() {
+        Employee e{1, "", 0.0};
+        for (int i = 0; i < 20000; ++i) {
+            char c = static_cast<char>('a' + i % 26);
+            std::memset(e.name, c, sizeof(e.name) - 1);
+            e.hours = c;
+            manager->storeRecord(0, e);
+        }
+        stop = true;
+    });
+
+    int torn = 0;
+    int reads = 0;
+    while (!stop || reads == 0) {
+        Employee e;
+        LockResult r = manager->readRecordOptimistic(1, e);
+        ASSERT_NE(r, LOCK_NOT_FOUND);
+        if (r != LOCK_OK) continue;
+        ++reads;
+        if (e.name[0] != static_cast<char>(e.hours) && e.hours != 0.0) ++torn;
+        for (size_t i = 1; i + 1 < sizeof(e.name) && e.hours != 0.0; ++i) {
+            if (e.name[i] != e.name[0]) {
+                ++torn;
+                break;
+            }
+        }
+    }
+    writer.join();
+    EXPECT_EQ(torn, 0);
+    EXPECT_GT(reads, 0);
+    EXPECT_EQ(manager->recordLocks.version(0), 2u * 20000);
+
+    delete manager;
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, EndSessionReleasesWriteLock) {
+    const std::string testFile = "test_end_session.bin";
+    ServerApp server(makeManager(testFile, {{7, "Seven", 7.0}}));
+    Session session;
+    Message resp;
+
+    server.processRequest(session, {WRITE_LOCK, 7}, resp, false);
+    EXPECT_EQ(resp.id, 7);
+    server.endSession(session);
+
+    Session next;
+    server.processRequest(next, {WRITE_LOCK, 7}, resp, false);
+    EXPECT_EQ(resp.id, 7);
+    server.endSession(next);
+
+    std::remove(testFile.c_str());
+}
+
+static Employee readFromFile(const std::string& file, size_t idx) {
+    Employee e{};
+    std::ifstream in(file, std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(idx * sizeof(Employee)));
+    in.read(reinterpret_cast<char*>(&e), sizeof(e));
+    return e;
+}
+
+TEST(RecordManagerTest, MappedStorageBuildsIndexFromFile) {
+    const std::string testFile = "test_mapped.bin";
+    delete makeManager(testFile, {{10, "Ten", 1.0}, {20, "Twenty", 2.0}, {30, "Thirty", 3.0}});
+
+    RecordManager manager(testFile);
+    ASSERT_TRUE(manager.useMappedStorage(SYNC_PER_WRITE));
+    EXPECT_TRUE(manager.records.empty());
+    EXPECT_EQ(manager.idToIndex.size(), 3u);
+    EXPECT_EQ(manager.recordLocks.size(), 3u);
+
+    Employee e;
+    ASSERT_TRUE(manager.readRecordById(20, e));
+    EXPECT_STREQ(e.name, "Twenty");
+
+    Employee updated{20, "Updated", 7.5};
+    ASSERT_TRUE(manager.writeRecord(updated));
+    EXPECT_STREQ(manager.recordAt(1).name, "Updated");
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Updated");
+
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, MappedStorageSyncPolicies) {
+    const std::string testFile = "test_mapped_sync.bin";
+    for (SyncPolicy policy : { SYNC_PERIODIC, SYNC_ON_SHUTDOWN }) {
+        RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}});
+        ASSERT_TRUE(manager->useMappedStorage(policy, 10));
+        EXPECT_TRUE(manager->records.empty());
+
+        Employee updated{2, "Synced", 2.5};
+        ASSERT_TRUE(manager->writeRecord(updated));
+        Employee e;
+        ASSERT_TRUE(manager->readRecordById(2, e));
+        EXPECT_STREQ(e.name, "Synced");
+        delete manager;
+
+        Employee onDisk = readFromFile(testFile, 1);
+        EXPECT_STREQ(onDisk.name, "Synced");
+        EXPECT_EQ(onDisk.hours, 2.5);
+    }
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, MappedStorageRejectsMismatchedFile) {
+    const std::string testFile = "test_mapped_mismatch.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}});
+    Employee extra{2, "Two", 2.0};
+    manager->records.push_back(extra);
+
+    EXPECT_FALSE(manager->useMappedStorage(SYNC_PER_WRITE));
+    EXPECT_EQ(manager->mapped, nullptr);
+    EXPECT_EQ(manager->records.size(), 2u);
+
+    delete manager;
+    std::remove(testFile.c_str());
+}
+
+static std::string readWholeFile(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+#ifdef __linux__
+// A server started without records still maps its file and grows it.
+TEST(RecordManagerTest, MappedStorageStartsFromEmptyFile) {
+    const std::string testFile = "test_mapped_empty.bin";
+    {
+        std::unique_ptr<RecordManager> manager(makeManager(testFile, {}));
+        ASSERT_TRUE(manager->useMappedStorage(SYNC_PER_WRITE));
+        ASSERT_NE(manager->mapped, nullptr);
+        EXPECT_EQ(manager->mapped->size.load(), 0u);
+        EXPECT_EQ(manager->idToIndex.size(), 0u);
+
+        Employee first{7, "First", 1.5};
+        ASSERT_TRUE(manager->createRecord(first));
+        Employee e;
+        ASSERT_TRUE(manager->readRecordById(7, e));
+        EXPECT_STREQ(e.name, "First");
+        EXPECT_EQ(manager->mapped->size.load(), sizeof(Employee));
+    }
+    EXPECT_EQ(readWholeFile(testFile).size(), sizeof(Employee));
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "First");
+    std::remove(testFile.c_str());
+}
+#endif
+
+TEST(WriteAheadLogTest, ConcurrentWritesShareOneSync) {
+    const std::string testFile = "test_wal_group.bin";
+    const int writers = 6;
+    std::vector<Employee> employees;
+    for (int i = 0; i < writers; ++i) {
+        employees.push_back({i + 1, "Worker", 1.0});
+    }
+    RecordManager* manager = makeManager(testFile, employees);
+    ASSERT_TRUE(manager->enableWriteAheadLog(0));
+    WriteAheadLog& wal = *manager->wal;
+
+    // Hold leadership so every writer queues behind the same flush.
+    {
+        std::lock_guard<std::mutex> lk(wal.mutex);
+        wal.flushing = true;
+    }
+    std::vector<std::thread> threads;
+    std::atomic<int> succeeded{0};
+    for (int i = 0; i < writers; ++i) {
+        threads.emplace_back([&, i]() {
+            Employee e{i + 1, "Logged", 10.0 + i};
+            if (manager->writeRecord(e)) succeeded++;
+        });
+    }
+    while (true) {
+        std::lock_guard<std::mutex> lk(wal.mutex);
+        if (wal.pending.size() == static_cast<size_t>(writers)) break;
+    }
+    {
+        std::lock_guard<std::mutex> lk(wal.mutex);
+        wal.flushing = false;
+    }
+    wal.flushed.notify_all();
+    for (auto& t : threads) t.join();
+
+    EXPECT_EQ(succeeded, writers);
+    EXPECT_EQ(wal.syncCount, 1u);
+    EXPECT_EQ(wal.durableLsn, static_cast<uint64_t>(writers));
+
+    delete manager;
+    EXPECT_STREQ(readFromFile(testFile, writers - 1).name, "Logged");
+    EXPECT_EQ(readFromFile(testFile, writers - 1).hours, 10.0 + writers - 1);
+    EXPECT_FALSE(std::ifstream(testFile + ".wal").good());
+    std::remove(testFile.c_str());
+}
+
+TEST(WriteAheadLogTest, CheckpointRotatesLog) {
+    const std::string testFile = "test_wal_checkpoint.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}});
+    ASSERT_TRUE(manager->enableWriteAheadLog(0));
+
+    Employee updated{2, "Checked", 3.0};
+    ASSERT_TRUE(manager->writeRecord(updated));
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Two");
+    EXPECT_EQ(readWholeFile(testFile + ".wal").size(), sizeof(WalRecord));
+
+    ASSERT_TRUE(manager->wal->checkpoint());
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Checked");
+    EXPECT_TRUE(readWholeFile(testFile + ".wal").empty());
+    EXPECT_FALSE(std::ifstream(testFile + ".wal.old").good());
+
+    delete manager;
+    std::remove(testFile.c_str());
+}
+
+// Mapped pages could reach the data file before the log does, so the two
+// are never used together, whichever comes first.
+TEST(WriteAheadLogTest, NotCombinedWithMappedStorage) {
+    const std::string testFile = "test_wal_mapped.bin";
+    {
+        std::unique_ptr<RecordManager> manager(makeManager(testFile, {{1, "One", 1.0}}));
+        ASSERT_TRUE(manager->enableWriteAheadLog(0));
+        EXPECT_FALSE(manager->useMappedStorage(SYNC_PER_WRITE));
+        EXPECT_EQ(manager->mapped, nullptr);
+        ASSERT_TRUE(manager->writeRecord({1, "Logged", 2.0}));
+        EXPECT_STREQ(readFromFile(testFile, 0).name, "One");
+    }
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "Logged");
+    {
+        RecordManager manager(testFile);
+        ASSERT_TRUE(manager.useMappedStorage(SYNC_PER_WRITE));
+        EXPECT_FALSE(manager.enableWriteAheadLog(0));
+        EXPECT_EQ(manager.wal, nullptr);
+        EXPECT_FALSE(std::ifstream(testFile + ".wal").good());
+    }
+    std::remove(testFile.c_str());
+}
+
+// A checkpoint that comes between two flushes leaves a queued record alone:
+// its log record is not written yet.
+TEST(WriteAheadLogTest, CheckpointSkipsRecordsNotYetLogged) {
+    const std::string testFile = "test_wal_pending.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}});
+    ASSERT_TRUE(manager->enableWriteAheadLog(0));
+    WriteAheadLog& wal = *manager->wal;
+    ASSERT_TRUE(manager->writeRecord({2, "Durable", 2.5}));
+
+    {
+        std::lock_guard<std::mutex> lk(wal.mutex);
+        wal.flushing = true;
+    }
+    std::atomic<bool> written{false};
+    std::thread writer([&]() { written = manager->writeRecord({1, "Queued", 5.0}); });
+    while (true) {
+        std::lock_guard<std::mutex> lk(wal.mutex);
+        if (!wal.pending.empty()) break;
+    }
+    // The last flush is over and the queued writer has not led one yet.
+    {
+        std::lock_guard<std::mutex> lk(wal.mutex);
+        wal.flushing = false;
+    }
+    ASSERT_TRUE(wal.checkpoint());
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "One");
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Durable");
+
+    wal.flushed.notify_all();
+    writer.join();
+    EXPECT_TRUE(written);
+    EXPECT_EQ(readWholeFile(testFile + ".wal").size(), sizeof(WalRecord));
+    ASSERT_TRUE(wal.checkpoint());
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "Queued");
+
+    delete manager;
+    std::remove(testFile.c_str());
+}
+
+TEST(WriteAheadLogTest, ReplayAfterCrash) {
+    const std::string testFile = "test_wal_replay.bin";
+    const std::vector<Employee> original = {{1, "One", 1.0}, {2, "Two", 2.0}};
+    RecordManager* manager = makeManager(testFile, original);
+    ASSERT_TRUE(manager->enableWriteAheadLog(0));
+
+    Employee first{1, "First", 5.0};
+    Employee second{2, "Second", 6.0};
+    ASSERT_TRUE(manager->writeRecord(first));
+    ASSERT_TRUE(manager->writeRecord(second));
+    std::string log = readWholeFile(testFile + ".wal");
+    ASSERT_EQ(log.size(), 2 * sizeof(WalRecord));
+    delete manager;
+
+    // Put back the pre-checkpoint data file and the log with a torn record.
+    delete makeManager(testFile, original);
+    {
+        std::ofstream out(testFile + ".wal", std::ios::binary | std::ios::trunc);
+        out << log << log.substr(0, sizeof(WalRecord) / 2);
+    }
+
+    RecordManager recovered(testFile);
+    ASSERT_TRUE(recovered.enableWriteAheadLog(0));
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "First");
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Second");
+    EXPECT_EQ(readFromFile(testFile, 1).hours, 6.0);
+    EXPECT_TRUE(readWholeFile(testFile + ".wal").empty());
+
+    recovered.wal.reset();
+    std::remove(testFile.c_str());
+}
+
+static void writeText(const std::string& file, const std::string& text) {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+TEST(WriteAheadLogTest, BatchReplaysWholeOrNotAtAll) {
+    const std::string testFile = "test_wal_batch.bin";
+    const std::vector<Employee> original = {{1, "One", 1.0}, {2, "Two", 2.0}};
+    RecordManager* manager = makeManager(testFile, original);
+    ASSERT_TRUE(manager->enableWriteAheadLog(0));
+
+    ASSERT_TRUE(manager->writeRecord({1, "Single", 3.0}));
+    uint64_t syncs = manager->wal->syncCount;
+    ASSERT_TRUE(manager->writeRecords({{1, "BatchOne", 4.0}, {2, "BatchTwo", 5.0}}));
+    EXPECT_EQ(manager->wal->syncCount, syncs + 1);
+    std::string log = readWholeFile(testFile + ".wal");
+    ASSERT_EQ(log.size(), 3 * sizeof(WalRecord));
+    delete manager;
+
+    // The whole log brings in the batch.
+    delete makeManager(testFile, original);
+    writeText(testFile + ".wal", log);
+    {
+        RecordManager recovered(testFile);
+        ASSERT_TRUE(recovered.enableWriteAheadLog(0));
+        EXPECT_STREQ(readFromFile(testFile, 0).name, "BatchOne");
+        EXPECT_STREQ(readFromFile(testFile, 1).name, "BatchTwo");
+    }
+
+    // Without its last record the batch is left out, its first record too.
+    delete makeManager(testFile, original);
+    writeText(testFile + ".wal", log.substr(0, 2 * sizeof(WalRecord)));
+    {
+        RecordManager recovered(testFile);
+        ASSERT_TRUE(recovered.enableWriteAheadLog(0));
+        EXPECT_STREQ(readFromFile(testFile, 0).name, "Single");
+        EXPECT_STREQ(readFromFile(testFile, 1).name, "Two");
+    }
+    std::remove(testFile.c_str());
+}
+
+TEST(BulkImportTest, CsvParsedInParallelKeepsOrder) {
+    const std::string source = "test_import.csv";
+    const std::string testFile = "test_import.bin";
+    const int count = 20000;
+    std::string csv = "num,name,hours\r\n";
+    for (int i = 0; i < count; ++i) {
+        csv += std::to_string(i * 3 + 1) + ", Emp" + std::to_string(i) + " ," + std::to_string(i % 40) + ".5\r\n";
+        if (i == count / 2) csv += "\n";
+    }
+    writeText(source, csv);
+
+    RecordManager manager(testFile);
+    ASSERT_TRUE(manager.importRecords(source, guessImportFormat(source), 4));
+    ASSERT_EQ(manager.records.size(), static_cast<size_t>(count));
+    EXPECT_EQ(manager.idToIndex.size(), static_cast<size_t>(count));
+    EXPECT_EQ(manager.recordLocks.size(), static_cast<size_t>(count));
+
+    Employee e;
+    ASSERT_TRUE(manager.readRecordById(3 * 12345 + 1, e));
+    EXPECT_STREQ(e.name, "Emp12345");
+    EXPECT_EQ(e.hours, 12345 % 40 + 0.5);
+    EXPECT_EQ(readWholeFile(testFile).size(), count * sizeof(Employee));
+    EXPECT_STREQ(readFromFile(testFile, count - 1).name, ("Emp" + std::to_string(count - 1)).c_str());
+
+    std::remove(source.c_str());
+    std::remove(testFile.c_str());
+}
+
+TEST(BulkImportTest, CsvErrorsAreRejected) {
+    const std::string source = "test_import_bad.csv";
+    const std::string testFile = "test_import_bad.bin";
+    RecordManager manager(testFile);
+
+    writeText(source, "1,One,1\n2,Two,2\n1,Again,3\n");
+    EXPECT_FALSE(manager.importRecords(source, IMPORT_CSV, 2));
+    writeText(source, "1,One,1\n2,Two\n");
+    EXPECT_FALSE(manager.importRecords(source, IMPORT_CSV, 2));
+    writeText(source, "1,One,1\n2,NameThatIsFarTooLongForTheRecord,2\n");
+    EXPECT_FALSE(manager.importRecords(source, IMPORT_CSV, 2));
+    EXPECT_TRUE(manager.records.empty());
+    EXPECT_TRUE(manager.idToIndex.empty());
+
+    std::remove(source.c_str());
+    std::remove(testFile.c_str());
+}
+
+TEST(BulkImportTest, BinaryImport) {
+    const std::string source = "test_import_src.bin";
+    const std::string testFile = "test_import_dst.bin";
+    std::vector<Employee> employees;
+    for (int i = 0; i < 5000; ++i) {
+        Employee e{i + 10, "", static_cast<double>(i)};
+        strcpy_s(e.name, "Binary");
+        employees.push_back(e);
+    }
+    ASSERT_TRUE(writeEmployeeFile(source, employees));
+
+    RecordManager manager(testFile);
+    ASSERT_TRUE(manager.importRecords(source, IMPORT_BINARY, 3));
+    ASSERT_EQ(manager.records.size(), employees.size());
+    Employee e;
+    ASSERT_TRUE(manager.readRecordById(4999 + 10, e));
+    EXPECT_EQ(e.hours, 4999.0);
+    EXPECT_EQ(readWholeFile(source), readWholeFile(testFile));
+
+    writeText(source, "odd size");
+    EXPECT_FALSE(manager.importRecords(source, IMPORT_BINARY));
+    std::remove(source.c_str());
+    std::remove(testFile.c_str());
+}
+
+TEST(WarmStartTest, OpenExistingBuildsIndexInParallel) {
+    const std::string testFile = "test_warm.bin";
+    std::vector<Employee> employees;
+    for (int i = 0; i < 50000; ++i) {
+        employees.push_back({i * 7 + 3, "Warm", static_cast<double>(i)});
+    }
+    ASSERT_TRUE(writeEmployeeFile(testFile, employees));
+
+    RecordManager manager(testFile);
+    ASSERT_TRUE(manager.openExisting(4));
+    ASSERT_EQ(manager.records.size(), employees.size());
+    EXPECT_EQ(manager.idToIndex.size(), employees.size());
+    EXPECT_EQ(manager.recordLocks.size(), employees.size());
+    size_t idx;
+    ASSERT_TRUE(manager.idToIndex.find(7 * 31337 + 3, idx));
+    EXPECT_EQ(idx, 31337u);
+
+    Employee e;
+    ASSERT_TRUE(manager.readRecordById(7 * 49999 + 3, e));
+    EXPECT_EQ(e.hours, 49999.0);
+    e.hours = 1.5;
+    ASSERT_TRUE(manager.writeRecord(e));
+    EXPECT_EQ(readFromFile(testFile, 49999).hours, 1.5);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, CreateAndDeleteReuseSlots) {
+    const std::string testFile = "test_create_delete.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}});
+
+    ASSERT_TRUE(manager->createRecord({3, "Three", 3.0}));
+    EXPECT_FALSE(manager->createRecord({3, "Again", 0.0}));
+    EXPECT_FALSE(manager->createRecord({FREE_RECORD_ID, "Free", 0.0}));
+    EXPECT_EQ(readWholeFile(testFile).size(), 3 * sizeof(Employee));
+    EXPECT_STREQ(readFromFile(testFile, 2).name, "Three");
+
+    ASSERT_TRUE(manager->lockRecord(3, true));
+    ASSERT_TRUE(manager->deleteRecord(3));
+    EXPECT_FALSE(manager->deleteRecord(3));
+    Employee e;
+    EXPECT_FALSE(manager->readRecordById(3, e));
+    EXPECT_EQ(manager->tryLockRecord(3, false), LOCK_NOT_FOUND);
+    EXPECT_EQ(readFromFile(testFile, 2).num, FREE_RECORD_ID);
+    ASSERT_EQ(manager->freeSlots.size(), 1u);
+
+    ASSERT_TRUE(manager->createRecord({4, "Four", 4.0}));
+    EXPECT_TRUE(manager->freeSlots.empty());
+    EXPECT_EQ(readWholeFile(testFile).size(), 3 * sizeof(Employee));
+    EXPECT_EQ(manager->tryLockRecord(4, true), LOCK_OK);
+    manager->unlockRecord(4, true);
+    ASSERT_TRUE(manager->deleteRecord(1));
+    delete manager;
+
+    RecordManager reopened(testFile);
+    ASSERT_TRUE(reopened.openExisting());
+    EXPECT_EQ(reopened.idToIndex.size(), 2u);
+    ASSERT_EQ(reopened.freeSlots.size(), 1u);
+    EXPECT_EQ(reopened.freeSlots[0], 0u);
+    ASSERT_TRUE(reopened.readRecordById(4, e));
+    EXPECT_STREQ(e.name, "Four");
+    EXPECT_FALSE(reopened.readRecordById(1, e));
+
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, CreatesGrowStorageUnderConcurrentReads) {
+    const std::string testFile = "test_create_growth.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}});
+    const int created = 10000;
+    std::atomic<bool> done{false};
+    std::atomic<int> failures{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&]() {
+            Employee e;
+            for (int i = 0; !done || i < 100; ++i) {
+                int id = 1 + i % 2;
+                if (manager->readRecordOptimistic(id, e) != LOCK_OK || e.num != id) ++failures;
+                if (!manager->lockRecord(id, false)) ++failures;
+                manager->unlockRecord(id, false);
+            }
+        });
+    }
+    for (int i = 0; i < created; ++i) {
+        Employee e{100 + i, "New", static_cast<double>(i)};
+        ASSERT_TRUE(manager->createRecord(e));
+        if (i % 3 == 0) ASSERT_TRUE(manager->deleteRecord(100 + i));
+    }
+    done = true;
+    for (auto& t : readers) t.join();
+
+    EXPECT_EQ(failures.load(), 0);
+    EXPECT_EQ(manager->idToIndex.size(), 2u + created - (created + 2) / 3);
+    Employee e;
+    ASSERT_TRUE(manager->readRecordById(100 + created - 2, e));
+    EXPECT_EQ(e.hours, created - 2.0);
+    EXPECT_FALSE(manager->readRecordById(100 + 3, e));
+
+    delete manager;
+    std::remove(testFile.c_str());
+}
+
+#ifdef __linux__
+TEST(RecordManagerTest, MappedStorageGrowsOnCreate) {
+    const std::string testFile = "test_mmap_create.bin";
+    delete makeManager(testFile, {{1, "One", 1.0}});
+    RecordManager manager(testFile);
+    ASSERT_TRUE(manager.useMappedStorage(SYNC_PER_WRITE));
+
+    for (int i = 2; i <= 200; ++i) {
+        ASSERT_TRUE(manager.createRecord({i, "Mapped", static_cast<double>(i)}));
+    }
+    EXPECT_EQ(readWholeFile(testFile).size(), 200 * sizeof(Employee));
+    EXPECT_EQ(readFromFile(testFile, 199).hours, 200.0);
+    Employee e;
+    ASSERT_TRUE(manager.readRecordById(150, e));
+    EXPECT_STREQ(e.name, "Mapped");
+
+    std::remove(testFile.c_str());
+}
+#endif
+
+TEST(ServerAppTest, DeleteWakesWaitersWithNotFound) {
+    const std::string testFile = "test_delete_session.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+    Session owner;
+    Session waiter;
+    Message resp;
+
+    EXPECT_EQ(server.processRequest(owner, {DELETE_RECORD, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    ASSERT_EQ(server.processRequest(owner, {WRITE_LOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(server.processRequest(waiter, {READ_LOCK, 1}, resp, false), REQUEST_BLOCKED);
+
+    std::thread blocked([&]() {
+        Session s;
+        Message r;
+        server.processRequest(s, {READ_LOCK, 1}, r, true);
+        EXPECT_EQ(r.id, -1);
+        EXPECT_TRUE(s.heldLocks.empty());
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(server.processRequest(owner, {DELETE_RECORD, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_TRUE(owner.heldLocks.empty());
+    blocked.join();
+
+    EXPECT_EQ(server.processRequest(waiter, {READ_LOCK, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    Employee fresh{1, "Reborn", 9.0};
+    EXPECT_EQ(server.processRequest(waiter, {CREATE_RECORD, 0, 0, fresh}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_EQ(server.processRequest(owner, {CREATE_RECORD, 0, 0, fresh}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_EQ(server.processRequest(waiter, {READ_OPTIMISTIC, 1}, resp, false), REQUEST_DONE);
+    EXPECT_STREQ(resp.emp.name, "Reborn");
+    EXPECT_EQ(readWholeFile(testFile).size(), 2 * sizeof(Employee));
+
+    std::remove(testFile.c_str());
+}
+
+static std::vector<int> idsOf(const std::vector<Employee>& rows) {
+    std::vector<int> ids;
+    for (const Employee& e : rows) ids.push_back(e.num);
+    return ids;
+}
+
+TEST(RecordManagerTest, ScansFollowWritesCreatesAndDeletes) {
+    const std::string testFile = "test_scan.bin";
+    std::unique_ptr<RecordManager> manager(makeManager(testFile,
+        {{1, "Anna", 8.0}, {2, "Boris", 4.0}, {3, "Andrei", 6.0}, {4, "Alla", 6.0}}));
+    std::vector<Employee> rows;
+
+    // Without the index every record is read, in the same order.
+    manager->scanByName("An", 0, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 1}));
+    manager->enableScanIndex();
+    manager->scanByName("An", 0, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 1}));
+    manager->scanByName("A", 2, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({4, 3}));
+    manager->scanByHours(5.0, 8.0, 0, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 4, 1}));
+    manager->scanByHours(9.0, 1.0, 0, rows);
+    EXPECT_TRUE(rows.empty());
+
+    ASSERT_TRUE(manager->writeRecord({2, "Anton", 7.0}));
+    Employee created{5, "Andrew", 5.0};
+    ASSERT_TRUE(manager->createRecord(created));
+    ASSERT_TRUE(manager->lockRecord(1, true));
+    ASSERT_TRUE(manager->deleteRecord(1));
+
+    manager->scanByName("An", 0, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 5, 2}));
+    manager->scanByHours(5.0, 8.0, 0, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({5, 3, 4, 2}));
+    EXPECT_EQ(manager->scanIndex.size(), 4u);
+
+    std::vector<Employee> unindexed;
+    manager->scanIndexed = false;
+    manager->scanByHours(5.0, 8.0, 0, unindexed);
+    EXPECT_EQ(idsOf(unindexed), idsOf(rows));
+
+    manager.reset();
+    std::remove(testFile.c_str());
+}
+
+// Records changed behind the index's back: rows that stopped matching are
+// made up for from further in the index, and the rest are ordered by their
+// current keys.
+TEST(RecordManagerTest, LimitedScansRecheckAgainstStaleIndex) {
+    const std::string testFile = "test_scan_stale.bin";
+    std::unique_ptr<RecordManager> manager(
+        makeManager(testFile, {{1, "Aa", 1.0}, {2, "Ab", 2.0}, {3, "Ac", 3.0}, {4, "Ad", 4.0}}));
+    manager->enableScanIndex();
+    std::strcpy(manager->records[0].name, "Zz");
+    manager->records[0].hours = 9.0;
+    std::strcpy(manager->records[1].name, "Ae");
+    manager->records[1].hours = 3.5;
+
+    std::vector<Employee> rows;
+    manager->scanByName("A", 2, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 4}));
+    manager->scanByName("A", 0, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 4, 2}));
+
+    manager->scanByHours(1.0, 5.0, 2, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 2}));
+    manager->scanByHours(1.0, 5.0, 3, rows);
+    EXPECT_EQ(idsOf(rows), std::vector<int>({3, 2, 4}));
+
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, ScanStreamsRowsBeforeEnd) {
+    const std::string testFile = "test_scan_session.bin";
+    ServerApp server(makeManager(testFile, {{1, "Anna", 8.0}, {2, "Boris", 4.0}, {3, "Andrei", 6.0}}));
+    server.manager->enableScanIndex();
+    Session session;
+    Message resp;
+
+    Message byName{SCAN, SCAN_NAME_PREFIX, 7};
+    std::strcpy(byName.emp.name, "An");
+    ASSERT_EQ(server.processRequest(session, byName, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.type, SCAN_END);
+    EXPECT_EQ(resp.reqId, 7u);
+    EXPECT_EQ(resp.id, 2);
+    ASSERT_EQ(session.streamed.size(), 2u);
+    EXPECT_EQ(session.streamed[0].type, SCAN);
+    EXPECT_EQ(session.streamed[0].reqId, 7u);
+    EXPECT_STREQ(session.streamed[0].emp.name, "Andrei");
+    EXPECT_STREQ(session.streamed[1].emp.name, "Anna");
+    session.streamed.clear();
+
+    // Scans take no locks, so a held write lock does not hold them up.
+    ASSERT_EQ(server.processRequest(session, {WRITE_LOCK, 2}, resp, false), REQUEST_DONE);
+    Session other;
+    Message byHours{SCAN, SCAN_HOURS_RANGE};
+    byHours.emp.num = 1;
+    byHours.emp.hours = 4.0;
+    setUpperBound(byHours, 6.0);
+    ASSERT_EQ(server.processRequest(other, byHours, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    ASSERT_EQ(other.streamed.size(), 1u);
+    EXPECT_EQ(other.streamed[0].id, 2);
+    EXPECT_TRUE(other.heldLocks.empty());
+
+    EXPECT_EQ(server.processRequest(other, {SCAN, 99}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.type, SCAN_END);
+    EXPECT_EQ(resp.id, -1);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(ColumnStoreTest, KernelsMatchPlainLoops) {
+    std::vector<double> hours;
+    for (int i = 0; i < 1003; ++i) {
+        hours.push_back(i % 7 == 0 ? std::numeric_limits<double>::quiet_NaN() : (i * 37 % 101) / 4.0);
+    }
+    // Every length exercises a different vector tail.
+    for (size_t n : {0u, 1u, 3u, 8u, 13u, 1003u}) {
+        size_t count = 0, inRange = 0;
+        double sum = 0, mn = 1e300, mx = -1e300;
+        std::vector<size_t> expected(7, 0);
+        for (size_t i = 0; i < n; ++i) {
+            double x = hours[i];
+            if (std::isnan(x)) continue;
+            count++;
+            sum += x;
+            mn = std::min(mn, x);
+            mx = std::max(mx, x);
+            if (x >= 2.5 && x <= 20.0) {
+                inRange++;
+                expected[std::min<size_t>(6, static_cast<size_t>((x - 2.5) * (7 / 17.5)))]++;
+            }
+        }
+
+        HoursSummary s = summarizeHours(hours.data(), n);
+        EXPECT_EQ(s.count, count);
+        EXPECT_NEAR(s.sum, sum, 1e-6);
+        if (count > 0) {
+            EXPECT_EQ(s.min, mn);
+            EXPECT_EQ(s.max, mx);
+        } else {
+            EXPECT_TRUE(std::isnan(s.min));
+        }
+        EXPECT_EQ(countHoursInRange(hours.data(), n, 2.5, 20.0), inRange);
+        std::vector<size_t> buckets(7);
+        histogramHours(hours.data(), n, 2.5, 20.0, buckets);
+        EXPECT_EQ(buckets, expected);
+    }
+
+    std::vector<size_t> one(3);
+    histogramHours(hours.data(), hours.size(), 5.0, 5.0, one);
+    EXPECT_EQ(one[0], countHoursInRange(hours.data(), hours.size(), 5.0, 5.0));
+    histogramHours(hours.data(), hours.size(), 9.0, 1.0, one);
+    EXPECT_EQ(one, std::vector<size_t>(3, 0));
+}
+
+TEST(RecordManagerTest, AggregatesFollowWritesCreatesAndDeletes) {
+    const std::string testFile = "test_columns.bin";
+    std::unique_ptr<RecordManager> manager(makeManager(testFile,
+        {{1, "One", 8.0}, {2, "Two", 4.0}, {3, "Three", 6.0}}));
+    EXPECT_EQ(manager->hoursSummary().sum, 18.0);
+    manager->enableColumnStore();
+    EXPECT_EQ(manager->columns.size(), 3u);
+
+    ASSERT_TRUE(manager->writeRecord({2, "Two", 10.0}));
+    Employee created{4, "Four", 1.0};
+    ASSERT_TRUE(manager->createRecord(created));
+    ASSERT_TRUE(manager->lockRecord(1, true));
+    ASSERT_TRUE(manager->deleteRecord(1));
+
+    HoursSummary s = manager->hoursSummary();
+    EXPECT_EQ(s.count, 3u);
+    EXPECT_EQ(s.sum, 17.0);
+    EXPECT_EQ(s.min, 1.0);
+    EXPECT_EQ(s.max, 10.0);
+    EXPECT_EQ(manager->hoursInRange(5.0, 10.0), 2u);
+    std::vector<size_t> buckets(2);
+    manager->hoursHistogram(0.0, 10.0, buckets);
+    EXPECT_EQ(buckets, std::vector<size_t>({1, 2}));
+
+    // Reused slot: the mirror follows the record, not the old occupant.
+    Employee reused{5, "Five", 2.0};
+    ASSERT_TRUE(manager->createRecord(reused));
+    EXPECT_EQ(manager->columns.nums[0], 5);
+    manager->columnar = false;
+    EXPECT_EQ(manager->hoursSummary().sum, 19.0);
+    manager->columnar = true;
+    EXPECT_EQ(manager->hoursSummary().sum, 19.0);
+
+    manager.reset();
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, AggregateStreamsHistogramBuckets) {
+    const std::string testFile = "test_aggregate.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}, {3, "Three", 9.0}}));
+    server.manager->enableColumnStore();
+    Session session;
+    Message resp;
+
+    ASSERT_EQ(server.processRequest(session, {AGGREGATE, AGG_SUM, 3}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.type, AGGREGATE);
+    EXPECT_EQ(resp.reqId, 3u);
+    EXPECT_EQ(resp.id, 3);
+    EXPECT_EQ(resp.emp.hours, 12.0);
+    ASSERT_EQ(server.processRequest(session, {AGGREGATE, AGG_MAX}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.emp.hours, 9.0);
+
+    Message count{AGGREGATE, AGG_COUNT_IN_RANGE};
+    count.emp.hours = 1.5;
+    setUpperBound(count, 9.0);
+    ASSERT_EQ(server.processRequest(session, count, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 2);
+    EXPECT_TRUE(session.streamed.empty());
+
+    Message histogram{AGGREGATE, AGG_HISTOGRAM};
+    histogram.emp.num = 2;
+    histogram.emp.hours = 0.0;
+    setUpperBound(histogram, 10.0);
+    ASSERT_EQ(server.processRequest(session, histogram, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 3);
+    ASSERT_EQ(session.streamed.size(), 2u);
+    EXPECT_EQ(session.streamed[0].type, HISTOGRAM_BUCKET);
+    EXPECT_EQ(session.streamed[0].emp.num, 2);
+    EXPECT_EQ(session.streamed[1].emp.num, 1);
+    EXPECT_EQ(session.streamed[1].emp.hours, 5.0);
+    session.streamed.clear();
+
+    histogram.emp.num = MAX_HISTOGRAM_BUCKETS + 1;
+    ASSERT_EQ(server.processRequest(session, histogram, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_TRUE(session.streamed.empty());
+    ASSERT_EQ(server.processRequest(session, {AGGREGATE, 42}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(DataFileTest, Crc32cMatchesReferenceValue) {
+    EXPECT_EQ(crc32c("123456789", 9), 0xE3069283u);
+    EXPECT_EQ(crc32c("", 0), 0u);
+    // Chained calls give the checksum of the concatenation.
+    EXPECT_EQ(crc32c("56789", 5, crc32c("1234", 4)), 0xE3069283u);
+}
+
+TEST(DataFileTest, PackedFileRoundTripAndCorruption) {
+    const std::string testFile = "test_packed.bin";
+    std::vector<Employee> employees(1000);
+    for (int i = 0; i < 1000; ++i) {
+        employees[i].num = i * 3;
+        std::snprintf(employees[i].name, NAME_SIZE, "Name%d", i);
+        employees[i].hours = i / 8.0;
+    }
+    ASSERT_TRUE(writePackedFile(testFile, employees));
+    EXPECT_TRUE(isPackedFile(testFile));
+    std::string bytes = readWholeFile(testFile);
+    EXPECT_EQ(bytes.size(), packedFileSize(employees.size()));
+    EXPECT_LT(bytes.size(), employees.size() * sizeof(Employee));
+
+    std::vector<Employee> loaded;
+    ASSERT_TRUE(readPackedFile(testFile, loaded, 3));
+    ASSERT_EQ(loaded.size(), employees.size());
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        EXPECT_EQ(loaded[i].num, employees[i].num);
+        EXPECT_STREQ(loaded[i].name, employees[i].name);
+        EXPECT_EQ(loaded[i].hours, employees[i].hours);
+    }
+
+    auto corrupt = [&](uint64_t at) {
+        std::string damaged = bytes;
+        damaged[at] ^= 0x40;
+        std::ofstream(testFile, std::ios::binary | std::ios::trunc).write(damaged.data(), damaged.size());
+        return readPackedFile(testFile, loaded);
+    };
+    EXPECT_FALSE(corrupt(packedRecordOffset(600) + 5));
+    EXPECT_FALSE(corrupt(packedRecordOffset(999) + PACKED_RECORD_SIZE));
+    EXPECT_FALSE(corrupt(offsetof(PackedHeader, recordCount)));
+    std::ofstream(testFile, std::ios::binary | std::ios::app).put('x');
+    EXPECT_FALSE(readPackedFile(testFile, loaded));
+
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, PackedFileFollowsWritesCreatesAndDeletes) {
+    const std::string testFile = "test_packed_manager.bin";
+    std::vector<Employee> employees(PACKED_RECORDS_PER_BLOCK);
+    for (size_t i = 0; i < employees.size(); ++i) {
+        employees[i] = {static_cast<int>(i + 1), "Worker", 1.0};
+    }
+    {
+        std::unique_ptr<RecordManager> manager(makeManager(testFile, employees));
+        ASSERT_TRUE(manager->savePacked());
+        EXPECT_FALSE(manager->useMappedStorage(SYNC_PER_WRITE));
+        EXPECT_FALSE(manager->enableWriteAheadLog());
+
+        ASSERT_TRUE(manager->writeRecord({10, "Changed", 7.5}));
+        Employee created{5000, "Appended", 2.0};
+        ASSERT_TRUE(manager->createRecord(created));
+        ASSERT_TRUE(manager->lockRecord(3, true));
+        ASSERT_TRUE(manager->deleteRecord(3));
+        EXPECT_EQ(manager->packedCount, PACKED_RECORDS_PER_BLOCK + 1);
+    }
+
+    std::vector<Employee> onDisk;
+    ASSERT_TRUE(readPackedFile(testFile, onDisk));
+    ASSERT_EQ(onDisk.size(), PACKED_RECORDS_PER_BLOCK + 1);
+    EXPECT_STREQ(onDisk[9].name, "Changed");
+    EXPECT_EQ(onDisk[2].num, FREE_RECORD_ID);
+    EXPECT_STREQ(onDisk.back().name, "Appended");
+
+    RecordManager reopened(testFile);
+    ASSERT_TRUE(reopened.openExisting(2));
+    EXPECT_TRUE(reopened.packedFile);
+    Employee e;
+    ASSERT_TRUE(reopened.readRecordById(5000, e));
+    EXPECT_EQ(e.hours, 2.0);
+    EXPECT_FALSE(reopened.readRecordById(3, e));
+    Employee reused{6000, "Reused", 3.0};
+    ASSERT_TRUE(reopened.createRecord(reused));
+    ASSERT_TRUE(readPackedFile(testFile, onDisk));
+    EXPECT_EQ(onDisk[2].num, 6000);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, SnapshotSeesOnePointInTime) {
+    const std::string testFile = "test_snapshot.bin";
+    std::unique_ptr<RecordManager> manager(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+    Employee e;
+
+    uint64_t before = manager->openSnapshot();
+    ASSERT_TRUE(manager->writeRecord({1, "Changed", 5.0}));
+    Employee created{3, "Three", 3.0};
+    ASSERT_TRUE(manager->createRecord(created));
+    ASSERT_TRUE(manager->lockRecord(2, true));
+    ASSERT_TRUE(manager->deleteRecord(2));
+    uint64_t after = manager->openSnapshot();
+
+    ASSERT_TRUE(manager->readSnapshot(before, 1, e));
+    EXPECT_STREQ(e.name, "One");
+    ASSERT_TRUE(manager->readSnapshot(before, 2, e));
+    EXPECT_STREQ(e.name, "Two");
+    EXPECT_FALSE(manager->readSnapshot(before, 3, e));
+
+    ASSERT_TRUE(manager->readSnapshot(after, 1, e));
+    EXPECT_STREQ(e.name, "Changed");
+    EXPECT_FALSE(manager->readSnapshot(after, 2, e));
+    ASSERT_TRUE(manager->readSnapshot(after, 3, e));
+
+    // The slot of 2 is reused by 4; the old snapshot still sees 2, not 4.
+    Employee reused{4, "Four", 4.0};
+    ASSERT_TRUE(manager->createRecord(reused));
+    ASSERT_TRUE(manager->readSnapshot(before, 2, e));
+    EXPECT_STREQ(e.name, "Two");
+    EXPECT_FALSE(manager->readSnapshot(before, 4, e));
+
+    EXPECT_GT(manager->snapshots.keptVersions(), 0u);
+    manager->closeSnapshot(before);
+    EXPECT_EQ(manager->snapshots.keptVersions(), 0u);
+    ASSERT_TRUE(manager->readSnapshot(after, 1, e));
+    EXPECT_STREQ(e.name, "Changed");
+    EXPECT_FALSE(manager->readSnapshot(after, 4, e));
+    manager->closeSnapshot(after);
+    EXPECT_EQ(manager->snapshots.openSnapshots(), 0u);
+
+    // With no snapshot open, writes keep nothing.
+    ASSERT_TRUE(manager->writeRecord({1, "Again", 6.0}));
+    EXPECT_EQ(manager->snapshots.keptVersions(), 0u);
+    EXPECT_TRUE(manager->snapshots.stripeFor(1).currentFrom.empty());
+
+    manager.reset();
+    std::remove(testFile.c_str());
+}
+
+// The writer always updates A before B to the same value, so at any single
+// point in time A is B or B + 1. Reads through a snapshot must agree.
+TEST(RecordManagerTest, SnapshotReadsAreConsistentUnderWrites) {
+    const std::string testFile = "test_snapshot_race.bin";
+    std::unique_ptr<RecordManager> manager(makeManager(testFile, {{1, "A", 0.0}, {2, "B", 0.0}}));
+    std::atomic<bool> stop{false};
+    std::thread writer([&]() {
+        for (int v = 1; !stop; ++v) {
+            manager->writeRecord({1, "A", static_cast<double>(v)});
+            manager->writeRecord({2, "B", static_cast<double>(v)});
+        }
+    });
+
+    for (int i = 0; i < 300; ++i) {
+        uint64_t ts = manager->openSnapshot();
+        Employee b, a, again;
+        ASSERT_TRUE(manager->readSnapshot(ts, 2, b));
+        std::this_thread::yield();
+        ASSERT_TRUE(manager->readSnapshot(ts, 1, a));
+        ASSERT_TRUE(manager->readSnapshot(ts, 2, again));
+        EXPECT_TRUE(a.hours == b.hours || a.hours == b.hours + 1) << a.hours << " " << b.hours;
+        EXPECT_EQ(again.hours, b.hours);
+        manager->closeSnapshot(ts);
+    }
+    stop = true;
+    writer.join();
+    EXPECT_EQ(manager->snapshots.keptVersions(), 0u);
+
+    manager.reset();
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, SnapshotRequestsAndSessionEnd) {
+    const std::string testFile = "test_snapshot_session.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}}));
+    Session reader;
+    Session writer;
+    Message resp;
+
+    ASSERT_EQ(server.processRequest(reader, {SNAPSHOT_OPEN, 0}, resp, false), REQUEST_DONE);
+    int handle = resp.id;
+    EXPECT_GT(handle, 0);
+
+    // A held write lock does not stop snapshot reads.
+    ASSERT_EQ(server.processRequest(writer, {WRITE_LOCK, 1}, resp, false), REQUEST_DONE);
+    Employee updated{1, "Updated", 2.0};
+    ASSERT_EQ(server.processRequest(writer, {WRITE_UPDATE, 1, 0, updated}, resp, false), REQUEST_DONE);
+    Message read{SNAPSHOT_READ, 1};
+    read.emp.num = handle;
+    ASSERT_EQ(server.processRequest(reader, read, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_STREQ(resp.emp.name, "One");
+    EXPECT_TRUE(reader.heldLocks.empty());
+
+    read.emp.num = handle + 1;
+    ASSERT_EQ(server.processRequest(reader, read, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_EQ(server.processRequest(reader, {SNAPSHOT_CLOSE, handle + 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, -1);
+
+    ASSERT_EQ(server.processRequest(reader, {SNAPSHOT_OPEN, 0}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(server.manager->snapshots.openSnapshots(), 2u);
+    ASSERT_EQ(server.processRequest(reader, {SNAPSHOT_CLOSE, handle}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, handle);
+    server.endSession(reader);
+    server.endSession(writer);
+    EXPECT_EQ(server.manager->snapshots.openSnapshots(), 0u);
+    EXPECT_EQ(server.manager->snapshots.keptVersions(), 0u);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, TransactionCommitsAllOrNothing) {
+    const std::string testFile = "test_txn.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}, {3, "Three", 3.0}}));
+    server.manager->enableScanIndex();
+    Session session;
+    Session other;
+    Message resp;
+
+    EXPECT_EQ(server.processRequest(session, {TXN_ITEM, 3, 0, {3, "C", 30.0}}, resp, false), REQUEST_SILENT);
+    EXPECT_EQ(server.processRequest(session, {TXN_ITEM, 1, 0, {1, "A", 10.0}}, resp, false), REQUEST_SILENT);
+    ASSERT_EQ(server.processRequest(session, {TXN_COMMIT, 2}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 2);
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "A");
+    EXPECT_STREQ(readFromFile(testFile, 2).name, "C");
+    EXPECT_TRUE(session.txn.empty());
+    EXPECT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    server.manager->unlockRecord(1, true);
+    std::vector<Employee> found;
+    server.manager->scanByName("A", 0, found);
+    EXPECT_EQ(found.size(), 1u);
+
+    // A missing ID, a repeated one or a wrong count change nothing.
+    server.processRequest(session, {TXN_ITEM, 1, 0, {1, "X", 0.0}}, resp, false);
+    server.processRequest(session, {TXN_ITEM, 9, 0, {9, "X", 0.0}}, resp, false);
+    server.processRequest(session, {TXN_COMMIT, 2}, resp, false);
+    EXPECT_EQ(resp.id, -1);
+    server.processRequest(session, {TXN_ITEM, 2, 0, {2, "X", 0.0}}, resp, false);
+    server.processRequest(session, {TXN_ITEM, 2, 0, {2, "Y", 0.0}}, resp, false);
+    server.processRequest(session, {TXN_COMMIT, 2}, resp, false);
+    EXPECT_EQ(resp.id, -1);
+    server.processRequest(session, {TXN_ITEM, 2, 0, {2, "X", 0.0}}, resp, false);
+    server.processRequest(session, {TXN_COMMIT, 3}, resp, false);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "A");
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Two");
+
+    // A record the session itself has locked is refused.
+    ASSERT_EQ(server.processRequest(session, {READ_LOCK, 2}, resp, false), REQUEST_DONE);
+    server.processRequest(session, {TXN_ITEM, 2, 0, {2, "X", 0.0}}, resp, false);
+    server.processRequest(session, {TXN_COMMIT, 1}, resp, false);
+    EXPECT_EQ(resp.id, -1);
+    server.processRequest(session, {UNLOCK, 2}, resp, false);
+
+    // A record locked elsewhere blocks the commit and releases what it took.
+    ASSERT_EQ(server.processRequest(other, {WRITE_LOCK, 3}, resp, false), REQUEST_DONE);
+    server.processRequest(session, {TXN_ITEM, 1, 0, {1, "AA", 11.0}}, resp, false);
+    server.processRequest(session, {TXN_ITEM, 3, 0, {3, "CC", 33.0}}, resp, false);
+    EXPECT_EQ(server.processRequest(session, {TXN_COMMIT, 2}, resp, false), REQUEST_BLOCKED);
+    EXPECT_EQ(session.txnBusy, 3);
+    EXPECT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    server.manager->unlockRecord(1, true);
+    server.processRequest(other, {UNLOCK, 3}, resp, false);
+    ASSERT_EQ(server.processRequest(session, {TXN_COMMIT, 2}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 2);
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "AA");
+    EXPECT_STREQ(readFromFile(testFile, 2).name, "CC");
+
+    std::remove(testFile.c_str());
+}
+
+// Both sessions name the records in opposite orders; the commits still never
+// deadlock, and a snapshot never sees one record of a commit without the other.
+TEST(ServerAppTest, TransactionsInOppositeOrdersDoNotDeadlock) {
+    const std::string testFile = "test_txn_order.bin";
+    ServerApp server(makeManager(testFile, {{1, "A", 0.0}, {2, "B", 0.0}}));
+    const int rounds = 300;
+    auto run = [&](int first, int second, double sign) {
+        Session session;
+        Message resp;
+        for (int i = 1; i <= rounds; ++i) {
+            Employee a{first, "A", sign * i};
+            Employee b{second, "B", sign * i};
+            server.processRequest(session, {TXN_ITEM, first, 0, a}, resp, true);
+            server.processRequest(session, {TXN_ITEM, second, 0, b}, resp, true);
+            ASSERT_EQ(server.processRequest(session, {TXN_COMMIT, 2}, resp, true), REQUEST_DONE);
+            ASSERT_EQ(resp.id, 2);
+        }
+    };
+    std::thread forward(run, 1, 2, 1.0);
+    std::thread backward(run, 2, 1, -1.0);
+    for (int i = 0; i < 200; ++i) {
+        uint64_t ts = server.manager->openSnapshot();
+        Employee a, b;
+        ASSERT_TRUE(server.manager->readSnapshot(ts, 1, a));
+        ASSERT_TRUE(server.manager->readSnapshot(ts, 2, b));
+        EXPECT_EQ(a.hours, b.hours);
+        server.manager->closeSnapshot(ts);
+    }
+    forward.join();
+    backward.join();
+
+    std::remove(testFile.c_str());
+}
+
+// A checkpoint while a commit's records wait for the log leaves them all out
+// of the data file; a crash at either point replays all of them or none.
+TEST(ServerAppTest, TransactionSurvivesCheckpointBeforeItsFlush) {
+    const std::string testFile = "test_txn_wal.bin";
+    const std::vector<Employee> original = {{1, "One", 1.0}, {2, "Two", 2.0}, {3, "Three", 3.0}};
+    std::string beforeFlush;
+    std::string afterFlush;
+    std::string logAfterFlush;
+    {
+        ServerApp server(makeManager(testFile, original));
+        ASSERT_TRUE(server.manager->enableWriteAheadLog(0));
+        WriteAheadLog& wal = *server.manager->wal;
+        ASSERT_TRUE(server.manager->writeRecord({3, "Durable", 3.5}));
+
+        {
+            std::lock_guard<std::mutex> lk(wal.mutex);
+            wal.flushing = true;
+        }
+        Session session;
+        Message resp;
+        std::thread committer([&]() {
+            server.processRequest(session, {TXN_ITEM, 1, 0, {1, "TxnOne", 10.0}}, resp, false);
+            server.processRequest(session, {TXN_ITEM, 2, 0, {2, "TxnTwo", 20.0}}, resp, false);
+            server.processRequest(session, {TXN_COMMIT, 2}, resp, false);
+        });
+        while (true) {
+            std::lock_guard<std::mutex> lk(wal.mutex);
+            if (wal.pending.size() == 2) break;
+        }
+        {
+            std::lock_guard<std::mutex> lk(wal.mutex);
+            wal.flushing = false;
+        }
+        ASSERT_TRUE(wal.checkpoint());
+        beforeFlush = readWholeFile(testFile);
+        EXPECT_TRUE(readWholeFile(testFile + ".wal").empty());
+
+        wal.flushed.notify_all();
+        committer.join();
+        EXPECT_EQ(resp.id, 2);
+        afterFlush = readWholeFile(testFile);
+        logAfterFlush = readWholeFile(testFile + ".wal");
+        EXPECT_EQ(logAfterFlush.size(), 2 * sizeof(WalRecord));
+    }
+
+    // Crash before the commit's flush: none of it.
+    writeText(testFile, beforeFlush);
+    WriteAheadLog::discard(testFile);
+    {
+        RecordManager recovered(testFile);
+        ASSERT_TRUE(recovered.enableWriteAheadLog(0));
+        EXPECT_STREQ(readFromFile(testFile, 0).name, "One");
+        EXPECT_STREQ(readFromFile(testFile, 1).name, "Two");
+        EXPECT_STREQ(readFromFile(testFile, 2).name, "Durable");
+    }
+
+    // Crash after it, before the next checkpoint: all of it.
+    writeText(testFile, afterFlush);
+    writeText(testFile + ".wal", logAfterFlush);
+    {
+        RecordManager recovered(testFile);
+        ASSERT_TRUE(recovered.enableWriteAheadLog(0));
+        EXPECT_STREQ(readFromFile(testFile, 0).name, "TxnOne");
+        EXPECT_STREQ(readFromFile(testFile, 1).name, "TxnTwo");
+        EXPECT_STREQ(readFromFile(testFile, 2).name, "Durable");
+    }
+    std::remove(testFile.c_str());
+}
+
+// Every ID is served by the thread of its shard, and a shard's state is only
+// touched by that thread, so plain counters add up under concurrent callers.
+TEST(RecordShardsTest, RoutesEveryIdToItsOwnThread) {
+    RecordShards shards("test_shards_route.bin", 4, 0);
+    std::vector<std::thread::id> owners(shards.size());
+    shards.each([&](size_t k, RecordManager&) { owners[k] = std::this_thread::get_id(); });
+    for (size_t k = 0; k < owners.size(); ++k) {
+        EXPECT_NE(owners[k], std::this_thread::get_id());
+        for (size_t j = 0; j < k; ++j) EXPECT_NE(owners[k], owners[j]);
+    }
+
+    std::vector<size_t> used(shards.size());
+    std::vector<size_t> counters(shards.size());
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 4; ++t) {
+        callers.emplace_back([&, t]() {
+            for (int id = t * 1000; id < (t + 1) * 1000; ++id) {
+                size_t k = shards.shardOf(id);
+                shards.run(id, [&](RecordManager&) {
+                    EXPECT_EQ(std::this_thread::get_id(), owners[k]);
+                    counters[k]++;
+                });
+            }
+        });
+    }
+    for (auto& c : callers) c.join();
+    size_t total = 0;
+    for (int id = 0; id < 4000; ++id) used[shards.shardOf(id)]++;
+    for (size_t k = 0; k < shards.size(); ++k) {
+        EXPECT_EQ(counters[k], used[k]);
+        EXPECT_GT(used[k], 0u);
+        total += counters[k];
+    }
+    EXPECT_EQ(total, 4000u);
+}
+
+TEST(ServerAppTest, ShardedRecordsServeEveryRequest) {
+    const std::string testFile = "test_sharded.bin";
+    std::vector<Employee> employees;
+    for (int i = 1; i <= 8; ++i) {
+        employees.push_back({i, "E", static_cast<double>(i)});
+        employees.back().name[1] = static_cast<char>('0' + 9 - i);
+    }
+    ServerApp server(makeManager(testFile, employees));
+    ASSERT_TRUE(server.manager->useShards(3));
+    EXPECT_FALSE(server.manager->useShards(2));
+    EXPECT_TRUE(server.manager->records.empty());
+    Session session;
+    Session other;
+    Message resp;
+
+    ASSERT_EQ(server.processRequest(session, {READ_LOCK, 2}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 2);
+    EXPECT_STREQ(resp.emp.name, "E7");
+    server.processRequest(session, {UNLOCK, 2}, resp, false);
+
+    // A write-locked record is refused to other writers and blocks readers.
+    ASSERT_EQ(server.processRequest(session, {WRITE_LOCK, 5}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 5);
+    server.processRequest(other, {WRITE_LOCK, 5}, resp, false);
+    EXPECT_EQ(resp.id, -1);
+    EXPECT_EQ(server.processRequest(other, {READ_LOCK, 5}, resp, false), REQUEST_BLOCKED);
+    ASSERT_EQ(server.processRequest(session, {WRITE_UPDATE, 5, 0, {5, "Five", 50.0}}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 5);
+    EXPECT_STREQ(readFromFile(testFile, 4).name, "Five");
+
+    // A blocking reader waits without holding up the shard.
+    auto reader = std::async(std::launch::async, [&]() {
+        Session s;
+        Message r;
+        server.processRequest(s, {READ_LOCK, 5}, r, true);
+        server.processRequest(s, {UNLOCK, 5}, r, true);
+        return r.id == 5;
+    });
+    EXPECT_EQ(reader.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+    ASSERT_EQ(server.processRequest(other, {READ_LOCK, 6}, resp, false), REQUEST_DONE);
+    server.processRequest(other, {UNLOCK, 6}, resp, false);
+    server.processRequest(session, {UNLOCK, 5}, resp, false);
+    EXPECT_TRUE(reader.get());
+
+    // A transaction spans shards.
+    for (int id : {1, 6, 7}) {
+        server.processRequest(session, {TXN_ITEM, id, 0, {id, "T", 70.0}}, resp, false);
+    }
+    ASSERT_EQ(server.processRequest(session, {TXN_COMMIT, 3}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 3);
+    for (size_t slot : {0u, 5u, 6u}) EXPECT_STREQ(readFromFile(testFile, slot).name, "T");
+
+    // Creates append to the one data file; deletes free their slot in it.
+    server.processRequest(session, {CREATE_RECORD, 0, 0, {9, "New", 9.0}}, resp, false);
+    EXPECT_EQ(resp.id, 9);
+    server.processRequest(session, {CREATE_RECORD, 0, 0, {10, "Newer", 10.0}}, resp, false);
+    EXPECT_EQ(resp.id, 10);
+    EXPECT_EQ(readWholeFile(testFile).size(), 10 * sizeof(Employee));
+    ASSERT_EQ(server.processRequest(session, {WRITE_LOCK, 9}, resp, false), REQUEST_DONE);
+    server.processRequest(session, {DELETE_RECORD, 9}, resp, false);
+    EXPECT_EQ(resp.id, 9);
+    EXPECT_EQ(server.manager->tryLockRecord(9, false), LOCK_NOT_FOUND);
+
+    // Scans and aggregates merge every shard.
+    std::vector<Employee> found;
+    server.manager->scanByName("E", 0, found);
+    EXPECT_EQ(idsOf(found), (std::vector<int>{8, 4, 3, 2}));
+    server.manager->scanByHours(0.0, 100.0, 3, found);
+    EXPECT_EQ(idsOf(found), (std::vector<int>{2, 3, 4}));
+    HoursSummary sum = server.manager->hoursSummary();
+    EXPECT_EQ(sum.count, 9u);
+    EXPECT_EQ(sum.min, 2.0);
+    EXPECT_EQ(sum.max, 70.0);
+    EXPECT_EQ(server.manager->hoursInRange(60.0, 80.0), 3u);
+
+    server.processRequest(session, {SNAPSHOT_OPEN}, resp, false);
+    EXPECT_EQ(resp.id, -1);
+    server.manager->shards.reset();
+
+    RecordManager reopened(testFile);
+    ASSERT_TRUE(reopened.openExisting());
+    EXPECT_EQ(reopened.idToIndex.size(), 9u);
+    Employee e;
+    ASSERT_TRUE(reopened.readRecordById(10, e));
+    EXPECT_STREQ(e.name, "Newer");
+    ASSERT_TRUE(reopened.readRecordById(5, e));
+    EXPECT_STREQ(e.name, "Five");
+    EXPECT_FALSE(reopened.readRecordById(9, e));
+
+    std::remove(testFile.c_str());
+}
+
+// Every change of a leased record pushes one INVALIDATE to each holder and
+// ends the lease; a session's leases go with it.
+TEST(ServerAppTest, ReadLeasesPushInvalidations) {
+    const std::string testFile = "test_leases.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}, {3, "Three", 3.0}}));
+    Session reader;
+    Session writer;
+    std::vector<Message> pushed;
+    server.leases.attach(reader.leases, [&](const Message& msg) { pushed.push_back(msg); });
+    Message resp;
+
+    ASSERT_EQ(server.processRequest(reader, {READ_CACHED, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.type, READ_CACHED);
+    EXPECT_STREQ(resp.emp.name, "One");
+    server.processRequest(reader, {READ_CACHED, 1}, resp, false);
+    server.processRequest(reader, {READ_CACHED, 2}, resp, false);
+    server.processRequest(reader, {READ_CACHED, 3}, resp, false);
+    EXPECT_EQ(server.leases.granted.load(), 3u);
+
+    ASSERT_EQ(server.processRequest(writer, {WRITE_LOCK, 1}, resp, false), REQUEST_DONE);
+    server.processRequest(writer, {WRITE_UPDATE, 1, 0, {1, "New", 5.0}}, resp, false);
+    ASSERT_EQ(pushed.size(), 1u);
+    EXPECT_EQ(pushed[0].type, INVALIDATE);
+    EXPECT_EQ(pushed[0].id, 1);
+    EXPECT_EQ(pushed[0].reqId, 0u);
+
+    // The lease is over: the next change of 1 pushes nothing.
+    server.processRequest(writer, {WRITE_UPDATE, 1, 0, {1, "Newer", 6.0}}, resp, false);
+    server.processRequest(writer, {UNLOCK, 1}, resp, false);
+    EXPECT_EQ(pushed.size(), 1u);
+
+    server.processRequest(writer, {TXN_ITEM, 2, 0, {2, "Txn", 7.0}}, resp, false);
+    ASSERT_EQ(server.processRequest(writer, {TXN_COMMIT, 1}, resp, false), REQUEST_DONE);
+    EXPECT_EQ(resp.id, 1);
+    ASSERT_EQ(pushed.size(), 2u);
+    EXPECT_EQ(pushed[1].id, 2);
+
+    // A new lease sees the new image.
+    server.processRequest(reader, {READ_CACHED, 1}, resp, false);
+    EXPECT_STREQ(resp.emp.name, "Newer");
+    EXPECT_EQ(server.leases.granted.load(), 2u);
+
+    server.endSession(reader);
+    EXPECT_EQ(server.leases.granted.load(), 0u);
+    ASSERT_EQ(server.processRequest(writer, {WRITE_LOCK, 3}, resp, false), REQUEST_DONE);
+    server.processRequest(writer, {DELETE_RECORD, 3}, resp, false);
+    EXPECT_EQ(resp.id, 3);
+    EXPECT_EQ(pushed.size(), 2u);
+
+    std::remove(testFile.c_str());
+}
+
+TEST(ConcurrentIndexTest, LookupsWhileGrowing) {
+    ConcurrentIndex index;
+    const int count = 200000;
+    std::atomic<int> published{0};
+    std::atomic<int> misses{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&, r]() {
+            for (int k = r; published.load() < count; k = (k * 31 + 7) % count) {
+                int limit = published.load();
+                if (limit == 0) continue;
+                int key = k % limit;
+                size_t value;
+                if (!index.find(key * 2, value) || value != static_cast<size_t>(key)) ++misses;
+                if (index.find(key * 2 + 1, value)) ++misses;
+            }
+        });
+    }
+    for (int i = 0; i < count; ++i) {
+        ASSERT_TRUE(index.insert(i * 2, i));
+        published.store(i + 1);
+    }
+    for (auto& t : readers) t.join();
+
+    EXPECT_EQ(misses.load(), 0);
+    EXPECT_EQ(index.size(), static_cast<size_t>(count));
+    EXPECT_FALSE(index.insert(10, 99));
+    size_t value;
+    ASSERT_TRUE(index.find(10, value));
+    EXPECT_EQ(value, 5u);
+}
+
+// Rebuilds that only drop tombstones free the table they replace, also while
+// lookups keep running.
+TEST(ConcurrentIndexTest, ChurnKeepsOneTable) {
+    ConcurrentIndex index;
+    const int live = 1000;
+    for (int i = 0; i < live; ++i) {
+        ASSERT_TRUE(index.insert(i, i));
+    }
+    std::atomic<bool> done{false};
+    std::atomic<int> misses{0};
+    std::thread reader([&]() {
+        size_t value;
+        for (int k = 0; !done.load(); k = (k + 1) % live) {
+            // Key 0 is never erased.
+            if (!index.find(0, value) || value != 0) ++misses;
+            index.find(k, value);
+        }
+    });
+
+    size_t most = 0;
+    for (int round = 0; round < 200000; ++round) {
+        int key = 1 + round % (live - 1);
+        ASSERT_TRUE(index.erase(key));
+        ASSERT_TRUE(index.insert(key + live * (1 + round / (live - 1)), round));
+        ASSERT_TRUE(index.erase(key + live * (1 + round / (live - 1))));
+        ASSERT_TRUE(index.insert(key, key));
+        most = std::max(most, index.tables.size());
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(misses.load(), 0);
+    EXPECT_EQ(most, 1u);
+    EXPECT_EQ(index.size(), static_cast<size_t>(live));
+    EXPECT_LE(index.current.load()->capacity(), 4096u);
+}
+
+TEST(ConcurrentIndexTest, ParallelInsertsDetectDuplicates) {
+    ConcurrentIndex index;
+    std::atomic<int> rejected{0};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < 20000; ++i) {
+                if (!index.insert(i, static_cast<size_t>(t))) ++rejected;
+            }
+        });
+    }
+    for (auto& t : writers) t.join();
+
+    EXPECT_EQ(index.size(), 20000u);
+    EXPECT_EQ(rejected.load(), 3 * 20000);
+    index.clear();
+    EXPECT_TRUE(index.empty());
+    size_t value;
+    EXPECT_FALSE(index.find(1, value));
+}
+
+TEST(ConcurrentIndexTest, DenseRangeUsesDirectArray) {
+    ConcurrentIndex index;
+    index.reserveRange(1000, 2999, 1500);
+    ASSERT_TRUE(index.dense());
+    for (int i = 0; i < 1500; ++i) {
+        ASSERT_TRUE(index.insert(1000 + i, i));
+    }
+    EXPECT_FALSE(index.insert(1000, 7));
+    EXPECT_TRUE(index.insert(-1, 1500));
+    EXPECT_TRUE(index.insert(INT_MAX, 1501));
+    EXPECT_TRUE(index.insert(INT_MIN, 1502));
+    EXPECT_EQ(index.size(), 1503u);
+
+    size_t value;
+    ASSERT_TRUE(index.find(1499 + 1000, value));
+    EXPECT_EQ(value, 1499u);
+    EXPECT_FALSE(index.find(2600, value));
+    EXPECT_FALSE(index.find(999, value));
+    ASSERT_TRUE(index.find(-1, value));
+    EXPECT_EQ(value, 1500u);
+    ASSERT_TRUE(index.find(INT_MAX, value));
+    EXPECT_EQ(value, 1501u);
+    ASSERT_TRUE(index.find(INT_MIN, value));
+    EXPECT_EQ(value, 1502u);
+    EXPECT_FALSE(index.insert(5, ConcurrentIndex::NO_VALUE));
+
+    ConcurrentIndex sparse;
+    sparse.reserveRange(0, 1000000, 1000);
+    EXPECT_FALSE(sparse.dense());
+    sparse.reserveRange(INT_MIN, INT_MAX, 1000);
+    EXPECT_FALSE(sparse.dense());
+}
+
+TEST(WarmStartTest, DenseIdsPickDirectIndex) {
+    const std::string testFile = "test_warm_dense.bin";
+    std::vector<Employee> employees;
+    for (int i = 0; i < 40000; ++i) {
+        employees.push_back({40000 - i, "Dense", static_cast<double>(i)});
+    }
+    ASSERT_TRUE(writeEmployeeFile(testFile, employees));
+
+    RecordManager manager(testFile);
+    ASSERT_TRUE(manager.openExisting(2));
+    EXPECT_TRUE(manager.idToIndex.dense());
+    EXPECT_EQ(manager.idToIndex.size(), employees.size());
+    Employee e;
+    ASSERT_TRUE(manager.readRecordById(1, e));
+    EXPECT_EQ(e.hours, 39999.0);
+    EXPECT_FALSE(manager.readRecordById(40001, e));
+
+    std::remove(testFile.c_str());
+}
+
+TEST(WarmStartTest, DuplicateIdRejected) {
+    const std::string testFile = "test_warm_dup.bin";
+    ASSERT_TRUE(writeEmployeeFile(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}, {1, "Again", 3.0}}));
+
+    RecordManager manager(testFile);
+    EXPECT_FALSE(manager.openExisting(2));
+    EXPECT_TRUE(manager.records.empty());
+    EXPECT_TRUE(manager.idToIndex.empty());
+
+    writeText(testFile, "odd size");
+    EXPECT_FALSE(manager.openExisting());
+    std::remove(testFile.c_str());
+}
+
+#ifdef __linux__
+TEST(EpollServerTest, ParkedReadResumesAfterUnlock) {
+    const std::string testFile = "test_epoll.bin";
+    const std::string path = "/tmp/TestEpollServer.sock";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}}));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 2);
+    std::thread serverThread([&]() { reactor.run(2); });
+
+    PipeClient writer(path);
+    PipeClient reader(path);
+    ASSERT_TRUE(writer.connect());
+    ASSERT_TRUE(reader.connect());
+
+    Message resp;
+    ASSERT_TRUE(writer.sendMessage({WRITE_LOCK, 1}));
+    ASSERT_TRUE(writer.recvMessage(resp));
+    EXPECT_EQ(resp.id, 1);
+
+    std::atomic<bool> readDone{false};
+    std::thread readerThread([&]() {
+        Message r;
+        reader.sendMessage({READ_LOCK, 1});
+        reader.recvMessage(r);
+        readDone = true;
+        EXPECT_EQ(r.id, 1);
+        EXPECT_STREQ(r.emp.name, "Changed");
+        reader.sendMessage({UNLOCK, 1});
+        reader.recvMessage(r);
+        reader.sendMessage({CLIENT_EXIT, 0});
+        reader.recvMessage(r);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(readDone);
+
+    Employee changed{1, "Changed", 3.0};
+    ASSERT_TRUE(writer.sendMessage({WRITE_UPDATE, 1, 0, changed}));
+    ASSERT_TRUE(writer.recvMessage(resp));
+    ASSERT_TRUE(writer.sendMessage({UNLOCK, 1}));
+    ASSERT_TRUE(writer.recvMessage(resp));
+    writer.sendMessage({CLIENT_EXIT, 0});
+    writer.recvMessage(resp);
+
+    readerThread.join();
+    serverThread.join();
+    EXPECT_TRUE(readDone);
+    EXPECT_EQ(reactor.finished, 2);
+
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+TEST(EpollServerTest, SharedMemorySession) {
+    const std::string testFile = "test_epoll_shm.bin";
+    const std::string path = "/tmp/TestEpollShm.sock";
+    ServerApp server(makeManager(testFile, {{5, "Five", 5.0}}));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(1); });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    ASSERT_TRUE(client.attachSharedMemory(SHM_WAIT_FUTEX));
+    EXPECT_NE(client.shm, nullptr);
+
+    Message resp;
+    ASSERT_TRUE(client.sendMessage({READ_LOCK, 5}));
+    ASSERT_TRUE(client.recvMessage(resp));
+    EXPECT_EQ(resp.id, 5);
+    EXPECT_STREQ(resp.emp.name, "Five");
+    ASSERT_TRUE(client.sendMessage({UNLOCK, 5}));
+    ASSERT_TRUE(client.recvMessage(resp));
+    ASSERT_TRUE(client.sendMessage({CLIENT_EXIT, 0}));
+    ASSERT_TRUE(client.recvMessage(resp));
+    EXPECT_EQ(resp.type, CLIENT_EXIT);
+    client.close();
+
+    serverThread.join();
+    EXPECT_EQ(reactor.finished, 1);
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+TEST(EpollServerTest, BlockedLockDoesNotStallOtherReads) {
+    const std::string testFile = "test_epoll_pipeline.bin";
+    const std::string path = "/tmp/TestEpollPipeline.sock";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(2); });
+
+    PipeClient writer(path);
+    PipeClient reader(path);
+    ASSERT_TRUE(writer.connect());
+    ASSERT_TRUE(reader.connect());
+
+    Message resp;
+    ASSERT_TRUE(writer.waitResponse(writer.submit({WRITE_LOCK, 1}), resp));
+    EXPECT_EQ(resp.id, 1);
+
+    uint32_t slow = reader.submit({READ_LOCK, 1});
+    uint32_t fast = reader.submit({READ_LOCK, 2});
+    ASSERT_TRUE(reader.recvMessage(resp));
+    EXPECT_EQ(resp.reqId, fast);
+    EXPECT_EQ(resp.id, 2);
+
+    ASSERT_TRUE(writer.waitResponse(writer.submit({UNLOCK, 1}), resp));
+    ASSERT_TRUE(reader.waitResponse(slow, resp));
+    EXPECT_EQ(resp.id, 1);
+
+    reader.waitResponse(reader.submit({CLIENT_EXIT, 0}), resp);
+    writer.waitResponse(writer.submit({CLIENT_EXIT, 0}), resp);
+    serverThread.join();
+
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+TEST(ServerAppTest, ThreadedSessionAnswersOutOfOrder) {
+    const std::string testFile = "test_threaded_pipeline.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    SocketConnection serverEnd(fds[0]);
+    SocketConnection clientEnd(fds[1]);
+    std::thread handler([&]() { server.clientHandler(serverEnd); });
+
+    ASSERT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+
+    Message req{READ_LOCK, 1, 100};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+    req = {READ_LOCK, 2, 200};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+
+    Message resp;
+    ASSERT_TRUE(clientEnd.recvMessage(resp));
+    EXPECT_EQ(resp.reqId, 200u);
+
+    server.manager->unlockRecord(1, true);
+    ASSERT_TRUE(clientEnd.recvMessage(resp));
+    EXPECT_EQ(resp.reqId, 100u);
+    EXPECT_EQ(resp.id, 1);
+
+    req = {CLIENT_EXIT, 0, 300};
+    clientEnd.sendMessage(req);
+    clientEnd.recvMessage(resp);
+    handler.join();
+    while (server.activeWaiters > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::remove(testFile.c_str());
+}
+
+static int threadCount() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 8, "Threads:") == 0) return std::atoi(line.c_str() + 8);
+    }
+    return -1;
+}
+
+// Blocked requests of a threaded session wait in the lock queues, not in
+// threads of their own, and the one past its deadline gets LOCK_TIMEOUT.
+TEST(ServerAppTest, ThreadedSessionWaitsWithoutThreads) {
+    const std::string testFile = "test_threaded_waits.bin";
+    const int blocked = 50;
+    std::vector<Employee> employees;
+    for (int i = 0; i <= blocked; ++i) {
+        employees.push_back({i, "Emp", 0.0});
+    }
+    ServerApp server(makeManager(testFile, employees));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    SocketConnection serverEnd(fds[0]);
+    SocketConnection clientEnd(fds[1]);
+    std::thread handler([&]() { server.clientHandler(serverEnd); });
+
+    for (int i = 0; i <= blocked; ++i) {
+        ASSERT_EQ(server.manager->tryLockRecord(i, true), LOCK_OK);
+    }
+    Message resp;
+    auto waitFor = [&](int n) {
+        for (int i = 0; i < 5000 && server.activeWaiters != n; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return server.activeWaiters.load();
+    };
+    // The first wait starts the notifier thread; the rest add none.
+    Message req{READ_LOCK, 1, 1};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+    ASSERT_EQ(waitFor(1), 1);
+    int before = threadCount();
+    for (int i = 2; i <= blocked; ++i) {
+        req = {READ_LOCK, i, static_cast<uint32_t>(i)};
+        ASSERT_TRUE(clientEnd.sendMessage(req));
+    }
+    ASSERT_EQ(waitFor(blocked), blocked);
+    EXPECT_LE(threadCount(), before);
+
+    for (int i = 1; i <= blocked; ++i) {
+        server.manager->unlockRecord(i, true);
+    }
+    std::vector<bool> answered(blocked + 1, false);
+    for (int i = 1; i <= blocked; ++i) {
+        ASSERT_TRUE(clientEnd.recvMessage(resp));
+        EXPECT_EQ(resp.type, READ_LOCK);
+        EXPECT_EQ(resp.id, static_cast<int>(resp.reqId));
+        answered[resp.reqId] = true;
+    }
+    EXPECT_EQ(std::count(answered.begin(), answered.end(), true), blocked);
+
+    server.lockTimeoutMs = 20;
+    req = {READ_LOCK, 0, 1000};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+    ASSERT_TRUE(clientEnd.recvMessage(resp));
+    EXPECT_EQ(resp.type, LOCK_TIMEOUT);
+    EXPECT_EQ(resp.reqId, 1000u);
+    server.manager->unlockRecord(0, true);
+
+    req = {CLIENT_EXIT, 0, 2000};
+    clientEnd.sendMessage(req);
+    clientEnd.recvMessage(resp);
+    handler.join();
+    while (server.activeWaiters > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::remove(testFile.c_str());
+}
+
+// Sends nothing until opened, like a client that stopped reading.
+struct GatedTransport : Transport {
+    explicit GatedTransport(Transport& inner) : inner(inner) {}
+    bool sendMessage(const Message& msg) override {
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [this]() { return open; });
+        return inner.sendMessage(msg);
+    }
+    bool recvMessage(Message& msg) override { return inner.recvMessage(msg); }
+    void close() override {}
+    void release() {
+        std::lock_guard<std::mutex> lk(mutex);
+        open = true;
+        cv.notify_all();
+    }
+
+    Transport& inner;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool open = false;
+};
+
+// The notifier only hands woken requests off: a session stuck sending its
+// resumed response does not hold up another session's wake-up.
+TEST(ServerAppTest, StuckResumeDoesNotBlockOtherSessions) {
+    const std::string testFile = "test_threaded_resume.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+
+    int slowFds[2], fastFds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, slowFds), 0);
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fastFds), 0);
+    SocketConnection slowServer(slowFds[0]), slowClient(slowFds[1]);
+    SocketConnection fastServer(fastFds[0]), fastClient(fastFds[1]);
+    GatedTransport gated(slowServer);
+    std::thread slowHandler([&]() { server.clientHandler(gated); });
+    std::thread fastHandler([&]() { server.clientHandler(fastServer); });
+
+    ASSERT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    ASSERT_EQ(server.manager->tryLockRecord(2, true), LOCK_OK);
+    Message req{READ_LOCK, 1, 1};
+    ASSERT_TRUE(slowClient.sendMessage(req));
+    req = {READ_LOCK, 2, 2};
+    ASSERT_TRUE(fastClient.sendMessage(req));
+    for (int i = 0; i < 5000 && server.activeWaiters != 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(server.activeWaiters, 2);
+
+    server.manager->unlockRecord(1, true);
+    server.manager->unlockRecord(2, true);
+    Message resp;
+    auto fast = std::async(std::launch::async, [&]() { return fastClient.recvMessage(resp); });
+    bool answered = fast.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    gated.release();
+    ASSERT_TRUE(answered);
+    ASSERT_TRUE(fast.get());
+    EXPECT_EQ(resp.reqId, 2u);
+    EXPECT_EQ(resp.id, 2);
+    ASSERT_TRUE(slowClient.recvMessage(resp));
+    EXPECT_EQ(resp.reqId, 1u);
+    EXPECT_EQ(resp.id, 1);
+
+    req = {CLIENT_EXIT, 0, 3};
+    slowClient.sendMessage(req);
+    slowClient.recvMessage(resp);
+    fastClient.sendMessage(req);
+    fastClient.recvMessage(resp);
+    slowHandler.join();
+    fastHandler.join();
+    while (server.activeWaiters > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::remove(testFile.c_str());
+}
+
+// With a pool the connection thread only reads: requests run as pool tasks,
+// scans and aggregates apart from the session's ordered requests.
+TEST(ServerAppTest, PooledSessionRunsRequestsAsTasks) {
+    const std::string testFile = "test_pooled_session.bin";
+    std::vector<Employee> employees;
+    for (int i = 1; i <= 20; ++i) {
+        employees.push_back({i, "Emp", static_cast<double>(i)});
+    }
+    ServerApp server(makeManager(testFile, employees));
+    server.pool.reset(new WorkStealingPool(2));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    SocketConnection serverEnd(fds[0]);
+    SocketConnection clientEnd(fds[1]);
+    std::thread handler([&]() { server.clientHandler(serverEnd); });
+
+    ASSERT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    Message req{READ_LOCK, 1, 1};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+    req = {AGGREGATE, AGG_SUM, 2};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+    req = {SCAN, SCAN_HOURS_RANGE, 3};
+    req.emp.hours = 5.0;
+    setUpperBound(req, 7.0);
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+    req = {READ_LOCK, 2, 4};
+    ASSERT_TRUE(clientEnd.sendMessage(req));
+
+    Message resp;
+    std::vector<int> rows;
+    std::map<uint32_t, Message> answers;
+    while (answers.size() < 3 && clientEnd.recvMessage(resp)) {
+        if (resp.type == SCAN) rows.push_back(resp.id);
+        else answers[resp.reqId] = resp;
+    }
+    EXPECT_EQ(answers[2].id, 20);
+    EXPECT_DOUBLE_EQ(answers[2].emp.hours, 210.0);
+    EXPECT_EQ(answers[3].type, SCAN_END);
+    EXPECT_EQ(answers[3].id, 3);
+    EXPECT_EQ(rows, std::vector<int>({5, 6, 7}));
+    EXPECT_EQ(answers[4].id, 2);
+    EXPECT_EQ(answers.count(1), 0u);
+
+    server.manager->unlockRecord(1, true);
+    ASSERT_TRUE(clientEnd.recvMessage(resp));
+    EXPECT_EQ(resp.reqId, 1u);
+    EXPECT_EQ(resp.id, 1);
+
+    req = {CLIENT_EXIT, 0, 5};
+    clientEnd.sendMessage(req);
+    ASSERT_TRUE(clientEnd.recvMessage(resp));
+    EXPECT_EQ(resp.type, CLIENT_EXIT);
+    handler.join();
+    while (server.activeWaiters > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::remove(testFile.c_str());
+}
+
+TEST(EpollServerTest, AsyncClientsOverSocketAndSharedMemory) {
+    const std::string testFile = "test_epoll_async.bin";
+    const std::string path = "/tmp/TestEpollAsync.sock";
+    const int rounds = 300;
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(2); });
+
+    PipeClient viaSocket(path);
+    PipeClient viaShm(path);
+    ASSERT_TRUE(viaSocket.connect());
+    ASSERT_TRUE(viaShm.connect());
+    ASSERT_TRUE(viaShm.attachSharedMemory(SHM_WAIT_FUTEX));
+
+    for (PipeClient* client : { &viaSocket, &viaShm }) {
+        ASSERT_TRUE(client->startAsync());
+        std::vector<std::future<Message>> reads;
+        for (int i = 0; i < rounds; ++i) {
+            int id = 1 + i % 2;
+            reads.push_back(client->submitAsync(Message{READ_LOCK, id}));
+            client->submitAsync(Message{UNLOCK, id});
+        }
+        for (int i = 0; i < rounds; ++i) {
+            Message resp = reads[i].get();
+            EXPECT_EQ(resp.id, 1 + i % 2);
+        }
+        EXPECT_EQ(client->submitAsync(Message{CLIENT_EXIT, 0}).get().type, CLIENT_EXIT);
+        client->close();
+    }
+
+    serverThread.join();
+    EXPECT_EQ(reactor.finished, 2);
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+TEST(RecordManagerTest, IoUringWrites) {
+    const std::string testFile = "test_uring.bin";
+    RecordManager* manager = makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}});
+    ASSERT_TRUE(manager->useIoUring(true));
+
+    Employee first{1, "Direct", 3.0};
+    ASSERT_TRUE(manager->writeRecord(first));
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "Direct");
+
+    std::promise<bool> written;
+    Employee second{2, "Async", 4.0};
+    ASSERT_TRUE(manager->writeRecordAsync(second, [&](bool ok) { written.set_value(ok); }));
+    EXPECT_TRUE(written.get_future().get());
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Async");
+
+    std::promise<bool> missing;
+    Employee unknown{99, "Nobody", 0.0};
+    ASSERT_TRUE(manager->writeRecordAsync(unknown, [&](bool ok) { missing.set_value(ok); }));
+    EXPECT_FALSE(missing.get_future().get());
+
+    delete manager;
+    std::remove(testFile.c_str());
+}
+
+TEST(EpollServerTest, UpdateAcknowledgedOnCompletion) {
+    const std::string testFile = "test_epoll_uring.bin";
+    const std::string path = "/tmp/TestEpollUring.sock";
+    ServerApp server(makeManager(testFile, {{3, "Three", 3.0}}));
+    ASSERT_TRUE(server.manager->useIoUring(false));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(1); });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    Message resp;
+    ASSERT_TRUE(client.waitResponse(client.submit({WRITE_LOCK, 3}), resp));
+    EXPECT_EQ(resp.id, 3);
+
+    Employee updated{3, "Uring", 9.0};
+    uint32_t update = client.submit({WRITE_UPDATE, 3, 0, updated});
+    uint32_t unlock = client.submit({UNLOCK, 3});
+    uint32_t exit = client.submit({CLIENT_EXIT, 0});
+    ASSERT_TRUE(client.waitResponse(update, resp));
+    EXPECT_EQ(resp.type, WRITE_UPDATE);
+    EXPECT_EQ(resp.id, 3);
+    ASSERT_TRUE(client.waitResponse(unlock, resp));
+    ASSERT_TRUE(client.waitResponse(exit, resp));
+    EXPECT_EQ(resp.type, CLIENT_EXIT);
+
+    serverThread.join();
+    EXPECT_EQ(reactor.inflightWrites, 0);
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "Uring");
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+// The loop is not running: completions of the ring's writes wait in the
+// loop's queue until the test drains them, one write at a time.
+TEST(EpollServerTest, RequestsWaitForTheirRecordsWrite) {
+    const std::string testFile = "test_epoll_write_order.bin";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}}));
+    ASSERT_TRUE(server.manager->useIoUring(false));
+    EpollServer reactor(server, -1, 1);
+    EpollLoop& loop = *reactor.loops[0];
+
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds), 0);
+    auto conn = std::make_unique<EpollConnection>();
+    EpollConnection* c = conn.get();
+    c->fd = fds[0];
+    c->serial = 1;
+    c->pendingResponses = 0;
+    c->closeAfterFlush = false;
+    c->events = EPOLLIN;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    ASSERT_EQ(epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fds[0], &ev), 0);
+    loop.conns[fds[0]] = std::move(conn);
+    auto nextWrite = [&]() {
+        while (true) {
+            std::lock_guard<std::mutex> lk(loop.completedMutex);
+            if (!loop.completed.empty()) return;
+        }
+    };
+
+    reactor.dispatch(loop, c, {WRITE_LOCK, 1});
+    reactor.dispatch(loop, c, {WRITE_UPDATE, 1, 0, {1, "First", 1.0}});
+    reactor.dispatch(loop, c, {WRITE_UPDATE, 1, 0, {1, "Second", 2.0}});
+    reactor.dispatch(loop, c, {UNLOCK, 1});
+    EXPECT_EQ(c->parked.size(), 2u);
+
+    // Only the first write has been handed to the ring.
+    nextWrite();
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "First");
+    reactor.drainCompletions(loop);
+    ASSERT_EQ(c->parked.size(), 1u);
+    EXPECT_EQ(c->parked[0].msg.type, UNLOCK);
+    EXPECT_EQ(server.manager->tryLockRecord(1, true), LOCK_BUSY);
+
+    nextWrite();
+    reactor.drainCompletions(loop);
+    EXPECT_TRUE(c->parked.empty());
+    EXPECT_TRUE(c->writing.empty());
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "Second");
+    EXPECT_EQ(server.manager->tryLockRecord(1, true), LOCK_OK);
+    server.manager->unlockRecord(1, true);
+
+    std::vector<int> types;
+    Message batch[MAX_BATCH_MESSAGES];
+    while (types.size() < 4) {
+        ssize_t n = ::recv(fds[1], batch, sizeof(batch), 0);
+        ASSERT_GT(n, 0);
+        for (size_t i = 0; i < n / sizeof(Message); ++i) {
+            types.push_back(batch[i].type);
+            EXPECT_EQ(batch[i].id, 1);
+        }
+    }
+    EXPECT_EQ(types, std::vector<int>({WRITE_LOCK, WRITE_UPDATE, WRITE_UPDATE, UNLOCK}));
+    // The reaper may still be waking the loop; stop it before the loop closes.
+    server.manager->uring->close();
+    ::close(fds[1]);
+    std::remove(testFile.c_str());
+}
+
+TEST(EpollServerTest, ScanStreamsOverSocket) {
+    const std::string testFile = "test_epoll_scan.bin";
+    const std::string path = "/tmp/TestEpollScan.sock";
+    std::vector<Employee> employees;
+    for (int i = 0; i < 300; ++i) {
+        employees.push_back({i, "", static_cast<double>(i % 10)});
+        std::snprintf(employees.back().name, NAME_SIZE, "Emp%03d", i);
+    }
+    ServerApp server(makeManager(testFile, employees));
+    server.manager->enableScanIndex();
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(1); });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    uint32_t read = client.submit({READ_OPTIMISTIC, 5});
+    Message scan{SCAN, SCAN_HOURS_RANGE};
+    scan.emp.hours = 3.0;
+    setUpperBound(scan, 3.0);
+    std::vector<Employee> rows;
+    ASSERT_TRUE(client.scan(scan, rows));
+    ASSERT_EQ(rows.size(), 30u);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        EXPECT_EQ(rows[i].num, static_cast<int>(i * 10 + 3));
+    }
+
+    std::strcpy(scan.emp.name, "Emp1");
+    scan.id = SCAN_NAME_PREFIX;
+    scan.emp.num = 5;
+    ASSERT_TRUE(client.scan(scan, rows));
+    EXPECT_EQ(idsOf(rows), std::vector<int>({100, 101, 102, 103, 104}));
+
+    Message resp;
+    ASSERT_TRUE(client.waitResponse(read, resp));
+    EXPECT_STREQ(resp.emp.name, "Emp005");
+    client.sendMessage({CLIENT_EXIT, 0});
+    client.recvMessage(resp);
+
+    serverThread.join();
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+// The transaction spans several packets and waits, parked, for a record
+// another client has locked.
+TEST(EpollServerTest, TransactionWaitsForLockOverSocket) {
+    const std::string testFile = "test_epoll_txn.bin";
+    const std::string path = "/tmp/TestEpollTxn.sock";
+    std::vector<Employee> employees;
+    for (int i = 0; i < 100; ++i) {
+        employees.push_back({i, "Old", 0.0});
+    }
+    ServerApp server(makeManager(testFile, employees));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(2); });
+
+    PipeClient holder(path);
+    ASSERT_TRUE(holder.connect());
+    Message resp;
+    ASSERT_TRUE(holder.sendMessage({WRITE_LOCK, 57}));
+    ASSERT_TRUE(holder.recvMessage(resp));
+    ASSERT_EQ(resp.id, 57);
+
+    std::vector<Employee> changed;
+    for (int i = 99; i >= 0; --i) {
+        changed.push_back({i, "New", static_cast<double>(i)});
+    }
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    std::atomic<bool> committed{false};
+    std::thread txn([&]() { committed = client.transaction(changed); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(committed);
+    EXPECT_STREQ(readFromFile(testFile, 3).name, "Old");
+
+    ASSERT_TRUE(holder.sendMessage({UNLOCK, 57}));
+    ASSERT_TRUE(holder.recvMessage(resp));
+    txn.join();
+    EXPECT_TRUE(committed);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_STREQ(readFromFile(testFile, i).name, "New");
+    }
+
+    holder.sendMessage({CLIENT_EXIT, 0});
+    holder.recvMessage(resp);
+    client.sendMessage({CLIENT_EXIT, 0});
+    client.recvMessage(resp);
+    serverThread.join();
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+TEST(EpollServerTest, LockTimeoutAnswersBusy) {
+    const std::string testFile = "test_epoll_timeout.bin";
+    const std::string path = "/tmp/TestEpollTimeout.sock";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+    server.lockTimeoutMs = 50;
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(2); });
+
+    PipeClient holder(path);
+    PipeClient client(path);
+    ASSERT_TRUE(holder.connect());
+    ASSERT_TRUE(client.connect());
+    Message resp;
+    ASSERT_TRUE(holder.waitResponse(holder.submit({WRITE_LOCK, 1}), resp));
+    ASSERT_EQ(resp.id, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t slow = client.submit({READ_LOCK, 1});
+    uint32_t queued = client.submit({READ_OPTIMISTIC, 1});
+    ASSERT_TRUE(client.waitResponse(client.submit({READ_LOCK, 2}), resp));
+    EXPECT_EQ(resp.id, 2);
+    ASSERT_TRUE(client.waitResponse(slow, resp));
+    EXPECT_EQ(resp.type, LOCK_TIMEOUT);
+    EXPECT_EQ(resp.id, 1);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    // The read queued behind it runs once the lock request gives up.
+    ASSERT_TRUE(client.waitResponse(queued, resp));
+    EXPECT_EQ(resp.type, READ_OPTIMISTIC);
+    EXPECT_EQ(resp.id, 1);
+    ASSERT_TRUE(client.waitResponse(client.submit({UNLOCK, 2}), resp));
+
+    // A commit that times out drops its records.
+    start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(client.transaction({{2, "Changed", 3.0}, {1, "Changed", 3.0}}));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Two");
+
+    ASSERT_TRUE(holder.waitResponse(holder.submit({UNLOCK, 1}), resp));
+    ASSERT_TRUE(client.waitResponse(client.submit({WRITE_LOCK, 1}), resp));
+    EXPECT_EQ(resp.type, WRITE_LOCK);
+    EXPECT_EQ(resp.id, 1);
+    client.waitResponse(client.submit({UNLOCK, 1}), resp);
+    EXPECT_TRUE(client.transaction({{2, "Changed", 3.0}, {1, "Changed", 3.0}}));
+
+    holder.waitResponse(holder.submit({CLIENT_EXIT, 0}), resp);
+    client.waitResponse(client.submit({CLIENT_EXIT, 0}), resp);
+    serverThread.join();
+    listener.close();
+    std::remove(testFile.c_str());
+}
+// Scans run on the pool while the loop keeps answering the connection.
+TEST(EpollServerTest, PoolRunsScansOffTheLoop) {
+    const std::string testFile = "test_epoll_pool.bin";
+    const std::string path = "/tmp/TestEpollPool.sock";
+    std::vector<Employee> employees;
+    for (int i = 0; i < 100; ++i) {
+        employees.push_back({i, "Emp", static_cast<double>(i % 10)});
+    }
+    ServerApp server(makeManager(testFile, employees));
+    server.pool.reset(new WorkStealingPool(2));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(1); });
+
+    PipeClient client(path);
+    ASSERT_TRUE(client.connect());
+    Message scan{SCAN, SCAN_HOURS_RANGE};
+    scan.emp.hours = 3.0;
+    setUpperBound(scan, 3.0);
+    std::vector<Employee> rows;
+    ASSERT_TRUE(client.scan(scan, rows));
+    EXPECT_EQ(rows.size(), 10u);
+
+    uint32_t sum = client.submit({AGGREGATE, AGG_SUM});
+    Message resp;
+    ASSERT_TRUE(client.waitResponse(client.submit({READ_OPTIMISTIC, 42}), resp));
+    EXPECT_EQ(resp.id, 42);
+    ASSERT_TRUE(client.waitResponse(sum, resp));
+    EXPECT_EQ(resp.id, 100);
+    EXPECT_DOUBLE_EQ(resp.emp.hours, 450.0);
+
+    client.waitResponse(client.submit({CLIENT_EXIT, 0}), resp);
+    serverThread.join();
+    EXPECT_EQ(reactor.inflightTasks, 0);
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+// The second read of a record is served from the client's cache; a write by
+// another client reaches it as an INVALIDATE.
+TEST(EpollServerTest, CachedReadsFollowOtherClientsWrites) {
+    const std::string testFile = "test_epoll_cache.bin";
+    const std::string path = "/tmp/TestEpollCache.sock";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    EpollServer reactor(server, listener.listenFd, 1);
+    std::thread serverThread([&]() { reactor.run(2); });
+
+    PipeClient reader(path);
+    PipeClient writer(path);
+    reader.enableCache();
+    ASSERT_TRUE(reader.connect());
+    ASSERT_TRUE(writer.connect());
+    Message resp;
+    ASSERT_TRUE(reader.readCached(1, resp));
+    EXPECT_STREQ(resp.emp.name, "One");
+    ASSERT_TRUE(reader.cache.count(1));
+    EXPECT_TRUE(reader.cache[1].valid);
+    ASSERT_TRUE(reader.readCached(1, resp));
+    EXPECT_STREQ(resp.emp.name, "One");
+
+    ASSERT_TRUE(writer.waitResponse(writer.submit({WRITE_LOCK, 1}), resp));
+    ASSERT_TRUE(writer.waitResponse(writer.submit({WRITE_UPDATE, 1, 0, {1, "Changed", 5.0}}), resp));
+    ASSERT_TRUE(writer.waitResponse(writer.submit({UNLOCK, 1}), resp));
+
+    // The INVALIDATE is on its way; no read after it arrives is stale.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    do {
+        ASSERT_TRUE(reader.readCached(1, resp));
+    } while (std::strcmp(resp.emp.name, "One") == 0 && std::chrono::steady_clock::now() < deadline);
+    EXPECT_STREQ(resp.emp.name, "Changed");
+
+    // A request answered in between is still delivered, after the INVALIDATE.
+    uint32_t other = reader.submit({READ_OPTIMISTIC, 2});
+    ASSERT_TRUE(writer.waitResponse(writer.submit({WRITE_LOCK, 1}), resp));
+    ASSERT_TRUE(writer.waitResponse(writer.submit({DELETE_RECORD, 1}), resp));
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    do {
+        ASSERT_TRUE(reader.readCached(1, resp));
+    } while (resp.id == 1 && std::chrono::steady_clock::now() < deadline);
+    EXPECT_EQ(resp.id, -1);
+    ASSERT_TRUE(reader.waitResponse(other, resp));
+    EXPECT_STREQ(resp.emp.name, "Two");
+
+    reader.waitResponse(reader.submit({CLIENT_EXIT, 0}), resp);
+    writer.waitResponse(writer.submit({CLIENT_EXIT, 0}), resp);
+    serverThread.join();
+    EXPECT_EQ(server.leases.granted.load(), 0u);
+    listener.close();
+    std::remove(testFile.c_str());
+}
+TEST(CoroutineServerTest, SessionsSuspendOnLocksAndWrites) {
+    const std::string testFile = "test_coroutine_session.bin";
+    const std::string path = "/tmp/TestCoroutineSession.sock";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}}));
+    // The update's session waits for the disk write suspended.
+    ASSERT_TRUE(server.manager->useIoUring(false));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    CoroutineServer coServer(server, listener.listenFd);
+    std::thread serverThread([&]() { coServer.run(2); });
+
+    PipeClient holder(path);
+    PipeClient client(path);
+    ASSERT_TRUE(holder.connect());
+    ASSERT_TRUE(client.connect());
+    Message resp;
+    ASSERT_TRUE(holder.waitResponse(holder.submit({WRITE_LOCK, 1}), resp));
+    ASSERT_EQ(resp.id, 1);
+
+    // The blocked read waits in its own coroutine; the session keeps answering.
+    uint32_t blocked = client.submit({READ_LOCK, 1});
+    ASSERT_TRUE(client.waitResponse(client.submit({READ_LOCK, 2}), resp));
+    EXPECT_EQ(resp.id, 2);
+
+    Message update{WRITE_UPDATE, 1};
+    update.emp = {1, "Changed", 5.0};
+    ASSERT_TRUE(holder.waitResponse(holder.submit(update), resp));
+    EXPECT_EQ(resp.id, 1);
+    ASSERT_TRUE(holder.waitResponse(holder.submit({UNLOCK, 1}), resp));
+    ASSERT_TRUE(client.waitResponse(blocked, resp));
+    EXPECT_EQ(resp.type, READ_LOCK);
+    EXPECT_STREQ(resp.emp.name, "Changed");
+
+    // Holding a read lock on 1 now, the client cannot get it for writing.
+    server.lockTimeoutMs = 30;
+    ASSERT_TRUE(holder.waitResponse(holder.submit({READ_LOCK, 1}), resp));
+    ASSERT_TRUE(client.waitResponse(client.submit({UNLOCK, 1}), resp));
+    ASSERT_TRUE(client.waitResponse(client.submit({UNLOCK, 2}), resp));
+    EXPECT_FALSE(client.transaction({{1, "Both", 1.0}, {2, "Both", 2.0}}));
+    ASSERT_TRUE(holder.waitResponse(holder.submit({UNLOCK, 1}), resp));
+    EXPECT_TRUE(client.transaction({{1, "Both", 1.0}, {2, "Both", 2.0}}));
+    EXPECT_STREQ(readFromFile(testFile, 1).name, "Both");
+
+    holder.waitResponse(holder.submit({CLIENT_EXIT, 0}), resp);
+    client.waitResponse(client.submit({CLIENT_EXIT, 0}), resp);
+    serverThread.join();
+    EXPECT_TRUE(coServer.live.empty());
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+// Without io_uring, updates and commits write on the pool: with its only
+// worker held up, the loop still answers other sessions.
+TEST(CoroutineServerTest, WritesLeaveTheLoop) {
+    const std::string testFile = "test_coroutine_writes.bin";
+    const std::string path = "/tmp/TestCoroutineWrites.sock";
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}, {2, "Two", 2.0}, {3, "Three", 3.0}}));
+    server.pool.reset(new WorkStealingPool(1));
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    server.pool->submit([opened]() { opened.wait(); });
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    CoroutineServer coServer(server, listener.listenFd);
+    std::thread serverThread([&]() { coServer.run(2); });
+
+    PipeClient writer(path);
+    PipeClient reader(path);
+    ASSERT_TRUE(writer.connect());
+    ASSERT_TRUE(reader.connect());
+    Message resp;
+    ASSERT_TRUE(writer.waitResponse(writer.submit({WRITE_LOCK, 1}), resp));
+    Message update{WRITE_UPDATE, 1};
+    update.emp = {1, "Changed", 5.0};
+    uint32_t updated = writer.submit(update);
+    uint32_t unlocked = writer.submit({UNLOCK, 1});
+    for (int i = 0; i < 5000 && coServer.inflightWrites == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_TRUE(reader.waitResponse(reader.submit({READ_OPTIMISTIC, 2}), resp));
+    EXPECT_EQ(resp.id, 2);
+    EXPECT_EQ(coServer.inflightWrites, 1);
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "One");
+    ASSERT_EQ(server.manager->tryLockRecord(1, true), LOCK_BUSY);
+
+    gate.set_value();
+    ASSERT_TRUE(writer.waitResponse(updated, resp));
+    EXPECT_EQ(resp.type, WRITE_UPDATE);
+    EXPECT_EQ(resp.id, 1);
+    ASSERT_TRUE(writer.waitResponse(unlocked, resp));
+    EXPECT_STREQ(readFromFile(testFile, 0).name, "Changed");
+
+    EXPECT_TRUE(reader.transaction({{2, "Both", 2.0}, {3, "Both", 3.0}}));
+    EXPECT_STREQ(readFromFile(testFile, 2).name, "Both");
+
+    writer.waitResponse(writer.submit({CLIENT_EXIT, 0}), resp);
+    reader.waitResponse(reader.submit({CLIENT_EXIT, 0}), resp);
+    serverThread.join();
+    listener.close();
+    std::remove(testFile.c_str());
+}
+
+// Sessions are coroutine frames on the loop thread, not threads.
+TEST(CoroutineServerTest, ManySessionsShareOneThread) {
+    const std::string testFile = "test_coroutine_many.bin";
+    const std::string path = "/tmp/TestCoroutineMany.sock";
+    const int clients = 64;
+    ServerApp server(makeManager(testFile, {{1, "One", 1.0}}));
+
+    SocketListener listener(path);
+    ASSERT_TRUE(listener.listen());
+    CoroutineServer coServer(server, listener.listenFd);
+    std::thread serverThread([&]() { coServer.run(clients); });
+
+    std::vector<std::unique_ptr<PipeClient>> sessions;
+    Message resp;
+    int before = 0;
+    for (int i = 0; i < clients; ++i) {
+        sessions.push_back(std::make_unique<PipeClient>(path));
+        ASSERT_TRUE(sessions.back()->connect());
+        ASSERT_TRUE(sessions.back()->waitResponse(sessions.back()->submit({READ_OPTIMISTIC, 1}), resp));
+        EXPECT_EQ(resp.id, 1);
+        if (i == 0) before = threadCount();
+    }
+    EXPECT_EQ(threadCount(), before);
+    EXPECT_EQ(coServer.live.size(), static_cast<size_t>(clients));
+
+    for (auto& session : sessions) {
+        session->waitResponse(session->submit({CLIENT_EXIT, 0}), resp);
+    }
+    serverThread.join();
+    listener.close();
+    std::remove(testFile.c_str());
+}
+#endif
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "common/Employee.h"
+#include "common/Platform.h"
 #include <cstring>
+#include <climits>
 
 TEST(EmployeeTest, ValueAssignment) {
     Employee emp;